@@ -0,0 +1,388 @@
+#include "MeshBenchmark.h"
+#include "ProcessStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <sstream>
+
+namespace {
+const char* kTopologyNames[] = { "line", "ring", "grid", "random", "full" };
+
+// Spin until done() holds or timeout ms pass without it
+bool waitUntil(std::function<bool()> done, int timeout) {
+    sf::Uint64 deadline = benchmarkClock() + static_cast<sf::Uint64>(timeout) * 1000;
+    while (!done()) {
+        if (benchmarkClock() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+Json::Value percentiles(const Histogram& histogram) {
+    Json::Value summary(Json::objectValue);
+    summary["count"] = static_cast<Json::UInt64>(histogram.count());
+    summary["meanMicroseconds"] = histogram.count() ? static_cast<double>(histogram.sum()) / static_cast<double>(histogram.count()) : 0.0;
+    summary["p50Microseconds"] = static_cast<Json::UInt64>(histogram.percentile(0.5));
+    summary["p99Microseconds"] = static_cast<Json::UInt64>(histogram.percentile(0.99));
+    summary["p999Microseconds"] = static_cast<Json::UInt64>(histogram.percentile(0.999));
+    return summary;
+}
+
+double seconds(sf::Uint64 microseconds) {
+    return static_cast<double>(microseconds) / 1000000.0;
+}
+}
+
+sf::Uint64 benchmarkClock() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+const char* topologyName(Topology topology) {
+    return kTopologyNames[topology];
+}
+
+bool parseTopology(std::string name, Topology& topology) {
+    for (int index = 0; index < kTopologyCount; index++) {
+        if (name == kTopologyNames[index]) {
+            topology = static_cast<Topology>(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+BenchmarkHandler::BenchmarkHandler(): received(0) {
+    messageTypes.push_back(BenchmarkMessage::type());
+}
+
+void BenchmarkHandler::handleMessage(std::string, std::string, const std::string& payload) {
+    BenchmarkMessage message;
+    if (!decodePayload(payload, message)) {
+        return;
+    }
+
+    sf::Uint64 now = benchmarkClock();
+    latency.record(now > message.sent ? now - message.sent : 0);
+    received++;
+}
+
+void BenchmarkHandler::reset() {
+    // Stragglers from the last run may still be recording, the histogram has to stay put
+    received = 0;
+    latency.clear();
+}
+
+MeshBenchmark::MeshBenchmark(Topology _topology, unsigned int _size, unsigned int _seed, bool loopback): topology(_topology), size(_size), seed(_seed) {
+    if (loopback) {
+        network = std::make_shared<LoopbackNetwork>();
+    }
+}
+
+MeshBenchmark::~MeshBenchmark() {
+    // Nodes first, they still hold their handlers
+    nodes.clear();
+    handlers.clear();
+}
+
+Json::Value MeshBenchmark::run() {
+    Json::Value result(Json::objectValue);
+    result["topology"] = topologyName(topology);
+    result["transport"] = network ? "loopback" : "tcp";
+    result["nodes"] = size;
+
+    ProcessStats before = processStats();
+    for (unsigned int index = 0; index < size; index++) {
+        std::stringstream name;
+        name << "bench" << index;
+        names.push_back(name.str());
+
+        std::shared_ptr<BenchmarkHandler> handler(new BenchmarkHandler);
+        std::unique_ptr<Transport> transport;
+        if (network) {
+            transport = std::unique_ptr<Transport>(new LoopbackTransport(network));
+        }
+        std::unique_ptr<MeshNode> node(new MeshNode(kListeningPort, name.str(), std::move(transport)));
+        node->registerHandler(handler);
+        nodes.push_back(std::move(node));
+        handlers.push_back(handler);
+    }
+
+    if (!form(result)) {
+        return result;
+    }
+
+    // Everything is connected and idle, so whatever the nodes cost shows up now
+    ProcessStats after = processStats();
+    unsigned int peers = size * (size - 1);
+    Json::Value& process = result["process"];
+    process["residentBytesPerNode"] = static_cast<double>(after.residentBytes - std::min(before.residentBytes, after.residentBytes)) / size;
+    process["threadsPerNode"] = static_cast<double>(after.threads - std::min(before.threads, after.threads)) / size;
+    process["threadsPerPeer"] = peers ? static_cast<double>(after.threads - std::min(before.threads, after.threads)) / peers : 0.0;
+
+    controlOverhead(result);
+    latency(result);
+    unicast(result);
+    broadcast(result);
+    convergence(result);
+    return result;
+}
+
+std::vector<std::pair<unsigned int, unsigned int>> MeshBenchmark::bootstrapEdges() {
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    std::mt19937 random(seed);
+
+    switch (topology) {
+    case kTopologyLine:
+    case kTopologyRing:
+        for (unsigned int index = 1; index < size; index++) {
+            edges.push_back(std::make_pair(index - 1, index));
+        }
+        if (topology == kTopologyRing && size > 2) {
+            edges.push_back(std::make_pair(size - 1, 0u));
+        }
+        break;
+    case kTopologyGrid: {
+        unsigned int width = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(size))));
+        for (unsigned int index = 0; index < size; index++) {
+            if ((index + 1) % width && index + 1 < size) {
+                edges.push_back(std::make_pair(index, index + 1));
+            }
+            if (index + width < size) {
+                edges.push_back(std::make_pair(index, index + width));
+            }
+        }
+        break;
+    }
+    case kTopologyRandom:
+        // A random tree keeps it connected, then half as many edges again at random
+        for (unsigned int index = 1; index < size; index++) {
+            edges.push_back(std::make_pair(static_cast<unsigned int>(random() % index), index));
+        }
+        for (unsigned int extra = 0; extra < size / 2; extra++) {
+            unsigned int a = random() % size, b = random() % size;
+            if (a != b) {
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        break;
+    default:
+        for (unsigned int a = 0; a < size; a++) {
+            for (unsigned int b = a + 1; b < size; b++) {
+                edges.push_back(std::make_pair(a, b));
+            }
+        }
+        break;
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    return edges;
+}
+
+bool MeshBenchmark::form(Json::Value& result) {
+    std::vector<std::pair<unsigned int, unsigned int>> edges = bootstrapEdges();
+    result["bootstrapEdges"] = static_cast<Json::UInt>(edges.size());
+
+    sf::Uint64 began = benchmarkClock();
+    for (auto& edge : edges) {
+        nodes[edge.first]->connectTo(sf::IpAddress::LocalHost, nodes[edge.second]->getListeningPort());
+    }
+
+    // Discovery turns any connected bootstrap into a full mesh
+    bool formed = waitUntil([this]() {
+        for (auto& node : nodes) {
+            if (node->numberOfConnections() < size - 1) {
+                return false;
+            }
+        }
+        return true;
+    }, kFormationTimeout);
+    result["formationMilliseconds"] = static_cast<double>(benchmarkClock() - began) / 1000.0;
+    result["formed"] = formed;
+    if (!formed) {
+        return false;
+    }
+
+    // Routes mean nothing until every link has been pinged enough to have a measurement
+    bool measured = waitUntil([this]() {
+        unsigned long long ping;
+        for (auto& node : nodes) {
+            for (auto& name : names) {
+                if (node->getName() != name && !node->getRoutePing(name, ping)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }, kFormationTimeout);
+    result["routesMeasuredMilliseconds"] = static_cast<double>(benchmarkClock() - began) / 1000.0;
+    result["routesMeasured"] = measured;
+    return measured;
+}
+
+void MeshBenchmark::controlOverhead(Json::Value& result) {
+    sf::Uint64 bytes = sumCounters("mesh_bytes_out_total");
+    sf::Uint64 frames = sumCounters("mesh_frames_out_total");
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleWindow));
+    bytes = sumCounters("mesh_bytes_out_total") - bytes;
+    frames = sumCounters("mesh_frames_out_total") - frames;
+
+    // Nothing but pings, discovery and route optimization is running
+    double window = static_cast<double>(kIdleWindow) / 1000.0;
+    Json::Value& overhead = result["controlTraffic"];
+    overhead["bytesPerSecondPerNode"] = static_cast<double>(bytes) / window / size;
+    overhead["framesPerSecondPerNode"] = static_cast<double>(frames) / window / size;
+    overhead["bytesPerSecondPerPeer"] = static_cast<double>(bytes) / window / (size * (size - 1));
+}
+
+void MeshBenchmark::latency(Json::Value& result) {
+    resetHandlers();
+    BenchmarkHandler& receiver = *handlers.back();
+    BenchmarkMessage message;
+    message.padding.assign(kBenchmarkPadding, 'x');
+
+    // One message at a time, so queueing behind other benchmark traffic never counts
+    unsigned int sent = 0;
+    for (; sent < kLatencyMessages; sent++) {
+        message.sequence = sent;
+        message.sent = benchmarkClock();
+        nodes.front()->send(names.back(), message);
+        if (!waitUntil([&]() { return receiver.received > sent; }, kDeliveryTimeout)) {
+            break;
+        }
+    }
+
+    Json::Value& idle = result["latency"];
+    idle = percentiles(receiver.latency);
+    idle["sent"] = sent;
+}
+
+void MeshBenchmark::unicast(Json::Value& result) {
+    resetHandlers();
+    BenchmarkHandler& receiver = *handlers.back();
+    BenchmarkMessage message;
+    message.padding.assign(kBenchmarkPadding, 'x');
+    std::size_t payload = encodePayload(message).size();
+
+    sf::Uint64 began = benchmarkClock();
+    unsigned int sent = 0;
+    for (; sent < kBenchmarkMessages; sent++) {
+        // Keep a window in flight, the non blocking sockets drop the connection when they fill up
+        if (!waitUntil([&]() { return sent - receiver.received < kBenchmarkWindow; }, kDeliveryTimeout)) {
+            break;
+        }
+        message.sequence = sent;
+        message.sent = benchmarkClock();
+        nodes.front()->send(names.back(), message);
+    }
+    waitUntil([&]() { return receiver.received >= sent; }, kDeliveryTimeout);
+    sf::Uint64 elapsed = benchmarkClock() - began;
+
+    Json::Value& unicast = result["unicast"];
+    unicast["sent"] = sent;
+    unicast["delivered"] = static_cast<Json::UInt64>(receiver.received);
+    unicast["messagesPerSecond"] = static_cast<double>(receiver.received) / seconds(elapsed);
+    unicast["payloadBytesPerSecond"] = static_cast<double>(receiver.received * payload) / seconds(elapsed);
+    unicast["latencyUnderLoad"] = percentiles(receiver.latency);
+}
+
+void MeshBenchmark::broadcast(Json::Value& result) {
+    resetHandlers();
+    BenchmarkMessage message;
+    message.padding.assign(kBenchmarkPadding, 'x');
+    std::size_t payload = encodePayload(message).size();
+
+    // The slowest receiver sets the pace
+    auto slowest = [this]() {
+        unsigned long long least = handlers[1]->received;
+        for (std::size_t index = 2; index < handlers.size(); index++) {
+            least = std::min<unsigned long long>(least, handlers[index]->received);
+        }
+        return least;
+    };
+
+    sf::Uint64 began = benchmarkClock();
+    unsigned int sent = 0;
+    for (; sent < kBenchmarkMessages; sent++) {
+        if (!waitUntil([&]() { return sent - slowest() < kBenchmarkWindow; }, kDeliveryTimeout)) {
+            break;
+        }
+        message.sequence = sent;
+        message.sent = benchmarkClock();
+        nodes.front()->broadcast(message);
+    }
+    waitUntil([&]() { return slowest() >= sent; }, kDeliveryTimeout);
+    sf::Uint64 elapsed = benchmarkClock() - began;
+
+    unsigned long long delivered = totalReceived();
+    Histogram combined;
+    for (std::size_t index = 1; index < handlers.size(); index++) {
+        combined.merge(handlers[index]->latency);
+    }
+
+    Json::Value& broadcast = result["broadcast"];
+    broadcast["sent"] = sent;
+    broadcast["delivered"] = static_cast<Json::UInt64>(delivered);
+    broadcast["expected"] = static_cast<Json::UInt64>(sent) * (size - 1);
+    broadcast["broadcastsPerSecond"] = static_cast<double>(sent) / seconds(elapsed);
+    broadcast["deliveredPayloadBytesPerSecond"] = static_cast<double>(delivered * payload) / seconds(elapsed);
+    broadcast["latencyUnderLoad"] = percentiles(combined);
+}
+
+void MeshBenchmark::convergence(Json::Value& result) {
+    Json::Value& convergence = result["convergence"];
+    if (size < 3) {
+        convergence["skipped"] = "needs a third node to route through";
+        return;
+    }
+
+    // Fail the link between the first two nodes both ways, then time how long the first one
+    // takes to send through somebody else
+    MeshNode& from = *nodes[0];
+    MeshNode& to = *nodes[1];
+    LinkProfile failed;
+    failed.delay = kFailedLinkDelay;
+    convergence["routeHopsBefore"] = static_cast<Json::UInt>(from.getRoute(names[1]).size() - 1);
+
+    sf::Uint64 began = benchmarkClock();
+    from.setLink(names[1], failed);
+    to.setLink(names[0], failed);
+    bool converged = waitUntil([&]() { return from.getRoute(names[1]).size() > 2; }, kConvergenceTimeout);
+
+    convergence["converged"] = converged;
+    convergence["milliseconds"] = static_cast<double>(benchmarkClock() - began) / 1000.0;
+    convergence["routeHopsAfter"] = static_cast<Json::UInt>(from.getRoute(names[1]).size() - 1);
+
+    from.setLink(names[1], LinkProfile());
+    to.setLink(names[0], LinkProfile());
+}
+
+unsigned long long MeshBenchmark::totalReceived() {
+    unsigned long long total = 0;
+    for (auto& handler : handlers) {
+        total += handler->received;
+    }
+    return total;
+}
+
+sf::Uint64 MeshBenchmark::sumCounters(const std::string& family) {
+    sf::Uint64 total = 0;
+    for (auto& node : nodes) {
+        for (auto metric : node->getMetrics().list()) {
+            if (metric->kind == kCounterMetric && metric->name.compare(0, family.size(), family) == 0) {
+                total += metric->counter.get();
+            }
+        }
+    }
+    return total;
+}
+
+void MeshBenchmark::resetHandlers() {
+    for (auto& handler : handlers) {
+        handler->reset();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef __MESHBENCHMARK_H__
+#define __MESHBENCHMARK_H__
+#include <json/json.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MeshNode.h"
+#include "Loopback.h"
+
+const unsigned int kBenchmarkMessages = 2000; // Messages per throughput run
+const unsigned int kLatencyMessages = 500; // Messages sent one at a time for the latency run
+const unsigned int kBenchmarkWindow = 64; // Messages in flight, the sockets are non blocking and refuse more
+const unsigned int kBenchmarkPadding = 64; // Payload bytes on top of the header fields
+const int kFormationTimeout = 60000; // Give up on the mesh forming after x ms
+const int kConvergenceTimeout = 60000; // Give up on routing around a failed link after x ms
+const int kDeliveryTimeout = 10000; // Stop waiting for stragglers x ms after the last send
+const int kIdleWindow = 5000; // Measure control traffic over x ms without any benchmark traffic
+const unsigned int kFailedLinkDelay = 1000; // ms a failed link adds, enough to make any relay better
+
+// How the nodes are first connected, discovery then fills in the rest of the mesh
+enum Topology {
+    kTopologyLine,
+    kTopologyRing,
+    kTopologyGrid,
+    kTopologyRandom,
+    kTopologyFull,
+    kTopologyCount
+};
+
+const char* topologyName(Topology topology);
+bool parseTopology(std::string name, Topology& topology);
+
+// Counts what arrives and how long it took, all nodes share the process so they share a clock
+class BenchmarkHandler : public MessageHandler {
+public:
+    BenchmarkHandler();
+    void handleMessage(std::string sender, std::string type, const std::string& payload);
+    void reset();
+
+    std::atomic<unsigned long long> received;
+    Histogram latency; // Microseconds, cleared by reset() between runs
+};
+
+sf::Uint64 benchmarkClock();
+
+// One topology at one size: builds the mesh, runs every measurement and reports them as JSON.
+// Nodes talk over real sockets, or over in-memory rings when loopback is set.
+class MeshBenchmark {
+public:
+    MeshBenchmark(Topology topology, unsigned int size, unsigned int seed, bool loopback);
+    ~MeshBenchmark();
+
+    Json::Value run();
+
+private:
+    MeshBenchmark(const MeshBenchmark&);
+
+    std::vector<std::pair<unsigned int, unsigned int>> bootstrapEdges();
+    bool form(Json::Value& result);
+    void unicast(Json::Value& result);
+    void latency(Json::Value& result);
+    void broadcast(Json::Value& result);
+    void controlOverhead(Json::Value& result);
+    void convergence(Json::Value& result);
+
+    unsigned long long totalReceived();
+    sf::Uint64 sumCounters(const std::string& family);
+    void resetHandlers();
+
+    Topology topology;
+    unsigned int size;
+    unsigned int seed;
+    std::shared_ptr<LoopbackNetwork> network; // Null on TCP
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<MeshNode>> nodes;
+    std::vector<std::shared_ptr<BenchmarkHandler>> handlers;
+};
+
+#endif // __MESHBENCHMARK_H__
@@ -0,0 +1,85 @@
+#include "Microbenchmark.h"
+#include "Tracing.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+volatile std::size_t microbenchmarkSink = 0;
+
+namespace {
+// Plain per thread counters, operator new can run before anything with a constructor is ready
+TRACE_THREAD_LOCAL bool counting = false;
+TRACE_THREAD_LOCAL sf::Uint64 allocations = 0;
+TRACE_THREAD_LOCAL sf::Uint64 allocatedBytes = 0;
+
+void* allocate(std::size_t size) {
+    if (counting) {
+        allocations++;
+        allocatedBytes += size;
+    }
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+}
+
+// Every allocation in the process goes through here so the benchmarks can count their own
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* memory) throw() {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) throw() {
+    std::free(memory);
+}
+
+// Compilers with sized deallocation call these instead, they must still free what allocate gave out
+void operator delete(void* memory, std::size_t) throw() {
+    operator delete(memory);
+}
+
+void operator delete[](void* memory, std::size_t) throw() {
+    operator delete[](memory);
+}
+
+void beginAllocationCount() {
+    allocations = 0;
+    allocatedBytes = 0;
+    counting = true;
+}
+
+AllocationCount endAllocationCount() {
+    counting = false;
+    AllocationCount count = { allocations, allocatedBytes };
+    return count;
+}
+
+Json::Value MicrobenchmarkResult::toJson() const {
+    Json::Value result(Json::objectValue);
+    result["name"] = name;
+    result["iterations"] = static_cast<Json::UInt64>(iterations);
+    result["nanosecondsPerOp"] = nanosecondsPerOp;
+    result["allocationsPerOp"] = allocationsPerOp;
+    result["bytesPerOp"] = bytesPerOp;
+    return result;
+}
+
+std::string MicrobenchmarkResult::toString() const {
+    std::stringstream line;
+    line << std::left << std::setw(44) << name << std::right << std::fixed;
+    line << std::setprecision(1) << std::setw(12) << nanosecondsPerOp << " ns/op";
+    line << std::setprecision(2) << std::setw(9) << allocationsPerOp << " allocs/op";
+    line << std::setprecision(1) << std::setw(11) << bytesPerOp << " B/op";
+    return line.str();
+}
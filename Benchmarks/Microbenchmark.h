@@ -0,0 +1,77 @@
+#ifndef __MICROBENCHMARK_H__
+#define __MICROBENCHMARK_H__
+#include <SFML/System.hpp>
+#include <json/json.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+const sf::Int64 kMinBatchMicroseconds = 50000; // Double the batch until one run takes at least x us
+const int kBatches = 5; // Timed batches per benchmark, the median is reported
+const unsigned long long kMaxBatchIterations = 1ULL << 30; // Stop growing the batch here even if it's still fast
+
+struct AllocationCount {
+    sf::Uint64 allocations;
+    sf::Uint64 bytes;
+};
+
+// Counts the operator new calls this thread makes in between, the node's own threads aren't counted
+void beginAllocationCount();
+AllocationCount endAllocationCount();
+
+struct MicrobenchmarkResult {
+    std::string name;
+    unsigned long long iterations; // Per batch
+    double nanosecondsPerOp; // Median batch
+    double allocationsPerOp;
+    double bytesPerOp;
+
+    Json::Value toJson() const;
+    std::string toString() const;
+};
+
+// Results written here can't be optimized away
+extern volatile std::size_t microbenchmarkSink;
+
+template <typename Body>
+sf::Int64 timeBatch(Body& body, unsigned long long iterations) {
+    sf::Clock clock;
+    for (unsigned long long iteration = 0; iteration < iterations; iteration++) {
+        body();
+    }
+    return clock.getElapsedTime().asMicroseconds();
+}
+
+// Runs body until a batch is long enough to time, then reports the median of kBatches batches
+template <typename Body>
+MicrobenchmarkResult measure(std::string name, Body body) {
+    unsigned long long iterations = 1;
+    while (timeBatch(body, iterations) < kMinBatchMicroseconds && iterations < kMaxBatchIterations) {
+        iterations *= 2;
+    }
+
+    std::vector<sf::Int64> batches;
+    batches.reserve(kBatches);
+    AllocationCount total = { 0, 0 };
+    for (int batch = 0; batch < kBatches; batch++) {
+        beginAllocationCount();
+        sf::Int64 elapsed = timeBatch(body, iterations);
+        AllocationCount counted = endAllocationCount();
+        batches.push_back(elapsed);
+        total.allocations += counted.allocations;
+        total.bytes += counted.bytes;
+    }
+    std::sort(batches.begin(), batches.end());
+
+    double operations = static_cast<double>(iterations) * kBatches;
+    MicrobenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nanosecondsPerOp = static_cast<double>(batches[kBatches / 2]) * 1000.0 / static_cast<double>(iterations);
+    result.allocationsPerOp = static_cast<double>(total.allocations) / operations;
+    result.bytesPerOp = static_cast<double>(total.bytes) / operations;
+    return result;
+}
+
+#endif // __MICROBENCHMARK_H__
@@ -0,0 +1,286 @@
+#include <SFML/Network.hpp>
+#include <json/json.h>
+
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "MeshNode.h"
+#include "Loopback.h"
+#include "Game.h"
+#include "Microbenchmark.h"
+
+const unsigned int kMeshSizes[] = { 4, 16, 64 }; // Peers in the routing table
+const unsigned int kPayloadSizes[] = { 16, 256, 4096 }; // Padding bytes, 256 and up cross kCompressionThreshold
+const unsigned int kRouteLengths[] = { 2, 4, 8 }; // Hops a forwarded message has been given
+const unsigned int kPlayerCounts[] = { 2, 8, 32 }; // Players on the board
+const unsigned int kRelayEvery = 3; // Every x'th peer is reached through a relay, the rest directly
+
+// Swallows whatever is dispatched to it so handleContent is timed on its own
+class DiscardHandler : public MessageHandler {
+public:
+    DiscardHandler() {
+        messageTypes.push_back(BenchmarkMessage::type());
+    }
+    void handleMessage(std::string, std::string, const std::string& payload) {
+        microbenchmarkSink += payload.size();
+    }
+};
+
+std::string peerName(unsigned int index) {
+    std::stringstream peer;
+    peer << "peer" << index;
+    return peer.str();
+}
+
+std::string benchmarkPayload(unsigned int padding) {
+    // Letters rather than a single repeated byte so the codec has to do some work
+    std::mt19937 random(padding);
+    std::uniform_int_distribution<int> letter('a', 'z');
+
+    BenchmarkMessage message;
+    message.sent = 0;
+    message.sequence = 0;
+    for (unsigned int character = 0; character < padding; character++) {
+        message.padding.push_back(static_cast<char>(letter(random)));
+    }
+    return encodePayload(message);
+}
+
+// Friend of MeshNode and Game, sets up their private state as a formed mesh and a running game would have it
+class MicrobenchmarkAccess {
+public:
+    MicrobenchmarkAccess(std::string _filter): filter(_filter) {}
+
+    void benchmarkMeshNode(MeshNode& node);
+    void benchmarkGame(Game& game);
+    Json::Value toJson() const;
+
+private:
+    template <typename Body>
+    void run(std::string name, Body body) {
+        if (name.find(filter) == std::string::npos) {
+            return;
+        }
+        results.push_back(measure(name, body));
+        std::cout << results.back().toString() << std::endl;
+    }
+
+    void populate(MeshNode& node, unsigned int peers, bool compression);
+    void clear(MeshNode& node);
+    void placePlayers(Game& game, unsigned int count, bool chasing);
+
+    std::string filter;
+    std::vector<MicrobenchmarkResult> results;
+};
+
+void MicrobenchmarkAccess::populate(MeshNode& node, unsigned int peers, bool compression) {
+    clear(node);
+
+    // Connections without channels: nothing ever connects to this node, so the listener never looks at them
+    for (unsigned int index = 0; index < peers; index++) {
+        std::string peer = peerName(index);
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->compression = compression;
+        node.connections[peer] = std::move(connection);
+
+        std::vector<std::string>& route = node.routingTable[peer];
+        route.push_back(node.name);
+        if (index % kRelayEvery == kRelayEvery - 1) {
+            route.push_back(peerName(index - 1));
+        }
+        route.push_back(peer);
+    }
+}
+
+void MicrobenchmarkAccess::clear(MeshNode& node) {
+    node.routingTable.clear();
+    node.connections.clear();
+}
+
+void MicrobenchmarkAccess::benchmarkMeshNode(MeshNode& node) {
+    for (auto peers : kMeshSizes) {
+        populate(node, peers, false);
+        std::string routed = peerName(kRelayEvery - 1);
+        std::string payload = benchmarkPayload(kPayloadSizes[1]);
+
+        std::stringstream suffix;
+        suffix << "/" << peers << "peers";
+
+        run("craftMessage/routed" + suffix.str(), [&]() {
+            Message message = node.craftMessage(routed, BenchmarkMessage::type(), payload);
+            microbenchmarkSink += message.route.size();
+        });
+        run("craftMessage/direct" + suffix.str(), [&]() {
+            Message message = node.craftMessage(routed, BenchmarkMessage::type(), payload, true);
+            microbenchmarkSink += message.route.size();
+        });
+
+        // A miss walks every route, a hit also rewrites the routes the relay was in
+        run("purgeFromRoutes/miss" + suffix.str(), [&]() {
+            node.purgeFromRoutes("nobody");
+        });
+        std::map<std::string, std::vector<std::string>> formed = node.routingTable;
+        run("purgeFromRoutes/restoreOnly" + suffix.str(), [&]() {
+            node.routingTable = formed;
+        });
+        run("purgeFromRoutes/hit+restore" + suffix.str(), [&]() {
+            node.routingTable = formed;
+            node.purgeFromRoutes(peerName(kRelayEvery - 2));
+        });
+    }
+
+    for (auto padding : kPayloadSizes) {
+        std::stringstream suffix;
+        suffix << "/" << padding << "B";
+        std::string payload = benchmarkPayload(padding);
+
+        for (int compression = 0; compression < 2; compression++) {
+            populate(node, kMeshSizes[1], compression != 0);
+            std::string peer = peerName(0);
+            std::string label = suffix.str() + (compression ? "/compressed" : "");
+            Message message = node.craftMessage(peer, BenchmarkMessage::type(), payload);
+
+            if (!compression) {
+                run("craftMessage/payload" + label, [&]() {
+                    Message crafted = node.craftMessage(peer, BenchmarkMessage::type(), payload);
+                    microbenchmarkSink += crafted.payload.size();
+                });
+            }
+            run("packFrame" + label, [&]() {
+                sf::Packet packet;
+                node.packFrame(peer, message, packet);
+                microbenchmarkSink += packet.getDataSize();
+            });
+
+            // listen() parses every frame out of a freshly received packet, so each run starts from the bytes
+            sf::Packet frame;
+            node.packFrame(peer, message, frame);
+            std::string bytes(static_cast<const char*>(frame.getData()), frame.getDataSize());
+            run("unpackFrame" + label, [&]() {
+                sf::Packet packet;
+                packet.append(bytes.data(), bytes.size());
+                Message parsed;
+                if (node.unpackFrame(packet, parsed)) {
+                    microbenchmarkSink += parsed.payload.size();
+                }
+            });
+        }
+
+        Message delivered;
+        delivered.type = BenchmarkMessage::type();
+        delivered.route.push_back(peerName(0));
+        delivered.route.push_back(node.name);
+        delivered.payload = payload;
+        run("handleContent" + suffix.str(), [&]() {
+            node.handleContent(delivered);
+        });
+    }
+
+    for (auto hops : kRouteLengths) {
+        // Forwarded messages only reach nodes that aren't the destination, so we sit just before it
+        Message forwarded;
+        forwarded.type = BenchmarkMessage::type();
+        for (unsigned int hop = 0; hop + 2 < hops; hop++) {
+            forwarded.route.push_back(peerName(hop));
+        }
+        forwarded.route.push_back(node.name);
+        forwarded.route.push_back(peerName(hops));
+
+        std::stringstream name;
+        name << "forwardMessage/nextHop/" << hops << "hops";
+        run(name.str(), [&]() {
+            microbenchmarkSink += node.nextHop(forwarded).size();
+        });
+    }
+
+    clear(node);
+}
+
+void MicrobenchmarkAccess::placePlayers(Game& game, unsigned int count, bool chasing) {
+    game.players.clear();
+    game.occupancy.clear();
+
+    // Spread out in a row so nobody touches, except the one standing next to us when chasing
+    game.placePlayer(game.playerName, 1, 1);
+    for (unsigned int index = 1; index < count; index++) {
+        if (chasing && index == 1) {
+            game.placePlayer(peerName(index), 2, 1);
+        } else {
+            game.placePlayer(peerName(index), 1 + index * (kDistanceAmount + 2), 1);
+        }
+    }
+
+    game.taggedPlayer = game.playerName;
+    game.previouslyTaggedPlayer = game.playerName;
+    game.madeDistance = true;
+}
+
+void MicrobenchmarkAccess::benchmarkGame(Game& game) {
+    for (auto count : kPlayerCounts) {
+        std::stringstream suffix;
+        suffix << "/" << count << "players";
+
+        // Nobody in reach: the neighbour lookup on every tick
+        placePlayers(game, count, false);
+        run("checkForTag/clear" + suffix.str(), [&]() {
+            game.checkForTag();
+        });
+
+        // Tagged and still too close to tag back: the distance check on every tick
+        placePlayers(game, count, true);
+        game.checkForTag();
+        run("checkForTag/chasing" + suffix.str(), [&]() {
+            game.checkForTag();
+        });
+    }
+
+    game.players.clear();
+    game.occupancy.clear();
+}
+
+Json::Value MicrobenchmarkAccess::toJson() const {
+    Json::Value list(Json::arrayValue);
+    for (auto& result : results) {
+        list.append(result.toJson());
+    }
+    return list;
+}
+
+// Microbenchmarks [results.json] [only names containing this]
+int main(int argc, char* argv[]) {
+    std::string filename = argc > 1 ? argv[1] : "microbenchmarks.json";
+    std::string filter = argc > 2 ? argv[2] : "";
+
+    // Logging inside the timed loops would measure the logger instead
+    setLogLevel(kLogWarning);
+
+    MicrobenchmarkAccess access(filter);
+    {
+        // Nothing connects, a loopback transport just spares us a socket and the public address lookup
+        MeshNode node(kListeningPort, "local", std::unique_ptr<Transport>(new LoopbackTransport(std::make_shared<LoopbackNetwork>())));
+        node.registerHandler(std::make_shared<DiscardHandler>());
+        access.benchmarkMeshNode(node);
+    }
+    {
+        Game game("local");
+        access.benchmarkGame(game);
+    }
+
+    Json::Value results(Json::objectValue);
+    results["timestamp"] = static_cast<Json::UInt64>(std::time(nullptr));
+    results["batches"] = kBatches;
+    results["minBatchMicroseconds"] = static_cast<Json::Int64>(kMinBatchMicroseconds);
+    results["results"] = access.toJson();
+
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) {
+        std::cerr << "Unable to write " << filename << std::endl;
+        return 1;
+    }
+    file << results.toStyledString();
+    std::cerr << "Results written to " << filename << std::endl;
+    return 0;
+}
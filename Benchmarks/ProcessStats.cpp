@@ -0,0 +1,53 @@
+#include "ProcessStats.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <fstream>
+#include <string>
+#endif
+
+#ifdef _WIN32
+ProcessStats processStats() {
+    ProcessStats stats = { 0, 0 };
+
+    PROCESS_MEMORY_COUNTERS memory;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) {
+        stats.residentBytes = memory.WorkingSetSize;
+    }
+
+    // Windows only hands out threads for the whole system, count the ones that are ours
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        THREADENTRY32 thread;
+        thread.dwSize = sizeof(thread);
+        DWORD process = GetCurrentProcessId();
+        for (BOOL more = Thread32First(snapshot, &thread); more; more = Thread32Next(snapshot, &thread)) {
+            if (thread.th32OwnerProcessID == process) {
+                stats.threads++;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+    return stats;
+}
+#else
+ProcessStats processStats() {
+    ProcessStats stats = { 0, 0 };
+
+    std::ifstream status("/proc/self/status");
+    std::string field;
+    while (status >> field) {
+        if (field == "VmRSS:") {
+            status >> stats.residentBytes;
+            stats.residentBytes *= 1024;
+        } else if (field == "Threads:") {
+            status >> stats.threads;
+        }
+    }
+    return stats;
+}
+#endif
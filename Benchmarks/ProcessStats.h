@@ -0,0 +1,13 @@
+#ifndef __PROCESSSTATS_H__
+#define __PROCESSSTATS_H__
+#include <SFML/Config.hpp>
+
+struct ProcessStats {
+    sf::Uint64 residentBytes; // Working set
+    unsigned int threads;
+};
+
+// What this process is using right now, zeros if the platform won't say
+ProcessStats processStats();
+
+#endif // __PROCESSSTATS_H__
@@ -0,0 +1,83 @@
+#include <SFML/Network.hpp>
+#include <json/json.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "MeshBenchmark.h"
+
+const unsigned int kBenchmarkSeed = 1; // Random topologies are the same run to run
+
+// MeshBenchmark [results.json] [topology|all] [node counts, comma separated] [tcp|loopback]
+int main(int argc, char* argv[]) {
+    std::string filename = argc > 1 ? argv[1] : "benchmark.json";
+    std::string topologyArgument = argc > 2 ? argv[2] : "all";
+    std::string sizeArgument = argc > 3 ? argv[3] : "4,8";
+    std::string transportArgument = argc > 4 ? argv[4] : "tcp";
+
+    if (transportArgument != "tcp" && transportArgument != "loopback") {
+        std::cerr << "Unknown transport " << transportArgument << ", try tcp or loopback" << std::endl;
+        return 1;
+    }
+    bool loopback = transportArgument == "loopback";
+
+    std::vector<Topology> topologies;
+    Topology topology;
+    if (topologyArgument == "all") {
+        for (int index = 0; index < kTopologyCount; index++) {
+            topologies.push_back(static_cast<Topology>(index));
+        }
+    } else if (parseTopology(topologyArgument, topology)) {
+        topologies.push_back(topology);
+    } else {
+        std::cerr << "Unknown topology " << topologyArgument << ", try line, ring, grid, random, full or all" << std::endl;
+        return 1;
+    }
+
+    std::vector<unsigned int> sizes;
+    std::stringstream sizeList(sizeArgument);
+    std::string size;
+    while (std::getline(sizeList, size, ',')) {
+        if (std::atoi(size.c_str()) < 2) {
+            std::cerr << "A mesh needs at least 2 nodes, not " << size << std::endl;
+            return 1;
+        }
+        sizes.push_back(static_cast<unsigned int>(std::atoi(size.c_str())));
+    }
+
+    // The nodes' own chatter would drown out the results
+    setLogLevel(kLogWarning);
+
+    Json::Value results(Json::objectValue);
+    results["timestamp"] = static_cast<Json::UInt64>(std::time(nullptr));
+    results["seed"] = kBenchmarkSeed;
+    Json::Value& configuration = results["configuration"];
+    configuration["messages"] = kBenchmarkMessages;
+    configuration["latencyMessages"] = kLatencyMessages;
+    configuration["window"] = kBenchmarkWindow;
+    configuration["paddingBytes"] = kBenchmarkPadding;
+    configuration["idleWindowMilliseconds"] = kIdleWindow;
+    configuration["failedLinkDelayMilliseconds"] = kFailedLinkDelay;
+    configuration["transport"] = transportArgument;
+    results["runs"] = Json::Value(Json::arrayValue);
+
+    for (auto topology : topologies) {
+        for (auto size : sizes) {
+            std::cerr << "Running " << topologyName(topology) << " with " << size << " nodes over " << transportArgument << std::endl;
+            MeshBenchmark benchmark(topology, size, kBenchmarkSeed, loopback);
+            results["runs"].append(benchmark.run());
+        }
+    }
+
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) {
+        std::cerr << "Unable to write " << filename << std::endl;
+        return 1;
+    }
+    file << results.toStyledString();
+    std::cerr << "Results written to " << filename << std::endl;
+    return 0;
+}
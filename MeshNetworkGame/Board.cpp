@@ -0,0 +1,299 @@
+#include "Board.h"
+#include "Logging.h"
+
+#include <cstring>
+
+Board::Board(): width(0), height(0), chunksWide(0), chunksHigh(0), mappedWalls(nullptr), rowStride(0), labelFont(nullptr) {
+}
+
+bool Board::open(std::string filename) {
+    chunks.clear();
+    spawnPoints.clear();
+    width = height = chunksWide = chunksHigh = 0;
+    visibleChunks = sf::IntRect();
+
+    map.close();
+    mappedWalls = nullptr;
+    if (file.is_open()) {
+        file.close();
+    }
+
+    // Only a file without the binary magic is read as text, a broken binary board is an error
+    bool binary = false;
+    return openBinary(filename, binary) || (!binary && openText(filename));
+}
+
+bool Board::openBinary(std::string filename, bool& binary) {
+    // Missing and unmappable files, empty ones included, are left for the text reader
+    if (!map.open(filename)) {
+        return false;
+    }
+
+    BoardHeader header;
+    if (map.size() < sizeof(header) || std::memcmp(map.data(), kBoardMagic, sizeof(kBoardMagic)) != 0) {
+        map.close();
+        return false;
+    }
+    binary = true;
+    std::memcpy(&header, map.data(), sizeof(header));
+
+    // 64 bit throughout, a hostile header mustn't wrap these into something that fits the file
+    sf::Uint64 wide = (static_cast<sf::Uint64>(header.width) + kChunkSize - 1) / kChunkSize;
+    sf::Uint64 high = (static_cast<sf::Uint64>(header.height) + kChunkSize - 1) / kChunkSize;
+    sf::Uint64 spawnBytes = static_cast<sf::Uint64>(header.spawnCount) * 2 * sizeof(sf::Uint32);
+    sf::Uint64 expected = sizeof(header) + spawnBytes + wide * high * kChunkWords * sizeof(sf::Uint32);
+    if (header.version != kBoardVersion || header.chunkSize != kChunkSize) {
+        LOG(kLogError, kLogGame) << "Board " << filename << " is version " << header.version << " with " << header.chunkSize << " tile chunks, expected version " << kBoardVersion << " with " << kChunkSize << std::endl;
+        map.close();
+        return false;
+    }
+    if (wide * high > 0xFFFFFFFFULL || static_cast<sf::Uint64>(map.size()) < expected) {
+        LOG(kLogError, kLogGame) << "Board " << filename << " is " << map.size() << " bytes, its " << header.width << "x" << header.height << " header needs " << expected << std::endl;
+        map.close();
+        return false;
+    }
+
+    const sf::Uint32* spawns = reinterpret_cast<const sf::Uint32*>(map.data() + sizeof(header));
+    for (sf::Uint32 i = 0; i < header.spawnCount; i++) {
+        spawnPoints.push_back(sf::Vector2u(spawns[i * 2], spawns[i * 2 + 1]));
+    }
+
+    // Nothing else is read, the OS pages the walls in as chunks are touched
+    width = header.width;
+    height = header.height;
+    chunksWide = static_cast<unsigned int>(wide);
+    chunksHigh = static_cast<unsigned int>(high);
+    mappedWalls = reinterpret_cast<const sf::Uint32*>(map.data() + sizeof(header) + static_cast<std::size_t>(spawnBytes));
+    return true;
+}
+
+bool Board::openText(std::string filename) {
+    file.clear();
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Rows are fixed width, so the first one tells us the layout of the whole file
+    std::string firstRow;
+    std::getline(file, firstRow);
+    if (!firstRow.empty() && firstRow[firstRow.size() - 1] == '\r') {
+        firstRow.erase(firstRow.size() - 1);
+    }
+    if (firstRow.empty()) {
+        return false;
+    }
+    rowStride = static_cast<std::streamoff>(file.tellg());
+
+    file.clear();
+    file.seekg(0, std::ios::end);
+    std::streamoff fileSize = static_cast<std::streamoff>(file.tellg());
+
+    width = static_cast<unsigned int>(firstRow.size());
+    height = static_cast<unsigned int>((fileSize + rowStride - 1) / rowStride);
+    // Allow the last row to go without a line ending
+    if (fileSize - (height - 1) * rowStride < width) {
+        height--;
+    }
+    chunksWide = (width + kChunkSize - 1) / kChunkSize;
+    chunksHigh = (height + kChunkSize - 1) / kChunkSize;
+
+    return height > 0;
+}
+
+bool Board::isWall(unsigned int x, unsigned int y) {
+    if (x >= width || y >= height) {
+        return true;
+    }
+
+    const sf::Uint32* walls = wallsAt(x / kChunkSize, y / kChunkSize);
+    unsigned int bit = (y % kChunkSize) * kChunkSize + (x % kChunkSize);
+    return (walls[bit / 32] >> (bit % 32)) & 1;
+}
+
+void Board::stream(const sf::IntRect& visibleTiles) {
+    int left = std::max(visibleTiles.left, 0) / static_cast<int>(kChunkSize);
+    int top = std::max(visibleTiles.top, 0) / static_cast<int>(kChunkSize);
+    int right = std::min((visibleTiles.left + visibleTiles.width - 1) / static_cast<int>(kChunkSize), static_cast<int>(chunksWide) - 1);
+    int bottom = std::min((visibleTiles.top + visibleTiles.height - 1) / static_cast<int>(kChunkSize), static_cast<int>(chunksHigh) - 1);
+    sf::IntRect visible(left, top, std::max(right - left + 1, 0), std::max(bottom - top + 1, 0));
+
+    if (visible == visibleChunks) {
+        return;
+    }
+    visibleChunks = visible;
+
+    // Drop chunks that have fallen well outside the view
+    for (auto chunk = chunks.begin(); chunk != chunks.end();) {
+        int chunkX = static_cast<int>(chunk->first % chunksWide);
+        int chunkY = static_cast<int>(chunk->first / chunksWide);
+        if (chunkX < left - static_cast<int>(kChunkMargin) || chunkX > right + static_cast<int>(kChunkMargin) ||
+            chunkY < top - static_cast<int>(kChunkMargin) || chunkY > bottom + static_cast<int>(kChunkMargin)) {
+            chunk = chunks.erase(chunk);
+        } else {
+            ++chunk;
+        }
+    }
+
+    for (int chunkY = top; chunkY <= bottom; chunkY++) {
+        for (int chunkX = left; chunkX <= right; chunkX++) {
+            Chunk& chunk = chunkAt(chunkX, chunkY);
+            if (!chunk.built) {
+                buildVertices(chunk, chunkX, chunkY);
+            }
+        }
+    }
+}
+
+void Board::draw(sf::RenderTarget& target, float tileSize) {
+    // Vertices are in tile units, scaled up to pixels here
+    sf::RenderStates states;
+    states.transform.scale(tileSize, tileSize);
+
+    sf::Vertex floor[] = {
+        sf::Vertex(sf::Vector2f(0.0f, 0.0f), sf::Color::White),
+        sf::Vertex(sf::Vector2f(static_cast<float>(width), 0.0f), sf::Color::White),
+        sf::Vertex(sf::Vector2f(static_cast<float>(width), static_cast<float>(height)), sf::Color::White),
+        sf::Vertex(sf::Vector2f(0.0f, static_cast<float>(height)), sf::Color::White)
+    };
+    target.draw(floor, 4, sf::Quads, states);
+
+    for (int chunkY = visibleChunks.top; chunkY < visibleChunks.top + visibleChunks.height; chunkY++) {
+        for (int chunkX = visibleChunks.left; chunkX < visibleChunks.left + visibleChunks.width; chunkX++) {
+            auto chunk = chunks.find(chunkIndex(chunkX, chunkY));
+            if (chunk != chunks.end()) {
+                target.draw(chunk->second.vertices, states);
+                for (auto& label : chunk->second.labels) {
+                    target.draw(label, states);
+                }
+            }
+        }
+    }
+}
+
+const sf::Uint32* Board::wallsAt(unsigned int chunkX, unsigned int chunkY) {
+    if (mappedWalls) {
+        return mappedWalls + static_cast<std::size_t>(chunkIndex(chunkX, chunkY)) * kChunkWords;
+    }
+    return chunkAt(chunkX, chunkY).walls.data();
+}
+
+Board::Chunk& Board::chunkAt(unsigned int chunkX, unsigned int chunkY) {
+    unsigned int index = chunkIndex(chunkX, chunkY);
+    auto chunk = chunks.find(index);
+    if (chunk != chunks.end()) {
+        return chunk->second;
+    }
+
+    Chunk& newChunk = chunks[index];
+    loadChunk(newChunk, chunkX, chunkY);
+    return newChunk;
+}
+
+void Board::loadChunk(Chunk& chunk, unsigned int chunkX, unsigned int chunkY) {
+    // Binary maps are read straight out of the mapping
+    if (mappedWalls) {
+        return;
+    }
+
+    chunk.walls.assign(kChunkWords, 0);
+
+    unsigned int left = chunkX * kChunkSize;
+    unsigned int top = chunkY * kChunkSize;
+    unsigned int columns = std::min(kChunkSize, width - left);
+    unsigned int rows = std::min(kChunkSize, height - top);
+
+    // One read per row segment instead of a get() per tile
+    std::vector<char> row(columns);
+    file.clear();
+    for (unsigned int y = 0; y < rows; y++) {
+        file.seekg((top + y) * rowStride + left);
+        if (!file.read(row.data(), columns)) {
+            break;
+        }
+
+        for (unsigned int x = 0; x < columns; x++) {
+            if (row[x] == '1') {
+                unsigned int bit = y * kChunkSize + x;
+                chunk.walls[bit / 32] |= 1u << (bit % 32);
+            }
+        }
+    }
+}
+
+void Board::buildVertices(Chunk& chunk, unsigned int chunkX, unsigned int chunkY) {
+    chunk.vertices.setPrimitiveType(sf::Quads);
+    chunk.vertices.clear();
+    chunk.labels.clear();
+
+    unsigned int left = chunkX * kChunkSize;
+    unsigned int top = chunkY * kChunkSize;
+    unsigned int columns = std::min(kChunkSize, width - left);
+    unsigned int rows = std::min(kChunkSize, height - top);
+    const sf::Uint32* walls = wallsAt(chunkX, chunkY);
+
+    for (unsigned int y = 0; y < rows; y++) {
+        for (unsigned int x = 0; x < columns; x++) {
+            float tileX = static_cast<float>(left + x);
+            float tileY = static_cast<float>(top + y);
+
+            unsigned int bit = y * kChunkSize + x;
+            if ((walls[bit / 32] >> (bit % 32)) & 1) {
+                chunk.vertices.append(sf::Vertex(sf::Vector2f(tileX, tileY), sf::Color::Black));
+                chunk.vertices.append(sf::Vertex(sf::Vector2f(tileX + 1.0f, tileY), sf::Color::Black));
+                chunk.vertices.append(sf::Vertex(sf::Vector2f(tileX + 1.0f, tileY + 1.0f), sf::Color::Black));
+                chunk.vertices.append(sf::Vertex(sf::Vector2f(tileX, tileY + 1.0f), sf::Color::Black));
+            }
+
+            if (labelFont) {
+                sf::Text text;
+                text.setFont(*labelFont);
+                text.setString(std::to_string(top + y) + ":" + std::to_string(left + x));
+                text.setCharacterSize(50);
+                text.setColor(sf::Color::Black);
+                text.setScale(0.01f, 0.01f);
+                text.setPosition(tileX, tileY);
+                chunk.labels.push_back(text);
+            }
+        }
+    }
+
+    chunk.built = true;
+}
+
+bool Board::convert(std::string textFilename, std::string binaryFilename, const std::vector<sf::Vector2u>& spawnPoints) {
+    Board board;
+    if (!board.openText(textFilename)) {
+        return false;
+    }
+
+    std::ofstream output(binaryFilename, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+
+    BoardHeader header;
+    std::memcpy(header.magic, kBoardMagic, sizeof(kBoardMagic));
+    header.version = kBoardVersion;
+    header.width = board.width;
+    header.height = board.height;
+    header.chunkSize = kChunkSize;
+    header.spawnCount = static_cast<sf::Uint32>(spawnPoints.size());
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (auto& spawn : spawnPoints) {
+        sf::Uint32 point[] = { spawn.x, spawn.y };
+        output.write(reinterpret_cast<const char*>(point), sizeof(point));
+    }
+
+    // Stream the text through a chunk at a time so huge boards never sit in memory whole
+    for (unsigned int chunkY = 0; chunkY < board.chunksHigh; chunkY++) {
+        for (unsigned int chunkX = 0; chunkX < board.chunksWide; chunkX++) {
+            Chunk chunk;
+            board.loadChunk(chunk, chunkX, chunkY);
+            output.write(reinterpret_cast<const char*>(chunk.walls.data()), kChunkWords * sizeof(sf::Uint32));
+        }
+    }
+
+    return output.good();
+}
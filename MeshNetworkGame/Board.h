@@ -0,0 +1,95 @@
+#ifndef __BOARD_H__
+#define __BOARD_H__
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "MappedFile.h"
+
+const unsigned int kChunkSize = 64; // Chunks are x by x tiles
+const unsigned int kChunkMargin = 1; // Keep chunks within x chunks of the view loaded
+const unsigned int kChunkWords = kChunkSize * kChunkSize / 32; // 32 bit words of wall bits per chunk
+
+// Binary map layout, in the little endian order x86 hosts write it:
+//     header, spawnCount spawn points as (x, y) pairs, then kChunkWords words of wall bits
+//     for each chunk, chunks in row major order and tiles row major within a chunk
+const char kBoardMagic[4] = { 'M', 'N', 'G', 'B' };
+const sf::Uint32 kBoardVersion = 1;
+
+struct BoardHeader {
+    char magic[4];
+    sf::Uint32 version;
+    sf::Uint32 width;
+    sf::Uint32 height;
+    sf::Uint32 chunkSize;
+    sf::Uint32 spawnCount;
+};
+
+// A board of any size, stored as one wall bitmap per chunk. Binary maps are memory mapped
+// and read in place. Text maps only have their first row read on open, chunks are pulled
+// from the file the first time they're needed and dropped again once they're well out of
+// view, so memory follows the visible area rather than the whole map.
+class Board {
+public:
+    Board();
+
+    bool open(std::string filename);
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+    const std::vector<sf::Vector2u>& getSpawnPoints() const { return spawnPoints; }
+
+    // Write a text board out in the binary format
+    static bool convert(std::string textFilename, std::string binaryFilename, const std::vector<sf::Vector2u>& spawnPoints);
+
+    // Anything off the board counts as a wall
+    bool isWall(unsigned int x, unsigned int y);
+
+    // Load what's inside the visible tile area, evict what's far outside it, then draw
+    void stream(const sf::IntRect& visibleTiles);
+    void draw(sf::RenderTarget& target, float tileSize);
+    std::size_t visibleChunkCount() const { return static_cast<std::size_t>(visibleChunks.width * visibleChunks.height); }
+    std::size_t loadedChunks() const { return chunks.size(); }
+
+    // Label every tile with its coordinates, for debugging
+    void setLabelFont(const sf::Font* font) { labelFont = font; }
+
+private:
+    struct Chunk {
+        std::vector<sf::Uint32> walls; // One bit per tile, row major
+        sf::VertexArray vertices; // Wall quads only, the floor is a single quad under everything
+        std::vector<sf::Text> labels;
+        bool built;
+
+        Chunk(): built(false) {}
+    };
+
+    bool openBinary(std::string filename, bool& binary); // binary is set once the file is known not to be a text board
+    bool openText(std::string filename);
+    const sf::Uint32* wallsAt(unsigned int chunkX, unsigned int chunkY);
+    Chunk& chunkAt(unsigned int chunkX, unsigned int chunkY);
+    void loadChunk(Chunk& chunk, unsigned int chunkX, unsigned int chunkY);
+    void buildVertices(Chunk& chunk, unsigned int chunkX, unsigned int chunkY);
+    unsigned int chunkIndex(unsigned int chunkX, unsigned int chunkY) const { return chunkY * chunksWide + chunkX; }
+
+    unsigned int width;
+    unsigned int height;
+    unsigned int chunksWide;
+    unsigned int chunksHigh;
+    std::unordered_map<unsigned int, Chunk> chunks;
+    sf::IntRect visibleChunks;
+
+    std::vector<sf::Vector2u> spawnPoints;
+
+    MappedFile map;
+    const sf::Uint32* mappedWalls; // Start of the wall bits in a binary map, null for text
+
+    std::ifstream file;
+    std::streamoff rowStride; // Bytes per text row, including the line ending
+    const sf::Font* labelFont;
+};
+
+#endif // __BOARD_H__
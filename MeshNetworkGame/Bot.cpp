@@ -0,0 +1,114 @@
+#include "Bot.h"
+#include "Game.h"
+
+#include <cstdlib>
+#include <limits>
+
+namespace {
+const sf::Keyboard::Key kMoves[] = { sf::Keyboard::W, sf::Keyboard::A, sf::Keyboard::S, sf::Keyboard::D };
+const int kMoveX[] = { 0, -1, 0, 1 };
+const int kMoveY[] = { -1, 0, 1, 0 };
+}
+
+Bot::Bot(BotPolicy _policy, unsigned int seed, std::shared_ptr<Pathfinder> _pathfinder): policy(_policy), random(seed), pathfinder(_pathfinder) {
+}
+
+bool Bot::parsePolicy(const std::string& name, BotPolicy& policy) {
+    if (name == "random") {
+        policy = kRandomWalk;
+    } else if (name == "chase") {
+        policy = kChase;
+    } else if (name == "flee") {
+        policy = kFlee;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+sf::Keyboard::Key Bot::chooseMove(const std::string& self, const std::map<std::string, Player>& players, const std::string& taggedPlayer, Board& board, const OccupancyGrid& occupancy) {
+    auto me = players.find(self);
+    if (me == players.end()) {
+        return sf::Keyboard::Unknown;
+    }
+    unsigned int x = me->second.x;
+    unsigned int y = me->second.y;
+
+    if (policy == kRandomWalk) {
+        return randomMove(x, y, board, occupancy);
+    }
+
+    if (self == taggedPlayer) {
+        // Go after whoever is closest
+        const Player* nearest = nullptr;
+        unsigned int nearestDistance = std::numeric_limits<unsigned int>::max();
+        for (auto& player : players) {
+            unsigned int distance = std::abs(static_cast<int>(player.second.x) - static_cast<int>(x)) + std::abs(static_cast<int>(player.second.y) - static_cast<int>(y));
+            if (player.first != self && distance < nearestDistance) {
+                nearest = &player.second;
+                nearestDistance = distance;
+            }
+        }
+        return nearest ? moveRelativeTo(x, y, nearest->x, nearest->y, true, board, occupancy) : randomMove(x, y, board, occupancy);
+    }
+
+    auto tagged = players.find(taggedPlayer);
+    if (policy == kFlee && tagged != players.end()) {
+        return moveRelativeTo(x, y, tagged->second.x, tagged->second.y, false, board, occupancy);
+    }
+    return randomMove(x, y, board, occupancy);
+}
+
+sf::Keyboard::Key Bot::randomMove(unsigned int x, unsigned int y, Board& board, const OccupancyGrid& occupancy) {
+    int first = std::uniform_int_distribution<int>(0, 3)(random);
+    for (int i = 0; i < 4; i++) {
+        int move = (first + i) % 4;
+        if (!blocked(x, y, move, board, occupancy)) {
+            return kMoves[move];
+        }
+    }
+    return sf::Keyboard::Unknown;
+}
+
+sf::Keyboard::Key Bot::moveRelativeTo(unsigned int x, unsigned int y, unsigned int targetX, unsigned int targetY, bool towards, Board& board, const OccupancyGrid& occupancy) {
+    std::shared_ptr<const DistanceField> field;
+    if (pathfinder) {
+        field = pathfinder->fieldTo(targetX, targetY);
+    }
+
+    // Take the open step that best closes (or opens) the distance, ties broken at random
+    int best = -1;
+    int bestScore = std::numeric_limits<int>::min();
+    int first = std::uniform_int_distribution<int>(0, 3)(random);
+    for (int i = 0; i < 4; i++) {
+        int move = (first + i) % 4;
+        if (blocked(x, y, move, board, occupancy)) {
+            continue;
+        }
+
+        unsigned int nextX = x + kMoveX[move];
+        unsigned int nextY = y + kMoveY[move];
+        unsigned int walk;
+        int distance;
+        if (field && field->distance(nextX, nextY, walk)) {
+            distance = static_cast<int>(walk);
+        } else {
+            distance = std::abs(static_cast<int>(nextX) - static_cast<int>(targetX)) + std::abs(static_cast<int>(nextY) - static_cast<int>(targetY));
+        }
+
+        int score = towards ? -distance : distance;
+        if (score > bestScore) {
+            best = move;
+            bestScore = score;
+        }
+    }
+
+    return best >= 0 ? kMoves[best] : sf::Keyboard::Unknown;
+}
+
+bool Bot::blocked(unsigned int x, unsigned int y, int move, Board& board, const OccupancyGrid& occupancy) {
+    if ((x == 0 && kMoveX[move] < 0) || (y == 0 && kMoveY[move] < 0)) {
+        return true;
+    }
+    return board.isWall(x + kMoveX[move], y + kMoveY[move]) || occupancy.isOccupied(x + kMoveX[move], y + kMoveY[move]);
+}
@@ -0,0 +1,43 @@
+#ifndef __BOT_H__
+#define __BOT_H__
+#include <SFML/Window/Keyboard.hpp>
+
+#include <random>
+#include <string>
+#include <map>
+#include <memory>
+
+#include "Board.h"
+#include "OccupancyGrid.h"
+#include "Pathfinding.h"
+
+struct Player;
+
+const int kBotTicksPerMove = 10; // Bots take one step every x ticks, about as fast as someone tapping keys
+
+enum BotPolicy {
+    kRandomWalk,
+    kChase, // Hunt the nearest player when IT, wander otherwise
+    kFlee // Run from whoever is IT, hunt when IT ourselves
+};
+
+// Stands in for the keyboard on a headless node, choosing one WASD step at a time
+class Bot {
+public:
+    // Without a pathfinder chase and flee just close or open the straight line distance
+    Bot(BotPolicy policy, unsigned int seed, std::shared_ptr<Pathfinder> pathfinder);
+    sf::Keyboard::Key chooseMove(const std::string& self, const std::map<std::string, Player>& players, const std::string& taggedPlayer, Board& board, const OccupancyGrid& occupancy);
+
+    static bool parsePolicy(const std::string& name, BotPolicy& policy);
+
+private:
+    sf::Keyboard::Key randomMove(unsigned int x, unsigned int y, Board& board, const OccupancyGrid& occupancy);
+    sf::Keyboard::Key moveRelativeTo(unsigned int x, unsigned int y, unsigned int targetX, unsigned int targetY, bool towards, Board& board, const OccupancyGrid& occupancy);
+    bool blocked(unsigned int x, unsigned int y, int move, Board& board, const OccupancyGrid& occupancy);
+
+    BotPolicy policy;
+    std::mt19937 random;
+    std::shared_ptr<Pathfinder> pathfinder;
+};
+
+#endif // __BOT_H__
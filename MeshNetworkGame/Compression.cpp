@@ -0,0 +1,201 @@
+#include "Compression.h"
+#include "Messages.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+const std::size_t kMinMatch = 4; // Shortest back reference worth encoding
+const std::size_t kMaxOffset = 65535; // Offsets are stored in two bytes
+const unsigned int kHashBits = 12;
+
+// Everything in the dictionary is laid out exactly as sf::Packet puts it on the wire
+std::string buildDictionary() {
+    sf::Packet packet;
+    const char* common[] = { "127.0.0.1", "192.168.", "10.0.", "test" };
+    for (auto& word : common) {
+        packet << std::string(word);
+    }
+    for (auto& type : knownMessageTypes()) {
+        packet << type;
+    }
+    // Frames end with runs of small big endian integers
+    packet << static_cast<sf::Uint32>(0) << static_cast<sf::Uint32>(1) << static_cast<sf::Uint32>(2);
+    return std::string(static_cast<const char*>(packet.getData()), packet.getDataSize());
+}
+
+// FNV-1a over the format and the dictionary, never 0 since that means no compression
+sf::Uint32 buildVersion(const std::string& dictionary) {
+    if (kCompressionFormat == 0) {
+        return 0;
+    }
+
+    sf::Uint32 hash = 2166136261u;
+    hash = (hash ^ kCompressionFormat) * 16777619u;
+    for (std::size_t i = 0; i < dictionary.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(dictionary[i])) * 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Built at startup so no thread ever races on its initialization
+const std::string kDictionary = buildDictionary();
+const sf::Uint32 kVersion = buildVersion(kDictionary);
+
+unsigned int hashAt(const std::string& window, std::size_t position) {
+    sf::Uint32 sequence;
+    std::memcpy(&sequence, window.data() + position, sizeof(sequence));
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+void writeLength(std::string& output, std::size_t length) {
+    while (length >= 255) {
+        output.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    output.push_back(static_cast<char>(length));
+}
+
+bool readLength(const std::string& input, std::size_t& position, std::size_t& length) {
+    unsigned char next;
+    do {
+        if (position >= input.size()) {
+            return false;
+        }
+        next = static_cast<unsigned char>(input[position++]);
+        length += next;
+    } while (next == 255);
+    return true;
+}
+
+// Sequence layout: token (literal length << 4 | match length - kMinMatch), extra literal length,
+// literals, then for all but the last sequence a little endian offset and extra match length
+void writeSequence(std::string& output, const std::string& window, std::size_t anchor, std::size_t literals, std::size_t offset, std::size_t matchLength) {
+    std::size_t extraMatch = matchLength ? matchLength - kMinMatch : 0;
+    unsigned char token = static_cast<unsigned char>(((literals < 15 ? literals : 15) << 4) | (extraMatch < 15 ? extraMatch : 15));
+    output.push_back(static_cast<char>(token));
+    if (literals >= 15) {
+        writeLength(output, literals - 15);
+    }
+    output.append(window, anchor, literals);
+
+    if (matchLength) {
+        output.push_back(static_cast<char>(offset & 0xFF));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (extraMatch >= 15) {
+            writeLength(output, extraMatch - 15);
+        }
+    }
+}
+}
+
+sf::Uint32 compressionVersion() {
+    return kVersion;
+}
+
+bool compressFrame(const std::string& input, std::string& output) {
+    if (input.size() > kMaxCompressedFrameSize) {
+        return false;
+    }
+
+    std::string window = kDictionary + input;
+    std::size_t start = kDictionary.size();
+    std::size_t end = window.size();
+    std::vector<int> table(1 << kHashBits, -1);
+
+    // Prime the table with the dictionary so the first frame can already refer back into it
+    for (std::size_t position = 0; position + kMinMatch <= start; position++) {
+        table[hashAt(window, position)] = static_cast<int>(position);
+    }
+
+    output.clear();
+    output.reserve(input.size());
+
+    std::size_t anchor = start;
+    std::size_t position = start;
+    while (position + kMinMatch <= end) {
+        unsigned int hash = hashAt(window, position);
+        int candidate = table[hash];
+        table[hash] = static_cast<int>(position);
+
+        if (candidate >= 0 && position - candidate <= kMaxOffset && std::memcmp(window.data() + candidate, window.data() + position, kMinMatch) == 0) {
+            std::size_t matchLength = kMinMatch;
+            while (position + matchLength < end && window[candidate + matchLength] == window[position + matchLength]) {
+                matchLength++;
+            }
+
+            writeSequence(output, window, anchor, position - anchor, position - candidate, matchLength);
+            position += matchLength;
+            anchor = position;
+        } else {
+            position++;
+        }
+
+        if (output.size() >= input.size()) {
+            return false;
+        }
+    }
+
+    // Whatever is left over goes out as trailing literals
+    writeSequence(output, window, anchor, end - anchor, 0, 0);
+    return output.size() < input.size();
+}
+
+bool decompressFrame(const std::string& input, std::size_t rawSize, std::string& output) {
+    // The size comes off the wire, don't let it decide how much we allocate
+    if (rawSize > kMaxCompressedFrameSize) {
+        return false;
+    }
+
+    std::string window = kDictionary;
+    std::size_t start = kDictionary.size();
+    window.reserve(start + rawSize);
+
+    std::size_t position = 0;
+    while (position < input.size()) {
+        unsigned char token = static_cast<unsigned char>(input[position++]);
+
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !readLength(input, position, literals)) {
+            return false;
+        }
+        if (position + literals > input.size() || window.size() - start + literals > rawSize) {
+            return false;
+        }
+        window.append(input, position, literals);
+        position += literals;
+
+        // The last sequence carries no match
+        if (position == input.size()) {
+            break;
+        }
+
+        if (position + 2 > input.size()) {
+            return false;
+        }
+        std::size_t offset = static_cast<unsigned char>(input[position]) | (static_cast<unsigned char>(input[position + 1]) << 8);
+        position += 2;
+
+        std::size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !readLength(input, position, matchLength)) {
+            return false;
+        }
+        matchLength += kMinMatch;
+
+        if (offset == 0 || offset > window.size() || window.size() - start + matchLength > rawSize) {
+            return false;
+        }
+        // Copy a byte at a time since a match may overlap what it is producing
+        std::size_t from = window.size() - offset;
+        for (std::size_t i = 0; i < matchLength; i++) {
+            char byte = window[from + i];
+            window.push_back(byte);
+        }
+    }
+
+    if (window.size() - start != rawSize) {
+        return false;
+    }
+    output.assign(window, start, rawSize);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef __COMPRESSION_H__
+#define __COMPRESSION_H__
+#include <SFML/Config.hpp>
+
+#include <string>
+
+const unsigned char kCompressionFormat = 1; // Bump when the sequence layout changes, 0 means uncompressed only
+const std::size_t kCompressionThreshold = 256; // Only compress frames of at least x bytes
+const std::size_t kMaxCompressedFrameSize = 16 * 1024 * 1024; // Larger frames go out raw, and a peer claiming more is refused
+
+struct CompressionStats {
+    unsigned long long frames;
+    unsigned long long rawBytes;
+    unsigned long long compressedBytes;
+    unsigned long long compressMicroseconds;
+    unsigned long long decompressMicroseconds;
+
+    CompressionStats(): frames(0), rawBytes(0), compressedBytes(0), compressMicroseconds(0), decompressMicroseconds(0) {}
+};
+
+// LZ77 block codec whose window starts out primed with our own message vocabulary, so even
+// the first occurrence of a type or common string in a frame can become a back reference.
+// Returns false when the frame doesn't get any smaller and should go out raw.
+bool compressFrame(const std::string& input, std::string& output);
+bool decompressFrame(const std::string& input, std::size_t rawSize, std::string& output);
+
+// Advertised in the handshake. Folds the format together with a hash of the dictionary, so new
+// message types change it and only nodes priming the window identically compress to each other.
+sf::Uint32 compressionVersion();
+
+#endif // __COMPRESSION_H__
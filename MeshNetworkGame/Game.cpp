@@ -1,66 +1,211 @@
 #include "Game.h"
 
 Game::Game(std::string name): playerName(name) {
-    messageTypes.push_back("move");
-    messageTypes.push_back("start");
-    messageTypes.push_back("ready");
+    messageTypes.push_back(StartMessage::type());
+    messageTypes.push_back(ReadyMessage::type());
+    messageTypes.push_back(PlayerKeyframeMessage::type());
+    messageTypes.push_back(PlayerDeltaMessage::type());
+    messageTypes.push_back(PlayerAckMessage::type());
+    messageTypes.push_back(LockstepInputMessage::type());
+    messageTypes.push_back(ChecksumMessage::type());
+    messageTypes.push_back(ResyncRequestMessage::type());
+    messageTypes.push_back(ResyncStateMessage::type());
+    messageTypes.push_back(InterestMessage::type());
 
     gameStarted = false;
     imReady = false;
+    ticks = 0;
+    needsReconcile = false;
+    lockstepEnabled = false;
+    inputDelay = kMinInputDelay;
+    resyncPending = false;
+    resyncTick = 0;
+    replications = 0;
+    madeDistance = true;
+    snapshotRequested = false;
+    interestRegion = 0;
+    interestAnnounced = false;
+
+    headless = false;
+    verticalSync = false;
+    frameLimit = kDefaultFrameLimit;
 
     if (!font.loadFromFile("sansation.ttf")) {
-        log << "Failed to load text" << std::endl;
+        LOG(kLogError, kLogGame) << "Failed to load text" << std::endl;
+    }
+
+    // Open the board once up front, preferring the binary map when one has been converted
+    if (board.open(binaryBoardFilename) || board.open(boardFilename)) {
+        LOG(kLogInfo, kLogGame) << "Loaded a " << board.getWidth() << "x" << board.getHeight() << " board" << std::endl;
+    } else {
+        LOG(kLogError, kLogGame) << "Could not open board file: " << boardFilename << std::endl;
+    }
+
+    playerVertices.setPrimitiveType(sf::Triangles);
+    for (int segment = 0; segment < kCircleSegments; segment++) {
+        float angle = 2.0f * 3.14159265f * segment / kCircleSegments;
+        circlePoints[segment] = sf::Vector2f(std::cos(angle), std::sin(angle));
     }
 }
 
-void Game::handleMessage(std::string sender, std::string type, Json::Value message) {
-    if (type == "move") {
-        movePlayer(sender, message);
-    } else if (type == "start") {
+void Game::handleMessage(std::string sender, std::string type, const std::string& payload) {
+    recorder.recordMessage(ticks, sender, type, payload);
+
+    if (type == LockstepInputMessage::type()) {
+        LockstepInputMessage message;
+        if (decodePayload(payload, message)) {
+            lockstep.receive(sender, message);
+        }
+    } else if (type == InterestMessage::type()) {
+        InterestMessage message;
+        if (decodePayload(payload, message)) {
+            interests.subscribe(sender, message.regions);
+        }
+    } else if (type == ChecksumMessage::type()) {
+        ChecksumMessage message;
+        if (decodePayload(payload, message)) {
+            lockstep.compareChecksum(sender, message.tick, message.checksum);
+            std::lock_guard<std::mutex> lock(desyncMutex);
+            desyncStats.checks++;
+            countSync("lockstep_checksums_total");
+        }
+    } else if (type == ResyncRequestMessage::type()) {
+        ResyncRequestMessage message;
+        if (decodePayload(payload, message)) {
+            LOG(kLogWarning, kLogSync) << sender << " desynced at tick " << message.tick << ", sending our state" << std::endl;
+            sendResyncState(sender);
+        }
+    } else if (type == ResyncStateMessage::type()) {
+        ResyncStateMessage message;
+        if (!decodePayload(payload, message)) {
+            LOG(kLogWarning, kLogSync) << "Malformed resync from " << sender << std::endl;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(desyncMutex);
+        if (sender != resyncRequestedFrom) {
+            LOG(kLogWarning, kLogSync) << "Ignoring resync we didn't ask " << sender << " for" << std::endl;
+            return;
+        }
+
+        resyncRequestedFrom.clear();
+        resyncState = LockstepState();
+        for (auto& player : message.players) {
+            PlayerState state;
+            state.x = player.x;
+            state.y = player.y;
+            state.color = player.color;
+            resyncState.players[player.name] = state;
+        }
+        resyncState.taggedPlayer = message.taggedPlayer;
+        resyncState.previouslyTaggedPlayer = message.previouslyTaggedPlayer;
+        resyncState.madeDistance = message.madeDistance;
+        resyncTick = message.tick;
+        resyncPending = true;
+        desyncStats.resyncBytes += payload.size();
+        countSync("lockstep_resync_bytes_total", payload.size());
+    } else if (type == PlayerDeltaMessage::type()) {
+        PlayerDeltaMessage message;
+        PlayerState state;
+        if (decodePayload(payload, message) && replicator.applyDelta(sender, message, state)) {
+            std::lock_guard<std::mutex> lock(playersMutex);
+            applyState(sender, state);
+        }
+    } else if (type == PlayerKeyframeMessage::type()) {
+        PlayerKeyframeMessage message;
+        PlayerState state;
+        if (decodePayload(payload, message) && replicator.applyKeyframe(sender, message, state)) {
+            std::lock_guard<std::mutex> lock(playersMutex);
+            applyState(sender, state);
+        }
+    } else if (type == PlayerAckMessage::type()) {
+        PlayerAckMessage message;
+        if (decodePayload(payload, message)) {
+            replicator.acknowledge(sender, message);
+        }
+    } else if (type == StartMessage::type()) {
+        StartMessage message;
+        if (!decodePayload(payload, message)) {
+            LOG(kLogWarning, kLogGame) << "Malformed start message from " << sender << std::endl;
+            return;
+        }
+
+        lockstepEnabled = message.lockstep;
+        inputDelay = message.inputDelay;
         startGame(false);
-    } else if (type == "ready") {
-        readyPlayers[sender] = true;
-        players[sender].x = message["x"].asUInt();
-        players[sender].y = message["y"].asUInt();
+    } else if (type == ReadyMessage::type()) {
+        ReadyMessage message;
+        if (!decodePayload(payload, message)) {
+            LOG(kLogWarning, kLogGame) << "Malformed ready message from " << sender << std::endl;
+            return;
+        }
 
-        if (message["color"].asString() == "green") {
-            players[sender].color = sf::Color::Green;
+        std::lock_guard<std::mutex> lock(playersMutex);
+        readyPlayers[sender] = true;
+        players[sender].color = message.color;
+        placePlayer(sender, message.x, message.y);
+        if (message.color == kGreen) {
             taggedPlayer = sender;
-        } else if (message["color"].asString() == "blue") {
-            players[sender].color = sf::Color::Blue;
-        } else if (message["color"].asString() == "yellow") {
-            players[sender].color = sf::Color::Yellow;
-        } else if (message["color"].asString() == "black") {
-            players[sender].color = sf::Color::Black;
-        } else if (message["color"].asString() == "magenta") {
-            players[sender].color = sf::Color::Magenta;
         }
 
-        log << sender << " is ready to play!" << std::endl;
+        // Whatever they had from us before is stale, start them over with a keyframe
+        replicator.forgetPeer(sender);
+        interests.forgetPeer(sender);
+        {
+            std::lock_guard<std::mutex> lock(interpolationMutex);
+            interpolation.erase(sender);
+        }
+
+        // They may have missed where we are if they joined after we last moved region
+        if (imReady) {
+            sendTo(sender, currentInterest());
+        }
+
+        LOG(kLogInfo, kLogGame) << sender << " is ready to play!" << std::endl;
     }  else {
-        log << "Unknown game message: " << type << std::endl << message.toStyledString() << std::endl;
+        LOG(kLogWarning, kLogGame) << "Unknown game message: " << type << std::endl << payloadToJson(type, payload).toStyledString() << std::endl;
     }
 }
 
+void Game::handleDisconnect(std::string peer) {
+    // They'll announce where they are again if they come back
+    interests.forgetPeer(peer);
+}
+
 void Game::startGame(bool initiatedStart) {
+    std::lock_guard<std::mutex> lock(playersMutex);
     if (allPlayersReady()) {
         if (initiatedStart) {
-            Json::Value message;
-            message["starter"] = playerName;
-            node->broadcast("start", message);
+            // Size the input delay to the slowest route we have to anyone playing
+            unsigned long long worstPing = 0;
+            for (auto& player : readyPlayers) {
+                unsigned long long ping;
+                if (node && node->getRoutePing(player.first, ping)) {
+                    worstPing = std::max(worstPing, ping);
+                }
+            }
+            inputDelay = Lockstep::inputDelayFor(worstPing);
+
+            StartMessage message;
+            message.starter = playerName;
+            message.lockstep = lockstepEnabled;
+            message.inputDelay = static_cast<sf::Uint8>(inputDelay);
+            broadcastAll(message);
+        }
+        if (lockstepEnabled) {
+            startLockstep();
         }
         gameStarted = true;
         std::thread(&Game::playGame, this).detach();
     } else {
-        log << "Not all players are ready" << std::endl;
+        LOG(kLogInfo, kLogGame) << "Not all players are ready" << std::endl;
     }
 }
 
 void Game::readyUp() {
     unsigned int input = 10;
-    Json::Value message;
 
-    while (input > 5) {
+    while (input < 1 || input > 5) {
         out << "Please choose a color: " << std::endl   
             << "\t1: Green" << std::endl
             << "\t2: Blue" << std::endl
@@ -70,173 +215,719 @@ void Game::readyUp() {
         in >> input;
     }
 
-    switch (input) {
-    case 1:
-        players[playerName].color = sf::Color::Green;
+    readyUp(static_cast<sf::Uint8>(input));
+}
+
+void Game::readyUp(sf::Uint8 color) {
+    std::lock_guard<std::mutex> lock(playersMutex);
+    ReadyMessage message;
+
+    switch (color) {
+    case kGreen:
         players[playerName].x = 0;
         players[playerName].y = 0;
-        out << "You will be IT first" << std::endl;
-        message["color"] = "green";
+        if (!bot) {
+            out << "You will be IT first" << std::endl;
+        }
         taggedPlayer = playerName;
         break;
-    case 2:
-        players[playerName].color = sf::Color::Blue;
+    case kBlue:
         players[playerName].x = 9;
         players[playerName].y = 9;
-        message["color"] = "blue";
         break;
-    case 3:
-        players[playerName].color = sf::Color::Yellow;
+    case kYellow:
         players[playerName].x = 2;
         players[playerName].y = 2;
-        message["color"] = "yellow";
         break;
-    case 4:
-        players[playerName].color = sf::Color::Black;
+    case kBlack:
         players[playerName].x = 6;
         players[playerName].y = 4;
-        message["color"] = "black";
         break;
-    case 5:
-        players[playerName].color = sf::Color::Magenta;
+    case kMagenta:
         players[playerName].x = 0;
         players[playerName].y = 9;
-        message["color"] = "magenta";
         break;
+    default:
+        LOG(kLogWarning, kLogGame) << "Unknown color " << static_cast<int>(color) << std::endl;
+        return;
     }
-    message["x"] = players[playerName].x;
-    message["y"] = players[playerName].y;
+    players[playerName].color = color;
+    message.color = color;
+
+    // Maps that carry their own spawn points override the defaults above
+    if (color - 1u < board.getSpawnPoints().size()) {
+        players[playerName].x = board.getSpawnPoints()[color - 1].x;
+        players[playerName].y = board.getSpawnPoints()[color - 1].y;
+    }
+
+    // Several bots can share a color, so walk forward to the first open tile
+    unsigned int tiles = board.getWidth() * board.getHeight();
+    unsigned int start = players[playerName].y * board.getWidth() + players[playerName].x;
+    for (unsigned int i = 0; i < tiles; i++) {
+        unsigned int tile = (start + i) % tiles;
+        unsigned int x = tile % board.getWidth();
+        unsigned int y = tile / board.getWidth();
+        if (!board.isWall(x, y) && collideCheck(x, y)) {
+            players[playerName].x = x;
+            players[playerName].y = y;
+            break;
+        }
+    }
+
+    placePlayer(playerName, players[playerName].x, players[playerName].y);
+    predictor.reset(players[playerName].x, players[playerName].y);
+
+    message.x = static_cast<sf::Uint16>(players[playerName].x);
+    message.y = static_cast<sf::Uint16>(players[playerName].y);
 
     imReady = true;
-    node->broadcast("ready", message);
+    interestAnnounced = false;
+    broadcastAll(message);
 }
 
 void Game::playGame() {
-    sf::RenderWindow window(sf::VideoMode(windowSize, windowSize), "MeshNetworkGame");
+    std::unique_ptr<sf::RenderWindow> window;
+    if (!headless) {
+        window = std::unique_ptr<sf::RenderWindow>(new sf::RenderWindow(sf::VideoMode(windowSize, windowSize), "MeshNetworkGame"));
+        window->setVerticalSyncEnabled(verticalSync);
+        window->setFramerateLimit(verticalSync ? 0 : frameLimit);
+    }
     setupBoard();
 
-    while(gameStarted && window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
-            }
+    const sf::Time tickDuration = sf::microseconds(1000000 / kTickRate);
+    sf::Clock clock;
+    sf::Time accumulator = sf::Time::Zero;
 
-            if (event.type == sf::Event::KeyPressed) {
-                if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
-                    if (players[playerName].y > 0 && boardData[players[playerName].y-1][players[playerName].x] != wall && collideCheck(playerName, players[playerName].x, players[playerName].y-1)) {
-                        players[playerName].y -= 1;
-                    }
-                } else if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
-                    if (players[playerName].x > 0 && boardData[players[playerName].y][players[playerName].x-1] != wall && collideCheck(playerName, players[playerName].x-1, players[playerName].y)) {
-                        players[playerName].x -= 1;
-                    } 
-                } else if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
-                    if (players[playerName].y < boardDimension - 1 && boardData[players[playerName].y+1][players[playerName].x] != wall && collideCheck(playerName, players[playerName].x, players[playerName].y+1)) {
-                        players[playerName].y += 1;
-                    }
-                } else if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
-                    if (players[playerName].x < boardDimension - 1 && boardData[players[playerName].y][players[playerName].x+1] != wall && collideCheck(playerName, players[playerName].x+1, players[playerName].y)) {
-                        players[playerName].x += 1;
-                    }
-                }
-                move();
+    while (gameStarted && (headless || window->isOpen())) {
+        accumulator += clock.restart();
+
+        if (!headless) {
+            pollInput(*window);
+        }
+
+        // Drop time we can't catch up on rather than spiralling after a stall
+        if (accumulator > tickDuration * static_cast<sf::Int64>(kMaxCatchUpTicks)) {
+            accumulator = tickDuration * static_cast<sf::Int64>(kMaxCatchUpTicks);
+        }
+
+        while (accumulator >= tickDuration) {
+            tick();
+            accumulator -= tickDuration;
+        }
+
+        if (headless) {
+            sf::sleep(tickDuration - accumulator);
+        } else {
+            render(*window, static_cast<float>(accumulator.asMicroseconds()) / static_cast<float>(tickDuration.asMicroseconds()));
+        }
+    }
+
+    return;
+}
+
+void Game::pollInput(sf::RenderWindow& window) {
+    sf::Event event;
+    while (window.pollEvent(event)) {
+        if (event.type == sf::Event::Closed) {
+            window.close();
+        }
+
+        // Key presses are queued and applied by the next tick
+        if (event.type == sf::Event::KeyPressed) {
+            pendingInput.push_back(event.key.code);
+        }
+    }
+}
+
+void Game::tick() {
+    std::lock_guard<std::mutex> lock(playersMutex);
+
+    // Remember where everyone was so rendering can interpolate towards where they are now
+    for (auto& player : players) {
+        previousPositions[player.first] = sf::Vector2f(static_cast<float>(player.second.x), static_cast<float>(player.second.y));
+    }
+
+    // Snapshots go in before anything this tick does, so playback can start right here
+    if (snapshotRequested || (ticks % kReplaySnapshotTicks == 0 && recorder.isOpen())) {
+        snapshotRequested = false;
+        recorder.recordSnapshot(ticks, saveState());
+    }
+
+    if (bot && ticks % kBotTicksPerMove == 0) {
+        pendingInput.push_back(bot->chooseMove(playerName, players, taggedPlayer, board, occupancy));
+    }
+
+    if (lockstepEnabled) {
+        lockstepTick();
+        ticks++;
+        return;
+    }
+
+    if (needsReconcile) {
+        needsReconcile = false;
+        reconcile();
+    }
+
+    while (!pendingInput.empty()) {
+        recorder.recordInput(ticks, static_cast<sf::Uint8>(pendingInput.front()));
+
+        // Tag each input with the snapshot that will first carry it to our peers
+        predictor.record(pendingInput.front(), replicator.currentTick() + 1);
+        step(pendingInput.front());
+        pendingInput.pop_front();
+    }
+
+    checkForTag();
+
+    ticks++;
+    if (ticks % kTicksPerReplication == 0) {
+        replicate();
+    }
+}
+
+void Game::step(sf::Keyboard::Key key) {
+    if (key == sf::Keyboard::W) {
+        if (players[playerName].y > 0 && !board.isWall(players[playerName].x, players[playerName].y-1) && collideCheck(players[playerName].x, players[playerName].y-1)) {
+            placePlayer(playerName, players[playerName].x, players[playerName].y-1);
+        }
+    } else if (key == sf::Keyboard::A) {
+        if (players[playerName].x > 0 && !board.isWall(players[playerName].x-1, players[playerName].y) && collideCheck(players[playerName].x-1, players[playerName].y)) {
+            placePlayer(playerName, players[playerName].x-1, players[playerName].y);
+        } 
+    } else if (key == sf::Keyboard::S) {
+        if (!board.isWall(players[playerName].x, players[playerName].y+1) && collideCheck(players[playerName].x, players[playerName].y+1)) {
+            placePlayer(playerName, players[playerName].x, players[playerName].y+1);
+        }
+    } else if (key == sf::Keyboard::D) {
+        if (!board.isWall(players[playerName].x+1, players[playerName].y) && collideCheck(players[playerName].x+1, players[playerName].y)) {
+            placePlayer(playerName, players[playerName].x+1, players[playerName].y);
+        }
+    } else {
+        return;
+    }
+    move();
 
 #if debug
-                log << "Player position: " << players[playerName].x << ":" << players[playerName].y << std::endl;
+    LOG(kLogDebug, kLogGame) << "Player position: " << players[playerName].x << ":" << players[playerName].y << std::endl;
 #endif
+}
+
+void Game::render(sf::RenderWindow& window, float alpha) {
+    window.clear(sf::Color::Black);
+    {
+        // Held only while we read the players, not while we wait on the display
+        std::lock_guard<std::mutex> lock(playersMutex);
+
+        // Only the chunks around the camera are loaded and drawn
+        followPlayer(window);
+        board.draw(window, static_cast<float>(tileSize));
+
+        sf::Int64 now = interpolationClock.getElapsedTime().asMicroseconds();
+        std::lock_guard<std::mutex> interpolationLock(interpolationMutex);
+
+        // Every player goes into one triangle list, rebuilt in place each frame
+        playerVertices.clear();
+        for (auto& player : players) {
+            sf::Color color = player.first != taggedPlayer ? toColor(player.second.color) : sf::Color::Red;
+
+            // Blend between the last two ticks so movement doesn't depend on the frame rate
+            sf::Vector2f current(static_cast<float>(player.second.x), static_cast<float>(player.second.y));
+            sf::Vector2f previous = previousPositions.count(player.first) ? previousPositions[player.first] : current;
+            sf::Vector2f position = previous + (current - previous) * alpha;
+
+            // We draw ourselves as predicted, everyone else a little in the past from their buffered updates
+            auto buffer = interpolation.find(player.first);
+            if (player.first != playerName && buffer != interpolation.end()) {
+                unsigned long long ping = 0;
+                if (node) {
+                    node->getRoutePing(player.first, ping);
+                }
+                buffer->second.sample(now - InterpolationBuffer::delayFor(ping), position);
             }
+
+            appendCircle(playerVertices, (position + sf::Vector2f(0.5f, 0.5f)) * static_cast<float>(tileSize), static_cast<float>(tileSize) / 2.0f, color);
+        }
+    }
+    window.draw(playerVertices);
+
+    window.display();
+}
+
+void Game::followPlayer(sf::RenderWindow& window) {
+    sf::Vector2f viewSize(static_cast<float>(window.getSize().x), static_cast<float>(window.getSize().y));
+    sf::Vector2f boardSize(static_cast<float>(board.getWidth() * tileSize), static_cast<float>(board.getHeight() * tileSize));
+    sf::Vector2f center((players[playerName].x + 0.5f) * tileSize, (players[playerName].y + 0.5f) * tileSize);
+
+    // Keep the camera on the board, or centered on it when it's smaller than the window
+    center.x = boardSize.x > viewSize.x ? std::min(std::max(center.x, viewSize.x / 2.0f), boardSize.x - viewSize.x / 2.0f) : boardSize.x / 2.0f;
+    center.y = boardSize.y > viewSize.y ? std::min(std::max(center.y, viewSize.y / 2.0f), boardSize.y - viewSize.y / 2.0f) : boardSize.y / 2.0f;
+    window.setView(sf::View(center, viewSize));
+
+    sf::Vector2f corner = center - viewSize / 2.0f;
+    board.stream(sf::IntRect(static_cast<int>(std::floor(corner.x / tileSize)), static_cast<int>(std::floor(corner.y / tileSize)),
+        static_cast<int>(viewSize.x / tileSize) + 2, static_cast<int>(viewSize.y / tileSize) + 2));
+}
+
+void Game::appendCircle(sf::VertexArray& vertices, sf::Vector2f center, float radius, sf::Color color) {
+    for (int segment = 0; segment < kCircleSegments; segment++) {
+        vertices.append(sf::Vertex(center, color));
+        vertices.append(sf::Vertex(center + circlePoints[segment] * radius, color));
+        vertices.append(sf::Vertex(center + circlePoints[(segment + 1) % kCircleSegments] * radius, color));
+    }
+}
+
+void Game::setHeadless(bool enabled) {
+    headless = enabled;
+}
+
+void Game::setBot(BotPolicy policy, std::shared_ptr<Pathfinder> pathfinder) {
+    // Bots in one process should share a pathfinder, otherwise give this one its own
+    if (!pathfinder) {
+        pathfinder = std::shared_ptr<Pathfinder>(new Pathfinder);
+        if (!pathfinder->open(binaryBoardFilename) && !pathfinder->open(boardFilename)) {
+            pathfinder.reset();
+        }
+    }
+
+    // Bots are only ever run without a window
+    std::random_device seed;
+    bot = std::unique_ptr<Bot>(new Bot(policy, seed(), pathfinder));
+    headless = true;
+}
+
+bool Game::startRecording(std::string filename) {
+    if (!recorder.open(filename, playerName)) {
+        LOG(kLogError, kLogSync) << "Could not record to " << filename << std::endl;
+        return false;
+    }
+
+    // The next tick starts the replay off with everything that happened before now
+    snapshotRequested = true;
+    return true;
+}
+
+void Game::stopRecording() {
+    recorder.close();
+}
+
+void Game::playReplay(std::string filename, float speed, sf::Uint64 seekTick) {
+    ReplayReader reader;
+    if (!reader.open(filename)) {
+        LOG(kLogError, kLogSync) << "Could not open replay " << filename << std::endl;
+        return;
+    }
+    playerName = reader.getPlayerName();
+    if (seekTick && !reader.seek(seekTick)) {
+        LOG(kLogWarning, kLogSync) << "No snapshot before tick " << seekTick << ", playing from the start" << std::endl;
+    }
+
+    std::unique_ptr<sf::RenderWindow> window;
+    if (!headless) {
+        window = std::unique_ptr<sf::RenderWindow>(new sf::RenderWindow(sf::VideoMode(windowSize, windowSize), "MeshNetworkGame replay"));
+        window->setVerticalSyncEnabled(verticalSync);
+    }
+    setupBoard();
+    gameStarted = true;
+
+    // A speed of 0 runs as fast as we can simulate
+    const sf::Time tickDuration = sf::microseconds(speed > 0.0f ? static_cast<sf::Int64>(1000000.0f / (kTickRate * speed)) : 0);
+    sf::Clock elapsed;
+    sf::Clock clock;
+    bool restored = false;
+    unsigned long long divergences = 0;
+    unsigned long long played = 0;
+
+    // Recordings started mid-game and seeks both begin at a snapshot taken long after tick 0,
+    // loading it first puts us at its tick instead of ticking an empty board up to it
+    ReplayEvent event;
+    bool more = reader.next(event);
+    if (more && event.kind == kReplaySnapshot) {
+        applyReplayEvent(event, restored, divergences);
+        more = reader.next(event);
+    }
+    while (more && (headless || window->isOpen())) {
+        // Everything recorded at a tick happened before that tick ran
+        while (more && event.tick <= ticks) {
+            applyReplayEvent(event, restored, divergences);
+            more = reader.next(event);
         }
 
-        checkForTag();
+        tick();
+        played++;
 
-        window.clear(sf::Color::Black);
+        // Skip straight through to where we were asked to seek to
+        if (ticks < seekTick) {
+            continue;
+        }
 
-        for (int i = 0; i < boardDimension; i++) {
-            for (int j = 0; j < boardDimension; j++) {
-                window.draw(boardRender[i][j]);
+        if (window) {
+            sf::Event windowEvent;
+            while (window->pollEvent(windowEvent)) {
+                if (windowEvent.type == sf::Event::Closed) {
+                    window->close();
+                }
             }
+            render(*window, 1.0f);
+        }
+
+        if (tickDuration > sf::Time::Zero) {
+            sf::sleep(tickDuration - clock.restart());
+            clock.restart();
+        }
+    }
+
+    gameStarted = false;
+    sf::Int64 milliseconds = elapsed.getElapsedTime().asMilliseconds();
+    LOG(kLogInfo, kLogSync) << "Replayed " << played << " ticks in " << milliseconds << "ms (" << (milliseconds > 0 ? played * 1000 / milliseconds : played) << " ticks/s), "
+                            << divergences << " snapshots diverged";
+}
+
+void Game::applyReplayEvent(const ReplayEvent& event, bool& restored, unsigned long long& divergences) {
+    if (event.kind == kReplaySnapshot) {
+        // The first snapshot is where we start, every later one is a check we're still on track
+        if (!restored) {
+            restored = loadState(event.data);
+        } else if (event.data != saveState()) {
+            divergences++;
+#if debug
+            LOG(kLogDebug, kLogSync) << "Replay diverged at tick " << event.tick << std::endl;
+#endif
+        }
+    } else if (event.kind == kReplayInput) {
+        pendingInput.push_back(static_cast<sf::Keyboard::Key>(event.key));
+    } else if (event.kind == kReplayMessage && event.type != StartMessage::type()) {
+        // Starting is already captured by the snapshot, running it again would start a second game
+        handleMessage(event.sender, event.type, event.data);
+    }
+}
+
+std::string Game::saveState() {
+    sf::Packet packet;
+    writeUint64(packet, ticks);
+    packet << lockstepEnabled << static_cast<sf::Uint32>(inputDelay);
+
+    packet << static_cast<sf::Uint32>(players.size());
+    for (auto& player : players) {
+        packet << player.first << static_cast<sf::Uint32>(player.second.x) << static_cast<sf::Uint32>(player.second.y) << player.second.color;
+    }
+    packet << taggedPlayer << previouslyTaggedPlayer << madeDistance;
+
+    packet << static_cast<sf::Uint32>(readyPlayers.size());
+    for (auto& player : readyPlayers) {
+        packet << player.first << player.second;
+    }
+
+    replicator.saveReceived(packet);
+    return std::string(static_cast<const char*>(packet.getData()), packet.getDataSize());
+}
+
+bool Game::loadState(const std::string& state) {
+    sf::Packet packet;
+    packet.append(state.data(), state.size());
+
+    sf::Uint64 savedTicks;
+    sf::Uint32 savedInputDelay;
+    sf::Uint32 count;
+    if (!readUint64(packet, savedTicks) || !(packet >> lockstepEnabled >> savedInputDelay >> count)) {
+        return false;
+    }
+    ticks = savedTicks;
+    inputDelay = savedInputDelay;
+
+    players.clear();
+    occupancy.clear();
+    previousPositions.clear();
+    for (sf::Uint32 i = 0; i < count; i++) {
+        std::string name;
+        sf::Uint32 x, y;
+        sf::Uint8 color;
+        if (!(packet >> name >> x >> y >> color)) {
+            return false;
+        }
+        players[name].color = color;
+        placePlayer(name, x, y);
+    }
+    if (!(packet >> taggedPlayer >> previouslyTaggedPlayer >> madeDistance >> count)) {
+        return false;
+    }
+
+    readyPlayers.clear();
+    for (sf::Uint32 i = 0; i < count; i++) {
+        std::string name;
+        bool ready;
+        if (!(packet >> name >> ready)) {
+            return false;
         }
+        readyPlayers[name] = ready;
+    }
+
+    if (lockstepEnabled) {
+        if (ticks > 0) {
+            LOG(kLogWarning, kLogSync) << "Lockstep replays can only start from the beginning, this one will drift" << std::endl;
+        }
+        startLockstep();
+    }
+    return replicator.loadReceived(packet);
+}
+
+void Game::setLockstep(bool enabled) {
+    lockstepEnabled = enabled;
+}
 
-        for (auto player : players) {
-            sf::CircleShape circle;
-            if (player.first != taggedPlayer) {
-                circle.setFillColor(player.second.color);
+void Game::listDesyncs() {
+    std::lock_guard<std::mutex> lock(desyncMutex);
+    out << desyncStats.checks << " checksums compared, " << desyncStats.desyncs << " desyncs" << std::endl;
+    if (desyncStats.resyncs) {
+        out << desyncStats.resyncs << " resyncs, " << desyncStats.resyncBytes / desyncStats.resyncs << " bytes and "
+            << desyncStats.resyncMicroseconds / desyncStats.resyncs << "us each" << std::endl;
+    }
+}
+
+void Game::setFrameLimit(unsigned int limit) {
+    frameLimit = limit;
+}
+
+void Game::setVerticalSync(bool enabled) {
+    verticalSync = enabled;
+}
+
+void Game::move() {
+#if debug
+    LOG(kLogDebug, kLogGame) << "Moved to " << players[playerName].x << ":" << players[playerName].y << std::endl;
+#endif
+    // Nothing to send here, the next replication tick picks up the new position
+}
+
+void Game::replicate() {
+    PlayerState state;
+    state.x = static_cast<sf::Uint16>(players[playerName].x);
+    state.y = static_cast<sf::Uint16>(players[playerName].y);
+    state.color = players[playerName].color;
+    replicator.snapshot(state);
+    replications++;
+
+    // Everyone hears when we cross into a new region so they know what to send us at full rate
+    sf::Uint32 region = InterestMap::regionOf(state.x, state.y);
+    if (!interestAnnounced || region != interestRegion) {
+        broadcastAll(currentInterest());
+        interestRegion = region;
+        interestAnnounced = true;
+    }
+
+    // Inputs every peer has seen can no longer be rewound
+    std::vector<std::string> peers;
+    for (auto& peer : readyPlayers) {
+        peers.push_back(peer.first);
+    }
+    sf::Uint32 confirmedTick;
+    PlayerState confirmed;
+    if (replicator.ackedByAll(peers, confirmedTick, confirmed)) {
+        predictor.confirm(confirmedTick, confirmed.x, confirmed.y);
+    }
+
+    // Only peers that are behind get anything, so an idle player costs no bandwidth
+    for (auto& peer : readyPlayers) {
+        // Peers too far away to be affected by us only need the occasional summary
+        if (replications % kSummaryInterval != 0 && !interests.isInterested(peer.first, state.x, state.y)) {
+            continue;
+        }
+
+        PlayerKeyframeMessage keyframe;
+        PlayerDeltaMessage delta;
+        bool isKeyframe;
+        if (replicator.buildUpdate(peer.first, keyframe, delta, isKeyframe)) {
+            if (isKeyframe) {
+                sendTo(peer.first, keyframe);
             } else {
-                circle.setFillColor(sf::Color::Red);
+                sendTo(peer.first, delta);
             }
-            circle.setRadius(50);
-            circle.setPosition(static_cast<float>(tileSize * player.second.x), static_cast<float>(tileSize * player.second.y));
-            window.draw(circle);
         }
+    }
 
+    for (auto& ack : replicator.takeAcks()) {
+        sendTo(ack.first, ack.second);
+    }
+}
 
-#if debug
-        for (int i = 0; i < boardDimension; i++) {
-            for (int j = 0; j < boardDimension; j++) {
-                sf::Text text;
-                text.setFont(font);
-                text.setString(std::to_string(i) + ":" + std::to_string(j));
-                text.setCharacterSize(50);
-                text.setColor(sf::Color::Black);
-                text.setPosition(boardRender[i][j].getPosition().x, boardRender[i][j].getPosition().y);
-                window.draw(text);
+void Game::startLockstep() {
+    LockstepState initial;
+    for (auto& player : players) {
+        PlayerState state;
+        state.x = static_cast<sf::Uint16>(player.second.x);
+        state.y = static_cast<sf::Uint16>(player.second.y);
+        state.color = player.second.color;
+        initial.players[player.first] = state;
+    }
+
+    // Several players may have picked green, so every node settles on the same one
+    for (auto& player : players) {
+        if (player.second.color == kGreen) {
+            initial.taggedPlayer = player.first;
+            break;
+        }
+    }
+    if (initial.taggedPlayer.empty() && !players.empty()) {
+        initial.taggedPlayer = players.begin()->first;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(interpolationMutex);
+        interpolation.clear();
+    }
+    lockstep.start(initial, playerName, inputDelay);
+    LOG(kLogInfo, kLogSync) << "Running in lockstep with " << inputDelay << " ticks of input delay" << std::endl;
+}
+
+void Game::lockstepTick() {
+    // One key per tick, anything pressed faster waits its turn
+    sf::Uint8 input = pendingInput.empty() ? kNoInput : Lockstep::encodeKey(pendingInput.front());
+    LockstepInputMessage message;
+    if (!lockstep.advance(input, board, message)) {
+        // Too far ahead of the slowest peer, hold the key until they catch up
+        return;
+    }
+    if (!pendingInput.empty()) {
+        recorder.recordInput(ticks, static_cast<sf::Uint8>(pendingInput.front()));
+        pendingInput.pop_front();
+    }
+    broadcastAll(message);
+    checkDesyncs();
+
+    LockstepState state = lockstep.predicted();
+    for (auto& player : state.players) {
+        players[player.first].color = player.second.color;
+        placePlayer(player.first, player.second.x, player.second.y);
+    }
+    taggedPlayer = state.taggedPlayer;
+    previouslyTaggedPlayer = state.previouslyTaggedPlayer;
+    madeDistance = state.madeDistance;
+}
+
+void Game::checkDesyncs() {
+    sf::Uint32 checksumTick;
+    sf::Uint64 checksum;
+    if (lockstep.takeChecksum(checksumTick, checksum)) {
+        ChecksumMessage message;
+        message.tick = checksumTick;
+        message.checksum = checksum;
+        broadcastAll(message);
+    }
+
+    std::lock_guard<std::mutex> lock(desyncMutex);
+    for (auto& desync : lockstep.takeDesyncs()) {
+        desyncStats.desyncs++;
+        countSync("lockstep_desyncs_total");
+        LOG(kLogWarning, kLogSync) << "Desynced from " << desync.peer << " at tick " << desync.tick << std::endl;
+
+        // Only the one that sorts later gives way, so two nodes never swap states with each other
+        if (playerName > desync.peer) {
+            ResyncRequestMessage request;
+            request.tick = desync.tick;
+            resyncRequestedFrom = desync.peer;
+            sendTo(desync.peer, request);
+        }
+    }
+
+    if (resyncPending) {
+        sf::Clock clock;
+        LockstepInputMessage filler;
+        if (lockstep.resync(resyncState, resyncTick, board, filler)) {
+            desyncStats.resyncs++;
+            countSync("lockstep_resyncs_total");
+            if (!filler.inputs.empty()) {
+                broadcastAll(filler);
             }
         }
-#endif
+        sf::Int64 elapsed = clock.getElapsedTime().asMicroseconds();
+        desyncStats.resyncMicroseconds += elapsed;
+        if (node) {
+            node->getMetrics().histogram("lockstep_resync_us").record(elapsed);
+        }
+        resyncPending = false;
+    }
+}
 
+void Game::countSync(const std::string& metric, sf::Uint64 amount) {
+    // Replays run lockstep without a node to report to
+    if (node) {
+        node->getMetrics().counter(metric).add(amount);
+    }
+}
 
-        window.display();
+void Game::sendResyncState(std::string peer) {
+    LockstepState state;
+    ResyncStateMessage message;
+    message.tick = lockstep.confirmedState(state);
+    for (auto& player : state.players) {
+        ResyncPlayer resyncPlayer;
+        resyncPlayer.name = player.first;
+        resyncPlayer.x = player.second.x;
+        resyncPlayer.y = player.second.y;
+        resyncPlayer.color = player.second.color;
+        message.players.push_back(resyncPlayer);
     }
+    message.taggedPlayer = state.taggedPlayer;
+    message.previouslyTaggedPlayer = state.previouslyTaggedPlayer;
+    message.madeDistance = state.madeDistance;
+    sendTo(peer, message);
+}
 
-    return;
+InterestMessage Game::currentInterest() {
+    InterestMessage message;
+    message.regions = InterestMap::regionsAround(players[playerName].x, players[playerName].y);
+    return message;
 }
 
-void Game::move() {
+void Game::applyState(std::string sender, const PlayerState& state) {
+    // Lockstep moves everyone from inputs, leftover updates from before the start don't apply
+    if (lockstep.isRunning()) {
+        return;
+    }
+
 #if debug
-    log << "Moved to " << players[playerName].x << ":" << players[playerName].y << std::endl;
+    LOG(kLogDebug, kLogGame) << "Player " << sender << " moved to " << state.x << ":" << state.y << std::endl;
 #endif
-    Json::Value message;
-    message["x"] = players[playerName].x;
-    message["y"] = players[playerName].y;
-    node->broadcast("move", message);
+    players[sender].color = state.color;
+    placePlayer(sender, state.x, state.y);
+
+    {
+        std::lock_guard<std::mutex> lock(interpolationMutex);
+        interpolation[sender].push(interpolationClock.getElapsedTime().asMicroseconds(), sf::Vector2f(static_cast<float>(state.x), static_cast<float>(state.y)));
+    }
+
+    // Both of us stepped into the same tile, whoever's name sorts later gives way
+    if (state.x == players[playerName].x && state.y == players[playerName].y && playerName > sender) {
+        needsReconcile = true;
+    }
 }
 
-void Game::movePlayer(std::string sender, Json::Value message) {
+void Game::reconcile() {
+    unsigned int x = predictor.getConfirmedX();
+    unsigned int y = predictor.getConfirmedY();
+
+    // Someone is already standing where we'd rewind to, stay put until one of us moves off
+    if ((x != players[playerName].x || y != players[playerName].y) && !collideCheck(x, y)) {
+        return;
+    }
+
 #if debug
-    log << "Player " << sender << " moved to " << players[sender].x << ":" << players[sender].y << std::endl;
+    LOG(kLogDebug, kLogGame) << "Rewinding to " << x << ":" << y << " and replaying " << predictor.pendingInputs().size() << " inputs" << std::endl;
 #endif
-    players[sender].x = message["x"].asUInt();
-    players[sender].y = message["y"].asUInt();
+    placePlayer(playerName, x, y);
+    for (auto& input : predictor.pendingInputs()) {
+        step(input.key);
+    }
 }
 
 void Game::checkForTag() {
-    for (auto player : players) {
-        for (auto otherPlayer : players) {
-            if (player.first != otherPlayer.first) {
-                // If they're within 1 tile of each other
-                if ((player.second.x - otherPlayer.second.x == -1 && player.second.y - otherPlayer.second.y == -1) ||   // Up-Left
-                    (player.second.x - otherPlayer.second.x == -1 && player.second.y - otherPlayer.second.y == 0) ||    // Up
-                    (player.second.x - otherPlayer.second.x == -1 && player.second.y - otherPlayer.second.y == 1) ||    // Up-Right
-                    (player.second.x - otherPlayer.second.x == 0 && player.second.y - otherPlayer.second.y == -1) ||    // Left
-                    (player.second.x - otherPlayer.second.x == 1 && player.second.y - otherPlayer.second.y == -1) ||    // Down-Left
-                    (player.second.x - otherPlayer.second.x == 1 && player.second.y - otherPlayer.second.y == 0) ||     // Down
-                    (player.second.x - otherPlayer.second.x == 1 && player.second.y - otherPlayer.second.y == 1) ||     // Down-Right
-                    (player.second.x - otherPlayer.second.x == 0 && player.second.y - otherPlayer.second.y == 1)        // Right
-                    ){
-
-                    // If one of them is tagged and they've made distance, tag them
-                    if (player.first == taggedPlayer && madeDistance) {
-                        taggedPlayer = otherPlayer.first;
-                        previouslyTaggedPlayer = player.first;
-                        madeDistance = false;
-                    } else if (otherPlayer.first == taggedPlayer && madeDistance) {
-                        taggedPlayer = player.first;
-                        previouslyTaggedPlayer = otherPlayer.first;
-                        madeDistance = false;
-                    }
-                }
-            }
+    // Only the tagged player can tag anyone, so only the tiles around them matter
+    auto tagged = players.find(taggedPlayer);
+    if (madeDistance && tagged != players.end()) {
+        std::string neighbour;
+        if (occupancy.firstNeighbour(tagged->second.x, tagged->second.y, taggedPlayer, neighbour)) {
+            previouslyTaggedPlayer = taggedPlayer;
+            taggedPlayer = neighbour;
+            madeDistance = false;
         }
     }
 
@@ -244,57 +935,30 @@ void Game::checkForTag() {
         double distance;
         if ((distance = std::sqrt(std::pow(static_cast<double>(players[taggedPlayer].x) - static_cast<double>(players[previouslyTaggedPlayer].x), 2.0) + std::pow(static_cast<double>(players[taggedPlayer].y) - static_cast<double>(players[previouslyTaggedPlayer].y), 2.0))) >= kDistanceAmount) {
 #if debug
-            log << "Distance achieved!" << distance << std::endl;
-            log << "Sqrt( (" << players[taggedPlayer].x << " - " << players[previouslyTaggedPlayer].x << ")^2 + (" << players[taggedPlayer].y << " - "  << players[previouslyTaggedPlayer].y << ")^2)" << std::endl;
+            LOG(kLogDebug, kLogGame) << "Distance achieved!" << distance << std::endl;
+            LOG(kLogDebug, kLogGame) << "Sqrt( (" << players[taggedPlayer].x << " - " << players[previouslyTaggedPlayer].x << ")^2 + (" << players[taggedPlayer].y << " - "  << players[previouslyTaggedPlayer].y << ")^2)" << std::endl;
 #endif
             madeDistance = true;
         }
     }
 }
 
-bool Game::collideCheck(std::string player, unsigned int x, unsigned int y) {
-    for (auto otherPlayer : players) {
-        if (otherPlayer.second.x == x && otherPlayer.second.y == y) {
-            return false;
-        }
-    }
+bool Game::collideCheck(unsigned int x, unsigned int y) {
+    return !occupancy.isOccupied(x, y);
+}
 
-    return true;
+void Game::placePlayer(std::string player, unsigned int x, unsigned int y) {
+    players[player].x = x;
+    players[player].y = y;
+    occupancy.place(player, x, y);
 }
 
 void Game::setupBoard() {
-    std::ifstream boardFile;
     madeDistance = true;
-    boardFile.open(boardFilename);
-
-    if (boardFile.is_open()) {
-        for (int i = 0; i < boardDimension; i++) {
-            for (int j = 0; j < boardDimension; j++) {
-                boardData[i][j] = boardFile.get();
-                boardRender[i][j].setSize(sf::Vector2f(tileSize, tileSize));
-                boardRender[i][j].setPosition(static_cast<float>(tileSize * j), static_cast<float>(tileSize * i));
-                if (boardData[i][j] == wall) {
-                    boardRender[i][j].setFillColor(sf::Color::Black);
-                } else if (boardData[i][j] == space) {
-                    boardRender[i][j].setFillColor(sf::Color::White);
-                }
-            }
-            boardFile.get();
-        }
-    } else {
-        log << "Could not open board file: " << boardFilename << std::endl;
-    }
 
 #if debug
-    for (int i = 0; i < boardDimension; i++) {
-        for (int j = 0; j < boardDimension; j++) {
-            log << boardData[i][j] - 48 << " ";
-        }
-        log << std::endl;
-    }
+    board.setLabelFont(&font);
 #endif
-
-    boardFile.close();
 }
 
 bool Game::allPlayersReady() {
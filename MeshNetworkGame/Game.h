@@ -8,24 +8,58 @@
 #include <math.h>
 #include <string>
 #include <map>
+#include <deque>
+#include <random>
+#include <memory>
+#include <atomic>
 
 #include "MessageHandler.h"
+#include "Replication.h"
+#include "Board.h"
+#include "OccupancyGrid.h"
+#include "Bot.h"
+#include "Prediction.h"
+#include "Lockstep.h"
+#include "Interest.h"
+#include "Replay.h"
 
 #define debug 0
 #define boardFilename "board.txt"
+#define binaryBoardFilename "board.map"
 #define fontFilename "sansation.ttf"
-#define boardDimension 10
 #define windowSize 1000
-#define tileSize windowSize / boardDimension
-#define wall 49
-#define space 48
+#define tileSize 100
 
 const int kDistanceAmount = 4;
+const int kTickRate = 60; // Simulation ticks per second
+const int kMaxCatchUpTicks = 5; // Never run more than x ticks back to back after a stall
+const int kTicksPerReplication = 3; // Send our player state every x ticks
+const unsigned int kDefaultFrameLimit = 60; // Rendered frames per second, 0 for unlimited
+const int kCircleSegments = 24; // Triangles per player disc
+
+enum PlayerColor {
+    kGreen = 1,
+    kBlue,
+    kYellow,
+    kBlack,
+    kMagenta
+};
+
+inline sf::Color toColor(sf::Uint8 color) {
+    switch (color) {
+    case kGreen: return sf::Color::Green;
+    case kBlue: return sf::Color::Blue;
+    case kYellow: return sf::Color::Yellow;
+    case kBlack: return sf::Color::Black;
+    case kMagenta: return sf::Color::Magenta;
+    default: return sf::Color::White;
+    }
+}
 
 struct Player {
     unsigned int x;
     unsigned int y;
-    sf::Color color;
+    sf::Uint8 color; // PlayerColor
 };
 
 class Game : public MessageHandler {
@@ -33,24 +67,75 @@ public:
     Game(std::string name);
     void startGame(bool intiatedStart);
     void readyUp();
+    void readyUp(sf::Uint8 color);
+    void setBot(BotPolicy policy, std::shared_ptr<Pathfinder> pathfinder);
     void playGame();
-    void handleMessage(std::string sender, std::string type, Json::Value message);
+    void setHeadless(bool enabled);
+    void setFrameLimit(unsigned int limit);
+    void setVerticalSync(bool enabled);
+    void setLockstep(bool enabled);
+    void listDesyncs();
+
+    // Recording captures every message and input, playback runs them through a Game with no node
+    bool startRecording(std::string filename);
+    void stopRecording();
+    void playReplay(std::string filename, float speed, sf::Uint64 seekTick);
+    void handleMessage(std::string sender, std::string type, const std::string& payload);
+    void handleDisconnect(std::string peer);
 
 private:
+    // Replays run without a node, so anything we'd send goes nowhere
+    template <typename T>
+    void sendTo(std::string peer, const T& message) { if (node) { node->send(peer, message); } }
+    template <typename T>
+    void broadcastAll(const T& message) { if (node) { node->broadcast(message); } }
+
     // Game state mechanisms
     bool gameStarted;
     std::thread gameThread;
 
+    // Simulation runs at kTickRate no matter how fast we render
+    void pollInput(sf::RenderWindow& window);
+    void tick();
+    void step(sf::Keyboard::Key key);
+    unsigned long long ticks;
+    std::deque<sf::Keyboard::Key> pendingInput;
+    std::unique_ptr<Bot> bot; // Drives our player instead of the keyboard when set
+
+    // Our moves are predicted locally and replayed if a peer disagrees with them
+    void reconcile();
+    Predictor predictor;
+    std::atomic<bool> needsReconcile;
+
+    // Optional deterministic mode, every node simulates everyone from exchanged inputs
+    void startLockstep();
+    void lockstepTick();
+    bool lockstepEnabled;
+    unsigned int inputDelay;
+    Lockstep lockstep;
+
+    // Checksums of the lockstep state, resyncs are applied on the game thread
+    void checkDesyncs();
+    void sendResyncState(std::string peer);
+    void countSync(const std::string& metric, sf::Uint64 amount = 1);
+    DesyncStats desyncStats; // Kept for the desync command, and in the node's metrics when there is one
+    bool resyncPending;
+    std::string resyncRequestedFrom; // Only a state from the peer we last asked is applied
+    sf::Uint32 resyncTick;
+    LockstepState resyncState;
+    std::mutex desyncMutex;
+
     // Ready mechanics
     bool imReady;
     bool allPlayersReady();
     std::map<std::string, bool> readyPlayers;
 
     // Game information
-    void movePlayer(std::string sender, Json::Value message);
     void move();
     void checkForTag();
-    bool collideCheck(std::string player, unsigned int x, unsigned int y);
+    bool collideCheck(unsigned int x, unsigned int y);
+    void placePlayer(std::string player, unsigned int x, unsigned int y);
+    OccupancyGrid occupancy;
 
     std::string playerName;
     std::map<std::string, Player> players;
@@ -58,11 +143,48 @@ private:
     std::string previouslyTaggedPlayer;
     bool madeDistance;
 
+    // The game thread ticks and renders, the listener and console threads ready players up and
+    // apply their updates. This guards everything above and readyPlayers, take it before interpolationMutex.
+    std::mutex playersMutex;
+
+    // Replication of our player to everyone else
+    void replicate();
+    void applyState(std::string sender, const PlayerState& state);
+    Replicator replicator;
+    unsigned long long replications;
+
+    // Full rate updates only go to peers near us, the rest get a summary now and then
+    InterestMessage currentInterest();
+    InterestMap interests;
+    sf::Uint32 interestRegion;
+    std::atomic<bool> interestAnnounced; // Cleared by readyUp from the console thread
+    std::map<std::string, InterpolationBuffer> interpolation;
+    std::mutex interpolationMutex;
+    sf::Clock interpolationClock;
+
+    // Replay recording, snapshots hold everything a replay needs to start from that tick
+    std::string saveState();
+    bool loadState(const std::string& state);
+    void applyReplayEvent(const ReplayEvent& event, bool& restored, unsigned long long& divergences);
+    ReplayWriter recorder;
+    std::atomic<bool> snapshotRequested;
+
     // Game graphics
+    void render(sf::RenderWindow& window, float alpha);
+    bool headless;
+    bool verticalSync;
+    unsigned int frameLimit;
+    std::map<std::string, sf::Vector2f> previousPositions;
     sf::Font font;
-    sf::RectangleShape boardRender[boardDimension][boardDimension];
-    unsigned int boardData[boardDimension][boardDimension];
+    sf::VertexArray playerVertices;
+    sf::Vector2f circlePoints[kCircleSegments];
+    void appendCircle(sf::VertexArray& vertices, sf::Vector2f center, float radius, sf::Color color);
+    Board board;
     void setupBoard();
+    void followPlayer(sf::RenderWindow& window);
+
+    // Benchmarks/Microbenchmarks.cpp times checkForTag against a populated board
+    friend class MicrobenchmarkAccess;
 };
 
 #endif // __GAME_HANDLER_H___
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "Interest.h"
+
+sf::Uint32 InterestMap::regionOf(unsigned int x, unsigned int y) {
+    return ((x / kInterestRegionSize) << 16) | ((y / kInterestRegionSize) & 0xFFFF);
+}
+
+std::vector<sf::Uint32> InterestMap::regionsAround(unsigned int x, unsigned int y) {
+    std::vector<sf::Uint32> regions;
+    int regionX = static_cast<int>(x / kInterestRegionSize);
+    int regionY = static_cast<int>(y / kInterestRegionSize);
+    for (int dy = -kInterestRadius; dy <= kInterestRadius; dy++) {
+        for (int dx = -kInterestRadius; dx <= kInterestRadius; dx++) {
+            if (regionX + dx >= 0 && regionY + dy >= 0) {
+                regions.push_back((static_cast<sf::Uint32>(regionX + dx) << 16) | static_cast<sf::Uint32>(regionY + dy));
+            }
+        }
+    }
+    return regions;
+}
+
+void InterestMap::subscribe(std::string peer, const std::vector<sf::Uint32>& regions) {
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions[peer] = std::unordered_set<sf::Uint32>(regions.begin(), regions.end());
+}
+
+void InterestMap::forgetPeer(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions.erase(peer);
+}
+
+bool InterestMap::isInterested(std::string peer, unsigned int x, unsigned int y) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto subscription = subscriptions.find(peer);
+    return subscription == subscriptions.end() || subscription->second.count(regionOf(x, y)) > 0;
+}
@@ -0,0 +1,34 @@
+#ifndef __INTEREST_H__
+#define __INTEREST_H__
+#include <SFML/Config.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+const unsigned int kInterestRegionSize = 16; // Regions are x by x tiles
+const int kInterestRadius = 1; // Subscribe to every region within x regions of our own
+const unsigned int kSummaryInterval = 10; // Peers not interested in us get one update every x replication ticks
+
+// Which board regions each peer has asked for full rate updates from. Tagging and collisions
+// only ever involve neighbouring tiles, so anyone outside the regions around a peer can't affect
+// them and only needs to show up on their screen now and then.
+class InterestMap {
+public:
+    static sf::Uint32 regionOf(unsigned int x, unsigned int y);
+    static std::vector<sf::Uint32> regionsAround(unsigned int x, unsigned int y);
+
+    void subscribe(std::string peer, const std::vector<sf::Uint32>& regions);
+    void forgetPeer(std::string peer);
+
+    // Peers we haven't heard from yet are treated as interested in everything
+    bool isInterested(std::string peer, unsigned int x, unsigned int y);
+
+private:
+    std::map<std::string, std::unordered_set<sf::Uint32>> subscriptions;
+    std::mutex mutex;
+};
+
+#endif // __INTEREST_H__
@@ -0,0 +1,251 @@
+#include "LinkEmulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+namespace {
+const double kParetoShape = 2.5; // Lower gives a heavier tail
+
+double percent(const std::string& value) {
+    return std::min(std::max(std::atof(value.c_str()) / 100.0, 0.0), 1.0);
+}
+}
+
+bool LinkProfile::isClear() const {
+    return !delay && !jitter && loss <= 0 && burstStart <= 0 && reorder <= 0 && !bandwidth;
+}
+
+std::string LinkProfile::toString() const {
+    static const char* distributions[] = { "uniform", "normal", "pareto" };
+    std::stringstream description;
+    description << delay << "ms delay";
+    if (jitter) {
+        description << ", " << jitter << "ms " << distributions[distribution] << " jitter";
+    }
+    if (loss > 0) {
+        description << ", " << loss * 100 << "% loss";
+    }
+    if (burstStart > 0) {
+        description << ", bursts of " << burstLoss * 100 << "% loss (" << burstStart * 100 << "% in, " << burstEnd * 100 << "% out)";
+    }
+    if (reorder > 0) {
+        description << ", " << reorder * 100 << "% reordered";
+    }
+    if (bandwidth) {
+        description << ", " << bandwidth << " B/s with a " << bucket << " B bucket";
+    }
+    return description.str();
+}
+
+LinkEmulator::LinkEmulator(DeliverFunction _deliver): deliver(_deliver), random(std::random_device()()), running(true) {
+    thread = std::thread(&LinkEmulator::run, this);
+}
+
+LinkEmulator::~LinkEmulator() {
+    stop();
+}
+
+void LinkEmulator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+bool LinkEmulator::parseSetting(LinkProfile& profile, std::string setting, std::string value) {
+    if (setting == "delay") {
+        profile.delay = static_cast<unsigned int>(std::atoi(value.c_str()));
+    } else if (setting == "jitter") {
+        profile.jitter = static_cast<unsigned int>(std::atoi(value.c_str()));
+    } else if (setting == "distribution") {
+        if (value == "uniform") {
+            profile.distribution = kJitterUniform;
+        } else if (value == "normal") {
+            profile.distribution = kJitterNormal;
+        } else if (value == "pareto") {
+            profile.distribution = kJitterPareto;
+        } else {
+            return false;
+        }
+    } else if (setting == "loss") {
+        profile.loss = percent(value);
+    } else if (setting == "burststart") {
+        profile.burstStart = percent(value);
+    } else if (setting == "burstend") {
+        profile.burstEnd = percent(value);
+    } else if (setting == "burstloss") {
+        profile.burstLoss = percent(value);
+    } else if (setting == "reorder") {
+        profile.reorder = percent(value);
+    } else if (setting == "bandwidth") {
+        profile.bandwidth = static_cast<unsigned int>(std::atoi(value.c_str()));
+        // Without a bucket of its own a cap lets a tenth of a second through at once
+        if (!profile.bucket) {
+            profile.bucket = profile.bandwidth / 10;
+        }
+    } else if (setting == "bucket") {
+        profile.bucket = static_cast<unsigned int>(std::atoi(value.c_str()));
+    } else if (setting == "clear") {
+        profile = LinkProfile();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void LinkEmulator::setProfile(std::string peer, const LinkProfile& profile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Link& link = links[peer];
+    link.profile = profile;
+    link.bad = false;
+    link.tokens = profile.bucket;
+    link.refilled = std::chrono::steady_clock::now();
+}
+
+LinkProfile LinkEmulator::getProfile(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto link = links.find(peer);
+    return link != links.end() ? link->second.profile : LinkProfile();
+}
+
+bool LinkEmulator::isImpaired(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto link = links.find(peer);
+    // Frames still queued have to drain in order even once the profile is cleared
+    return link != links.end() && (!link->second.profile.isClear() || link->second.queued);
+}
+
+void LinkEmulator::forget(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    links.erase(peer);
+    for (auto frame = frames.begin(); frame != frames.end();) {
+        if (frame->second.peer == peer) {
+            frame = frames.erase(frame);
+        } else {
+            ++frame;
+        }
+    }
+}
+
+std::size_t LinkEmulator::queued(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto link = links.find(peer);
+    return link != links.end() ? link->second.queued : 0;
+}
+
+bool LinkEmulator::lost(Link& link) {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    // Two state Gilbert-Elliott model, the link flips between good and bad before each frame
+    if (link.profile.burstStart > 0) {
+        if (link.bad) {
+            link.bad = chance(random) >= link.profile.burstEnd;
+        } else {
+            link.bad = chance(random) < link.profile.burstStart;
+        }
+        if (link.bad && chance(random) < link.profile.burstLoss) {
+            return true;
+        }
+    }
+    return link.profile.loss > 0 && chance(random) < link.profile.loss;
+}
+
+double LinkEmulator::jitterFor(const LinkProfile& profile) {
+    if (!profile.jitter) {
+        return 0;
+    }
+
+    double jitter = static_cast<double>(profile.jitter);
+    if (profile.distribution == kJitterNormal) {
+        return std::normal_distribution<double>(0.0, jitter)(random);
+    }
+    if (profile.distribution == kJitterPareto) {
+        double uniform = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        return jitter * (std::pow(1.0 - uniform, -1.0 / kParetoShape) - 1.0);
+    }
+    return std::uniform_real_distribution<double>(-jitter, jitter)(random);
+}
+
+bool LinkEmulator::submit(EmulatedFrame& frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Link& link = links[frame.peer];
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (lost(link)) {
+        return false;
+    }
+
+    // Refill the bucket for the time that passed, then wait until it covers this frame
+    double wait = 0;
+    if (link.profile.bandwidth) {
+        double rate = static_cast<double>(link.profile.bandwidth) / 1000.0;
+        double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(now - link.refilled).count()) / 1000.0;
+        link.tokens = std::min(link.tokens + elapsed * rate, static_cast<double>(link.profile.bucket));
+        link.refilled = now;
+
+        double size = static_cast<double>(frame.packet.getDataSize());
+        if (link.tokens < size) {
+            wait = (size - link.tokens) / rate;
+        }
+        if (wait > kMaxLinkBacklog) {
+            return false;
+        }
+        link.tokens -= size;
+    }
+
+    std::chrono::steady_clock::time_point due = now;
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    if (link.profile.reorder > 0 && chance(random) < link.profile.reorder) {
+        // Goes out as soon as the bandwidth allows, ahead of whatever is still delayed
+        due += std::chrono::microseconds(static_cast<long long>(wait * 1000.0));
+    } else {
+        double delay = std::max(static_cast<double>(link.profile.delay) + jitterFor(link.profile), 0.0) + wait;
+        due += std::chrono::microseconds(static_cast<long long>(delay * 1000.0));
+        // Jitter alone doesn't reorder, a real link queue is first in first out
+        due = std::max(due, link.lastDue);
+        link.lastDue = due;
+    }
+
+    link.queued++;
+    bool first = frames.empty() || due < frames.begin()->first;
+    frames.insert(std::make_pair(due, frame));
+    if (first) {
+        wake.notify_all();
+    }
+    return true;
+}
+
+void LinkEmulator::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        if (frames.empty()) {
+            wake.wait(lock);
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point due = frames.begin()->first;
+        if (std::chrono::steady_clock::now() < due) {
+            wake.wait_until(lock, due);
+            continue;
+        }
+
+        EmulatedFrame frame = frames.begin()->second;
+        frames.erase(frames.begin());
+        auto link = links.find(frame.peer);
+        if (link != links.end() && link->second.queued) {
+            link->second.queued--;
+        }
+
+        // Sending can block on the socket, don't hold up submissions meanwhile
+        lock.unlock();
+        deliver(frame);
+        lock.lock();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef __LINKEMULATOR_H__
+#define __LINKEMULATOR_H__
+#include <SFML/Network.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+const unsigned int kMaxLinkBacklog = 2000; // Frames waiting on the bandwidth cap longer than x ms are tail dropped
+
+enum JitterDistribution {
+    kJitterUniform, // Anywhere within jitter either side of the delay
+    kJitterNormal, // Jitter is the standard deviation
+    kJitterPareto // Mostly on time with a long tail of late frames, jitter is the scale
+};
+
+// What one direction of one link does to frames, everything off by default
+struct LinkProfile {
+    unsigned int delay; // ms added to every frame
+    unsigned int jitter; // ms, see JitterDistribution
+    JitterDistribution distribution;
+    double loss; // Chance any frame is dropped
+    double burstStart; // Gilbert-Elliott burst loss: chance per frame the link goes bad,
+    double burstEnd; // chance it recovers,
+    double burstLoss; // and the chance of a drop while it's bad
+    double reorder; // Chance a frame skips the delay and overtakes the ones queued before it
+    unsigned int bandwidth; // Bytes per second, 0 for no cap
+    unsigned int bucket; // Token bucket depth in bytes, how much can go out in one burst
+
+    LinkProfile(): delay(0), jitter(0), distribution(kJitterUniform), loss(0), burstStart(0), burstEnd(0), burstLoss(0), reorder(0), bandwidth(0), bucket(0) {}
+
+    bool isClear() const;
+    std::string toString() const;
+};
+
+struct EmulatedFrame {
+    std::string peer;
+    sf::Packet packet;
+    std::string type;
+    sf::Uint64 traceId;
+};
+
+// Holds frames for impaired links in a timed queue and hands them back on a thread of its own
+// once they're due. Links without a profile never come through here.
+class LinkEmulator {
+public:
+    typedef std::function<void(EmulatedFrame& frame)> DeliverFunction;
+
+    LinkEmulator(DeliverFunction deliver);
+    ~LinkEmulator();
+    void stop();
+
+    void setProfile(std::string peer, const LinkProfile& profile);
+    LinkProfile getProfile(std::string peer);
+    bool isImpaired(std::string peer);
+    void forget(std::string peer);
+    std::size_t queued(std::string peer);
+
+    // Queue a frame for its link, false if the link lost it
+    bool submit(EmulatedFrame& frame);
+
+    // Change one setting by name, as typed at the console: "loss 5" is a 5% loss rate
+    static bool parseSetting(LinkProfile& profile, std::string setting, std::string value);
+
+private:
+    LinkEmulator(const LinkEmulator&);
+
+    struct Link {
+        LinkProfile profile;
+        bool bad; // In a loss burst
+        double tokens; // Bytes the bucket holds, negative while frames wait on the cap
+        std::chrono::steady_clock::time_point refilled;
+        std::chrono::steady_clock::time_point lastDue; // Keeps frames in order unless reordered
+        std::size_t queued;
+    };
+
+    void run();
+    bool lost(Link& link);
+    double jitterFor(const LinkProfile& profile);
+
+    DeliverFunction deliver;
+    std::map<std::string, Link> links;
+    std::multimap<std::chrono::steady_clock::time_point, EmulatedFrame> frames; // Equal times stay in submission order
+    std::mt19937 random;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+    std::thread thread;
+};
+
+#endif // __LINKEMULATOR_H__
@@ -0,0 +1,349 @@
+#include "Lockstep.h"
+#include "Game.h"
+
+namespace {
+// Indexed by input, kNoInput stays put
+const int kInputX[] = { 0, 0, -1, 0, 1 };
+const int kInputY[] = { 0, -1, 0, 1, 0 };
+const sf::Uint8 kInputCount = 5;
+
+const sf::Uint64 kHashOffset = 14695981039346656037ULL;
+const sf::Uint64 kHashPrime = 1099511628211ULL;
+
+void hashBytes(sf::Uint64& hash, const void* data, std::size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * kHashPrime;
+    }
+}
+}
+
+sf::Uint64 LockstepState::hashPlayer(const std::string& name, const PlayerState& state) {
+    // FNV-1a over fixed width fields, so it's the same whatever the host
+    sf::Uint64 hash = kHashOffset;
+    hashBytes(hash, name.data(), name.size());
+    unsigned char fields[5] = { static_cast<unsigned char>(state.x >> 8), static_cast<unsigned char>(state.x), static_cast<unsigned char>(state.y >> 8), static_cast<unsigned char>(state.y), state.color };
+    hashBytes(hash, fields, sizeof(fields));
+    return hash;
+}
+
+void LockstepState::rehash() {
+    playersHash = 0;
+    for (auto& player : players) {
+        playersHash ^= hashPlayer(player.first, player.second);
+    }
+}
+
+sf::Uint64 LockstepState::checksum() const {
+    // Player order doesn't matter to the XOR, so only the few global fields are hashed each time
+    sf::Uint64 hash = kHashOffset;
+    unsigned char players[8];
+    for (int i = 0; i < 8; i++) {
+        players[i] = static_cast<unsigned char>(playersHash >> (56 - 8 * i));
+    }
+    hashBytes(hash, players, sizeof(players));
+    hashBytes(hash, taggedPlayer.data(), taggedPlayer.size());
+    hashBytes(hash, "\0", 1);
+    hashBytes(hash, previouslyTaggedPlayer.data(), previouslyTaggedPlayer.size());
+    unsigned char distance = madeDistance ? 1 : 0;
+    hashBytes(hash, &distance, 1);
+    return hash;
+}
+
+Lockstep::Lockstep(): running(false), inputDelay(kMinInputDelay), tick(0), confirmedTick(0), lastChecksumTaken(0) {
+}
+
+void Lockstep::start(const LockstepState& initial, std::string _self, unsigned int _inputDelay) {
+    std::lock_guard<std::mutex> lock(mutex);
+    self = _self;
+    inputDelay = _inputDelay;
+    tick = 0;
+    confirmedTick = 0;
+    confirmed = initial;
+    confirmed.rehash();
+    prediction = confirmed;
+    lastChecksumTaken = 0;
+    remoteChecksums.clear();
+    desyncs.clear();
+    for (auto& checksum : checksums) {
+        checksum = Checksum();
+    }
+
+    // Keep anything that raced in ahead of our own start
+    for (auto input = inputs.begin(); input != inputs.end();) {
+        if (initial.players.count(input->first)) {
+            ++input;
+        } else {
+            input = inputs.erase(input);
+        }
+    }
+    running = true;
+}
+
+bool Lockstep::isRunning() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+}
+
+bool Lockstep::advance(sf::Uint8 input, Board& board, LockstepInputMessage& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    confirm(board);
+    if (tick - confirmedTick >= kMaxRollbackTicks) {
+        return false;
+    }
+
+    tick++;
+    inputs[self][tick + inputDelay] = input < kInputCount ? input : kNoInput;
+
+    message.tick = tick + inputDelay;
+    message.inputs.clear();
+    sf::Uint32 oldest = message.tick >= kInputRedundancy ? message.tick - kInputRedundancy + 1 : 1;
+    for (sf::Uint32 past = oldest; past <= message.tick; past++) {
+        bool known;
+        message.inputs.push_back(inputFor(self, past, known));
+    }
+
+    // Our own inputs are kept until they drop out of the redundancy window, peers may still need them
+    auto& own = inputs[self];
+    own.erase(own.begin(), own.lower_bound(std::min(oldest, retainedFrom())));
+
+    // Rebuild the prediction from the last state everyone agrees on
+    prediction = confirmed;
+    for (sf::Uint32 next = confirmedTick + 1; next <= tick; next++) {
+        bool complete;
+        simulate(prediction, next, board, complete);
+    }
+    return true;
+}
+
+void Lockstep::receive(std::string sender, const LockstepInputMessage& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (message.inputs.size() > message.tick) {
+        return;
+    }
+
+    auto& received = inputs[sender];
+    sf::Uint32 first = message.tick - static_cast<sf::Uint32>(message.inputs.size()) + 1;
+    for (std::size_t i = 0; i < message.inputs.size(); i++) {
+        if (first + i >= retainedFrom()) {
+            received[first + static_cast<sf::Uint32>(i)] = message.inputs[i];
+        }
+    }
+}
+
+LockstepState Lockstep::predicted() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return prediction;
+}
+
+sf::Uint8 Lockstep::encodeKey(sf::Keyboard::Key key) {
+    switch (key) {
+    case sf::Keyboard::W: return 1;
+    case sf::Keyboard::A: return 2;
+    case sf::Keyboard::S: return 3;
+    case sf::Keyboard::D: return 4;
+    default: return kNoInput;
+    }
+}
+
+unsigned int Lockstep::inputDelayFor(unsigned long long worstRoutePing) {
+    // Our input has to cross the slowest route, one way, before that peer reaches its tick
+    unsigned long long tickMilliseconds = 1000 / kTickRate;
+    unsigned int delay = static_cast<unsigned int>((worstRoutePing / 2 + tickMilliseconds - 1) / tickMilliseconds) + 1;
+    return std::min(std::max(delay, kMinInputDelay), kMaxInputDelay);
+}
+
+sf::Uint8 Lockstep::inputFor(const std::string& player, sf::Uint32 forTick, bool& known) const {
+    // Nobody can have pressed anything that lands before the first delayed tick
+    known = true;
+    if (forTick <= inputDelay) {
+        return kNoInput;
+    }
+
+    auto received = inputs.find(player);
+    if (received != inputs.end()) {
+        auto input = received->second.find(forTick);
+        if (input != received->second.end()) {
+            return input->second;
+        }
+    }
+
+    known = false;
+    return kNoInput;
+}
+
+void Lockstep::simulate(LockstepState& state, sf::Uint32 forTick, Board& board, bool& complete) const {
+    complete = true;
+
+    for (auto& player : state.players) {
+        bool known;
+        sf::Uint8 input = inputFor(player.first, forTick, known);
+        complete = complete && known;
+        if (input == kNoInput) {
+            continue;
+        }
+
+        int x = static_cast<int>(player.second.x) + kInputX[input];
+        int y = static_cast<int>(player.second.y) + kInputY[input];
+        if (x < 0 || y < 0 || board.isWall(x, y)) {
+            continue;
+        }
+
+        bool blocked = false;
+        for (auto& other : state.players) {
+            if (other.second.x == x && other.second.y == y) {
+                blocked = true;
+                break;
+            }
+        }
+        if (!blocked) {
+            state.playersHash ^= LockstepState::hashPlayer(player.first, player.second);
+            player.second.x = static_cast<sf::Uint16>(x);
+            player.second.y = static_cast<sf::Uint16>(y);
+            state.playersHash ^= LockstepState::hashPlayer(player.first, player.second);
+        }
+    }
+
+    auto tagged = state.players.find(state.taggedPlayer);
+    if (tagged == state.players.end()) {
+        return;
+    }
+
+    if (state.madeDistance) {
+        // The first neighbour by name is tagged, the same on every node
+        for (auto& player : state.players) {
+            int dx = static_cast<int>(player.second.x) - static_cast<int>(tagged->second.x);
+            int dy = static_cast<int>(player.second.y) - static_cast<int>(tagged->second.y);
+            if (player.first != state.taggedPlayer && dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1) {
+                state.previouslyTaggedPlayer = state.taggedPlayer;
+                state.taggedPlayer = player.first;
+                state.madeDistance = false;
+                break;
+            }
+        }
+    } else {
+        // Squared integer distance so no node rounds differently
+        auto previous = state.players.find(state.previouslyTaggedPlayer);
+        auto current = state.players.find(state.taggedPlayer);
+        if (previous != state.players.end()) {
+            int dx = static_cast<int>(current->second.x) - static_cast<int>(previous->second.x);
+            int dy = static_cast<int>(current->second.y) - static_cast<int>(previous->second.y);
+            if (dx * dx + dy * dy >= kDistanceAmount * kDistanceAmount) {
+                state.madeDistance = true;
+            }
+        } else {
+            state.madeDistance = true;
+        }
+    }
+}
+
+void Lockstep::confirm(Board& board) {
+    while (confirmedTick < tick) {
+        LockstepState next = confirmed;
+        bool complete;
+        simulate(next, confirmedTick + 1, board, complete);
+        if (!complete) {
+            return;
+        }
+
+        confirmed = next;
+        confirmedTick++;
+        recordChecksum();
+
+        // Inputs are only kept as far back as a resync could replay from
+        for (auto& received : inputs) {
+            if (received.first != self) {
+                received.second.erase(received.second.begin(), received.second.lower_bound(retainedFrom()));
+            }
+        }
+    }
+}
+
+void Lockstep::recordChecksum() {
+    Checksum& checksum = checksums[confirmedTick % kChecksumHistory];
+    checksum.tick = confirmedTick;
+    checksum.checksum = confirmed.checksum();
+
+    for (auto& remote : remoteChecksums) {
+        auto theirs = remote.second.find(confirmedTick);
+        if (theirs != remote.second.end()) {
+            if (theirs->second != checksum.checksum) {
+                desyncs.push_back(Desync(remote.first, confirmedTick));
+            }
+            remote.second.erase(remote.second.begin(), ++theirs);
+        }
+    }
+}
+
+bool Lockstep::takeChecksum(sf::Uint32& checksumTick, sf::Uint64& checksum) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sf::Uint32 latest = confirmedTick - confirmedTick % kChecksumTicks;
+    if (latest == 0 || latest == lastChecksumTaken || checksums[latest % kChecksumHistory].tick != latest) {
+        return false;
+    }
+
+    lastChecksumTaken = latest;
+    checksumTick = latest;
+    checksum = checksums[latest % kChecksumHistory].checksum;
+    return true;
+}
+
+void Lockstep::compareChecksum(std::string sender, sf::Uint32 checksumTick, sf::Uint64 checksum) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (checksumTick > confirmedTick) {
+        remoteChecksums[sender][checksumTick] = checksum;
+        return;
+    }
+
+    const Checksum& ours = checksums[checksumTick % kChecksumHistory];
+    if (ours.tick == checksumTick && ours.checksum != checksum) {
+        desyncs.push_back(Desync(sender, checksumTick));
+    }
+}
+
+std::vector<Desync> Lockstep::takeDesyncs() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Desync> found;
+    found.swap(desyncs);
+    return found;
+}
+
+sf::Uint32 Lockstep::confirmedState(LockstepState& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    state = confirmed;
+    return confirmedTick;
+}
+
+bool Lockstep::resync(const LockstepState& state, sf::Uint32 stateTick, Board& board, LockstepInputMessage& filler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stateTick + 1 < retainedFrom()) {
+        return false;
+    }
+
+    sf::Uint32 replayTo = confirmedTick;
+    confirmed = state;
+    confirmed.rehash();
+    confirmedTick = stateTick;
+    recordChecksum();
+
+    // Replay the ticks we'd already confirmed on top of their state, or jump ahead if they're past us
+    while (confirmedTick < replayTo) {
+        bool complete;
+        simulate(confirmed, confirmedTick + 1, board, complete);
+        confirmedTick++;
+        recordChecksum();
+    }
+
+    // We never sent input for the ticks we jumped over, peers would wait on it forever
+    filler.inputs.clear();
+    if (confirmedTick > tick) {
+        auto& own = inputs[self];
+        for (sf::Uint32 skipped = tick + inputDelay + 1; skipped <= confirmedTick + inputDelay; skipped++) {
+            own[skipped] = kNoInput;
+            filler.inputs.push_back(kNoInput);
+        }
+        tick = confirmedTick;
+    }
+    filler.tick = tick + inputDelay;
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+#include <SFML/Window/Keyboard.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Messages.h"
+#include "Replication.h"
+#include "Board.h"
+
+const unsigned int kMinInputDelay = 2; // Ticks between pressing a key and it taking effect
+const unsigned int kMaxInputDelay = 12;
+const unsigned int kMaxRollbackTicks = 60; // Stop and wait for peers rather than predict further ahead than this
+const unsigned int kInputRedundancy = 8; // Ticks of input repeated in every lockstep message
+const unsigned int kChecksumTicks = 60; // Confirmed ticks between checksum exchanges
+const unsigned int kChecksumHistory = 256; // Confirmed ticks of checksums and inputs kept to compare against and resync from
+
+const sf::Uint8 kNoInput = 0;
+
+// What keeping nodes in agreement has cost, for the desync console command
+struct DesyncStats {
+    unsigned long long checks;
+    unsigned long long desyncs;
+    unsigned long long resyncs;
+    unsigned long long resyncBytes;
+    unsigned long long resyncMicroseconds;
+
+    DesyncStats(): checks(0), desyncs(0), resyncs(0), resyncBytes(0), resyncMicroseconds(0) {}
+};
+
+// A peer whose checksum disagreed with ours, and the confirmed tick it happened at
+struct Desync {
+    std::string peer;
+    sf::Uint32 tick;
+
+    Desync(std::string _peer, sf::Uint32 _tick): peer(_peer), tick(_tick) {}
+};
+
+// Everything the tag game needs to agree on. Players are kept in a map so every node walks
+// them in the same order.
+struct LockstepState {
+    std::map<std::string, PlayerState> players;
+    std::string taggedPlayer;
+    std::string previouslyTaggedPlayer;
+    bool madeDistance;
+    sf::Uint64 playersHash; // XOR of hashPlayer over every player, kept up to date as they move
+
+    LockstepState(): madeDistance(true), playersHash(0) {}
+
+    sf::Uint64 checksum() const;
+    void rehash();
+    static sf::Uint64 hashPlayer(const std::string& name, const PlayerState& state);
+};
+
+// Deterministic simulation driven only by the inputs every player sends for every tick. The
+// confirmed state only ever moves forward over ticks we have every input for. What we show is
+// that state run forward to the current tick, guessing "no input" for anything still missing,
+// so a late input simply changes the guess and the prediction is rebuilt from confirmed.
+class Lockstep {
+public:
+    Lockstep();
+
+    void start(const LockstepState& initial, std::string self, unsigned int inputDelay);
+    bool isRunning();
+
+    // Run one tick with our input, which takes effect inputDelay ticks from now. False when
+    // we're too far ahead of the slowest peer and have to wait for them.
+    bool advance(sf::Uint8 input, Board& board, LockstepInputMessage& message);
+    void receive(std::string sender, const LockstepInputMessage& message);
+    LockstepState predicted();
+
+    // Every kChecksumTicks confirmed ticks we have a checksum to share, peers' checksums are
+    // compared as soon as we've confirmed the same tick and anyone who disagreed is reported once
+    bool takeChecksum(sf::Uint32& checksumTick, sf::Uint64& checksum);
+    void compareChecksum(std::string sender, sf::Uint32 checksumTick, sf::Uint64 checksum);
+    std::vector<Desync> takeDesyncs();
+
+    // Replace our confirmed state with a peer's and replay what we've confirmed since. If that
+    // jumps us ahead, the ticks we skipped get no input and filler carries that to peers.
+    sf::Uint32 confirmedState(LockstepState& state);
+    bool resync(const LockstepState& state, sf::Uint32 stateTick, Board& board, LockstepInputMessage& filler);
+
+    static sf::Uint8 encodeKey(sf::Keyboard::Key key);
+    static unsigned int inputDelayFor(unsigned long long worstRoutePing);
+
+private:
+    sf::Uint8 inputFor(const std::string& player, sf::Uint32 forTick, bool& known) const;
+    void simulate(LockstepState& state, sf::Uint32 forTick, Board& board, bool& complete) const;
+    void confirm(Board& board);
+    void recordChecksum();
+    sf::Uint32 retainedFrom() const { return confirmedTick > kChecksumHistory ? confirmedTick - kChecksumHistory + 1 : 1; }
+
+    struct Checksum {
+        sf::Uint32 tick;
+        sf::Uint64 checksum;
+
+        Checksum(): tick(0), checksum(0) {}
+    };
+
+    bool running;
+    std::string self;
+    unsigned int inputDelay;
+    sf::Uint32 tick;
+    sf::Uint32 confirmedTick;
+    LockstepState confirmed;
+    LockstepState prediction;
+    std::map<std::string, std::map<sf::Uint32, sf::Uint8>> inputs;
+
+    Checksum checksums[kChecksumHistory];
+    sf::Uint32 lastChecksumTaken;
+    std::map<std::string, std::map<sf::Uint32, sf::Uint64>> remoteChecksums; // Ones we haven't confirmed far enough to check
+    std::vector<Desync> desyncs;
+    std::mutex mutex;
+};
+
+#endif // __LOCKSTEP_H__
@@ -0,0 +1,263 @@
+#include "Logging.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace {
+const char* kLevelNames[] = { "error", "warning", "info", "debug" };
+const char* kCategoryNames[] = { "mesh", "routing", "game", "sync" };
+
+struct LogEntry {
+    std::atomic<LogEntry*> next;
+    LogLevel level;
+    LogCategory category;
+    const char* file;
+    int line;
+    std::string text;
+};
+
+// Lines go through an intrusive multi producer, single consumer queue: producers swap
+// themselves in at the head, only the writer thread walks from the tail
+class LogWriter {
+public:
+    LogWriter();
+    ~LogWriter();
+
+    void push(LogEntry* entry);
+    void flush();
+
+    std::atomic<int> levels[kLogCategoryCount];
+
+private:
+    LogWriter(const LogWriter&);
+
+    void link(LogEntry* entry);
+    LogEntry* pop();
+    void run();
+    void drain();
+    bool allow(const LogEntry& entry, std::string& output);
+    void expireWindows(std::string& output);
+    void reportSuppressed(const char* file, int line, unsigned int& suppressed, std::string& output);
+
+    std::atomic<LogEntry*> head;
+    LogEntry* tail;
+    LogEntry stub;
+    std::atomic<std::size_t> pending;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    // Only touched by the writer thread
+    struct Site {
+        Site(): written(0), suppressed(0) {}
+
+        std::chrono::steady_clock::time_point windowStart;
+        unsigned int written;
+        unsigned int suppressed;
+    };
+    std::map<std::pair<const char*, int>, Site> sites;
+};
+
+LogWriter::LogWriter(): tail(&stub), pending(0), dropped(0), running(true) {
+    for (auto& level : levels) {
+        level.store(kDefaultLogLevel);
+    }
+    stub.next.store(nullptr);
+    head.store(&stub);
+    thread = std::thread(&LogWriter::run, this);
+}
+
+LogWriter::~LogWriter() {
+    running = false;
+    thread.join();
+    drain();
+}
+
+void LogWriter::push(LogEntry* entry) {
+    if (pending.fetch_add(1, std::memory_order_relaxed) >= kLogQueueLimit) {
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        delete entry;
+        return;
+    }
+    link(entry);
+}
+
+void LogWriter::link(LogEntry* entry) {
+    entry->next.store(nullptr, std::memory_order_relaxed);
+    LogEntry* previous = head.exchange(entry, std::memory_order_acq_rel);
+    previous->next.store(entry, std::memory_order_release);
+}
+
+LogEntry* LogWriter::pop() {
+    LogEntry* entry = tail;
+    LogEntry* next = entry->next.load(std::memory_order_acquire);
+    if (entry == &stub) {
+        if (!next) {
+            return nullptr;
+        }
+        tail = next;
+        entry = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail = next;
+        return entry;
+    }
+
+    // A producer has swapped in but not linked yet, pick it up next time
+    if (entry != head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // Park the stub behind the last entry so that entry can be taken
+    link(&stub);
+    next = entry->next.load(std::memory_order_acquire);
+    if (next) {
+        tail = next;
+        return entry;
+    }
+    return nullptr;
+}
+
+void LogWriter::run() {
+    while (running) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLogFlushInterval));
+    }
+}
+
+void LogWriter::drain() {
+    std::string output;
+    while (LogEntry* entry = pop()) {
+        if (allow(*entry, output)) {
+            output += kLevelNames[entry->level];
+            output += " [";
+            output += kCategoryNames[entry->category];
+            output += "] ";
+            output += entry->text;
+            output += '\n';
+        }
+        delete entry;
+        pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    expireWindows(output);
+
+    unsigned long long lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+        std::stringstream note;
+        note << "warning [log] dropped " << lost << " lines, the writer fell behind" << std::endl;
+        output += note.str();
+    }
+
+    // One write per wakeup, stderr is unbuffered
+    if (!output.empty()) {
+        std::cerr.write(output.data(), output.size());
+    }
+}
+
+bool LogWriter::allow(const LogEntry& entry, std::string& output) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Site& site = sites[std::make_pair(entry.file, entry.line)];
+
+    if (now - site.windowStart >= std::chrono::milliseconds(kLogRateWindow)) {
+        reportSuppressed(entry.file, entry.line, site.suppressed, output);
+        site.windowStart = now;
+        site.written = 0;
+    }
+
+    if (site.written >= kLogRateLimit) {
+        site.suppressed++;
+        return false;
+    }
+    site.written++;
+    return true;
+}
+
+// Report what each call site held back once its window is over, even if it has gone quiet
+void LogWriter::expireWindows(std::string& output) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (auto& entry : sites) {
+        if (now - entry.second.windowStart >= std::chrono::milliseconds(kLogRateWindow)) {
+            reportSuppressed(entry.first.first, entry.first.second, entry.second.suppressed, output);
+        }
+    }
+}
+
+void LogWriter::reportSuppressed(const char* file, int line, unsigned int& suppressed, std::string& output) {
+    if (suppressed) {
+        std::stringstream note;
+        note << "warning [log] suppressed " << suppressed << " lines from " << file << ":" << line << std::endl;
+        output += note.str();
+        suppressed = 0;
+    }
+}
+
+void LogWriter::flush() {
+    while (pending.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+LogWriter writer;
+}
+
+bool logEnabled(LogLevel level, LogCategory category) {
+    return level <= writer.levels[category].load(std::memory_order_relaxed);
+}
+
+void setLogLevel(LogLevel level) {
+    for (auto& categoryLevel : writer.levels) {
+        categoryLevel.store(level);
+    }
+}
+
+void setLogLevel(LogCategory category, LogLevel level) {
+    writer.levels[category].store(level);
+}
+
+bool parseLogLevel(std::string name, LogLevel& level) {
+    for (int index = kLogError; index <= kLogDebug; index++) {
+        if (name == kLevelNames[index]) {
+            level = static_cast<LogLevel>(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseLogCategory(std::string name, LogCategory& category) {
+    for (int index = 0; index < kLogCategoryCount; index++) {
+        if (name == kCategoryNames[index]) {
+            category = static_cast<LogCategory>(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+void flushLog() {
+    writer.flush();
+}
+
+LogLine::LogLine(LogLevel _level, LogCategory _category, const char* _file, int _line): level(_level), category(_category), file(_file), line(_line) {
+}
+
+LogLine::~LogLine() {
+    LogEntry* entry = new LogEntry;
+    entry->level = level;
+    entry->category = category;
+    entry->file = file;
+    entry->line = line;
+    entry->text = buffer.str();
+
+    // Callers used to end lines with std::endl, the writer adds its own
+    while (!entry->text.empty() && entry->text[entry->text.size() - 1] == '\n') {
+        entry->text.erase(entry->text.size() - 1);
+    }
+    writer.push(entry);
+}
@@ -0,0 +1,58 @@
+#ifndef __LOGGING_H__
+#define __LOGGING_H__
+
+#include <sstream>
+#include <string>
+
+enum LogLevel {
+    kLogError,
+    kLogWarning,
+    kLogInfo,
+    kLogDebug // Per message detail, far too much to leave on under load
+};
+
+enum LogCategory {
+    kLogMesh, // Connections, sockets and frames
+    kLogRouting, // Route discovery, optimization and forwarding
+    kLogGame,
+    kLogSync, // Lockstep, replication, resyncs and replays
+    kLogCategoryCount
+};
+
+const LogLevel kDefaultLogLevel = kLogInfo;
+const std::size_t kLogQueueLimit = 65536; // Lines waiting on the writer before new ones are dropped
+const int kLogFlushInterval = 10; // The writer wakes every x ms
+const int kLogRateWindow = 1000; // Lines are counted per call site over x ms
+const unsigned int kLogRateLimit = 20; // Lines one call site may write per window, the rest are counted
+
+bool logEnabled(LogLevel level, LogCategory category);
+void setLogLevel(LogLevel level);
+void setLogLevel(LogCategory category, LogLevel level);
+bool parseLogLevel(std::string name, LogLevel& level);
+bool parseLogCategory(std::string name, LogCategory& category);
+
+// Wait until everything logged so far has been written
+void flushLog();
+
+// Collects one line and queues it for the writer thread when it goes out of scope
+class LogLine {
+public:
+    LogLine(LogLevel level, LogCategory category, const char* file, int line);
+    ~LogLine();
+    std::ostream& stream() { return buffer; }
+
+private:
+    LogLine(const LogLine&);
+
+    LogLevel level;
+    LogCategory category;
+    const char* file;
+    int line;
+    std::ostringstream buffer;
+};
+
+// LOG(kLogInfo, kLogMesh) << "Connected to " << name; nothing after LOG is evaluated when the
+// level is off for that category
+#define LOG(level, category) if (!logEnabled(level, category)) {} else LogLine(level, category, __FILE__, __LINE__).stream()
+
+#endif // __LOGGING_H__
@@ -0,0 +1,286 @@
+#include "Loopback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+const unsigned int kSpinAttempts = 64; // Yield this many times before sleeping between attempts
+
+// Blocking calls have nothing to wait on but the other thread, spin a little then back off
+void backoff(unsigned int attempt) {
+    if (attempt < kSpinAttempts) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+}
+
+FrameRing::FrameRing(): head(0), tail(0) {
+}
+
+bool FrameRing::push(const void* data, std::size_t size) {
+    sf::Uint32 position = tail.load(std::memory_order_relaxed);
+    if (position - head.load(std::memory_order_acquire) >= kLoopbackRingSize) {
+        return false;
+    }
+
+    slots[position % kLoopbackRingSize].assign(static_cast<const char*>(data), size);
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::pop(sf::Packet& packet) {
+    sf::Uint32 position = head.load(std::memory_order_relaxed);
+    if (position == tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const std::string& slot = slots[position % kLoopbackRingSize];
+    packet.clear();
+    packet.append(slot.data(), slot.size());
+    head.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+LoopbackEndpoint::LoopbackEndpoint(): sleeping(false), open(true), pending(0) {
+}
+
+void LoopbackEndpoint::notify() {
+    // Pairs with the fence in LoopbackTransport::wait, one of us sees the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+}
+
+LoopbackChannel::LoopbackChannel(std::shared_ptr<LoopbackPipe> _pipe, int _side): pipe(_pipe), side(_side), blocking(true) {
+    sending.clear();
+}
+
+LoopbackChannel::~LoopbackChannel() {
+    pipe->closed[side] = true;
+    pipe->endpoints[1 - side]->notify();
+}
+
+sf::Socket::Status LoopbackChannel::send(sf::Packet& packet) {
+    int other = 1 - side;
+    for (unsigned int attempt = 0; ; attempt++) {
+        if (pipe->closed[other]) {
+            return sf::Socket::Disconnected;
+        }
+
+        while (sending.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        bool pushed = pipe->rings[other].push(packet.getData(), packet.getDataSize());
+        sending.clear(std::memory_order_release);
+
+        if (pushed) {
+            pipe->endpoints[other]->notify();
+            return sf::Socket::Done;
+        } else if (!blocking) {
+            return sf::Socket::NotReady;
+        }
+        backoff(attempt);
+    }
+}
+
+sf::Socket::Status LoopbackChannel::receive(sf::Packet& packet) {
+    for (unsigned int attempt = 0; ; attempt++) {
+        if (pipe->rings[side].pop(packet)) {
+            return sf::Socket::Done;
+        }
+
+        // Whatever was sent before the other end went still gets delivered
+        if (pipe->closed[1 - side]) {
+            return pipe->rings[side].pop(packet) ? sf::Socket::Done : sf::Socket::Disconnected;
+        } else if (!blocking) {
+            return sf::Socket::NotReady;
+        }
+        backoff(attempt);
+    }
+}
+
+bool LoopbackChannel::isReady() const {
+    return !pipe->rings[side].empty() || pipe->closed[1 - side];
+}
+
+LoopbackNetwork::LoopbackNetwork(): localPorts(kLoopbackFirstLocalPort) {
+}
+
+unsigned short LoopbackNetwork::bind(unsigned short port, std::shared_ptr<LoopbackEndpoint> endpoint) {
+    std::lock_guard<std::mutex> lock(mutex);
+    while (listeners.find(port) != listeners.end()) {
+        port++;
+    }
+    listeners[port] = endpoint;
+    return port;
+}
+
+void LoopbackNetwork::unbind(unsigned short port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    listeners.erase(port);
+}
+
+std::shared_ptr<LoopbackEndpoint> LoopbackNetwork::find(unsigned short port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto listener = listeners.find(port);
+    return listener != listeners.end() ? listener->second : std::shared_ptr<LoopbackEndpoint>();
+}
+
+unsigned short LoopbackNetwork::nextLocalPort() {
+    return localPorts++;
+}
+
+LoopbackTransport::LoopbackTransport(std::shared_ptr<LoopbackNetwork> _network): network(_network), endpoint(new LoopbackEndpoint()), port(0), listening(false) {
+}
+
+LoopbackTransport::~LoopbackTransport() {
+    close();
+}
+
+unsigned short LoopbackTransport::listen(unsigned short _port) {
+    port = network->bind(_port, endpoint);
+    listening = true;
+    return port;
+}
+
+void LoopbackTransport::close() {
+    if (listening) {
+        network->unbind(port);
+        listening = false;
+    }
+
+    // Whoever is still waiting to be accepted finds the pipe closed, once we're out of the lock
+    std::deque<std::unique_ptr<Channel>> refused;
+    {
+        std::lock_guard<std::mutex> lock(endpoint->mutex);
+        endpoint->open = false;
+        refused.swap(endpoint->backlog);
+        endpoint->pending = 0;
+    }
+}
+
+std::unique_ptr<Channel> LoopbackTransport::connect(sf::IpAddress address, unsigned short _port, sf::Time timeout) {
+    std::shared_ptr<LoopbackEndpoint> remote;
+    if (address == sf::IpAddress::LocalHost) {
+        remote = network->find(_port);
+    }
+    if (!remote) {
+        return std::unique_ptr<Channel>();
+    }
+
+    std::shared_ptr<LoopbackPipe> pipe(new LoopbackPipe());
+    pipe->endpoints[0] = endpoint;
+    pipe->endpoints[1] = remote;
+    pipe->ports[0] = network->nextLocalPort();
+    pipe->ports[1] = _port;
+
+    std::unique_ptr<Channel> accepted(new LoopbackChannel(pipe, 1));
+    Channel* waiting = accepted.get();
+    {
+        std::lock_guard<std::mutex> lock(remote->mutex);
+        if (remote->open) {
+            remote->backlog.push_back(std::move(accepted));
+            remote->pending++;
+        }
+    }
+    if (accepted) {
+        return std::unique_ptr<Channel>();
+    }
+    remote->notify();
+
+    // Nothing completes a handshake for the listener, so wait for it to accept. A zero timeout
+    // waits as long as it takes, as it does for a socket.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout.asMicroseconds());
+    std::unique_ptr<Channel> abandoned;
+    for (unsigned int attempt = 0; ; attempt++) {
+        {
+            std::lock_guard<std::mutex> lock(remote->mutex);
+            auto queued = std::find_if(remote->backlog.begin(), remote->backlog.end(), [waiting](const std::unique_ptr<Channel>& channel) { return channel.get() == waiting; });
+            if (queued == remote->backlog.end()) {
+                break;
+            } else if (timeout != sf::Time::Zero && std::chrono::steady_clock::now() >= deadline) {
+                abandoned = std::move(*queued);
+                remote->backlog.erase(queued);
+                remote->pending--;
+                break;
+            }
+        }
+        backoff(attempt);
+    }
+
+    // Closing the listener refuses its backlog just as giving up does
+    if (abandoned || pipe->closed[1]) {
+        return std::unique_ptr<Channel>();
+    }
+    return std::unique_ptr<Channel>(new LoopbackChannel(pipe, 0));
+}
+
+bool LoopbackTransport::anythingReady() {
+    if (endpoint->pending) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(channelsMutex);
+    for (auto channel : channels) {
+        if (channel->isReady()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LoopbackTransport::wait(sf::Time timeout) {
+    if (anythingReady()) {
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout.asMicroseconds());
+    std::unique_lock<std::mutex> lock(endpoint->mutex);
+    endpoint->sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool ready;
+    while (!(ready = anythingReady()) && endpoint->wake.wait_until(lock, deadline) != std::cv_status::timeout) {
+    }
+    endpoint->sleeping = false;
+    return ready || anythingReady();
+}
+
+std::unique_ptr<Channel> LoopbackTransport::accept() {
+    if (!endpoint->pending) {
+        return std::unique_ptr<Channel>();
+    }
+
+    std::lock_guard<std::mutex> lock(endpoint->mutex);
+    if (endpoint->backlog.empty()) {
+        return std::unique_ptr<Channel>();
+    }
+    std::unique_ptr<Channel> channel = std::move(endpoint->backlog.front());
+    endpoint->backlog.pop_front();
+    endpoint->pending--;
+    return channel;
+}
+
+// A LoopbackTransport only ever hands out LoopbackChannels
+void LoopbackTransport::add(Channel& channel) {
+    std::lock_guard<std::mutex> lock(channelsMutex);
+    channels.push_back(static_cast<LoopbackChannel*>(&channel));
+}
+
+void LoopbackTransport::remove(Channel& channel) {
+    std::lock_guard<std::mutex> lock(channelsMutex);
+    channels.erase(std::remove(channels.begin(), channels.end(), static_cast<LoopbackChannel*>(&channel)), channels.end());
+}
+
+bool LoopbackTransport::isReady(Channel& channel) {
+    return static_cast<LoopbackChannel&>(channel).isReady();
+}
@@ -0,0 +1,133 @@
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+#include <SFML/Network.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Transport.h"
+
+const unsigned int kLoopbackRingSize = 4096; // Frames in flight each way before a non blocking send is refused, about what a socket buffers
+const unsigned short kLoopbackFirstLocalPort = 49152; // Ports handed to the connecting end, like the OS's ephemeral range
+
+// Single producer, single consumer ring of frames. Slots keep their capacity, so once warmed up
+// pushing a frame no bigger than the last one in that slot doesn't allocate.
+class FrameRing {
+public:
+    FrameRing();
+
+    bool push(const void* data, std::size_t size); // False when full
+    bool pop(sf::Packet& packet); // False when empty
+    bool empty() const;
+
+private:
+    FrameRing(const FrameRing&);
+
+    std::string slots[kLoopbackRingSize];
+    std::atomic<sf::Uint32> head; // Next to pop, only the consumer moves it
+    std::atomic<sf::Uint32> tail; // Next to push, only the producer moves it
+};
+
+// What a loopback transport can be reached and woken through, outlives the transport while channels point at it
+struct LoopbackEndpoint {
+    LoopbackEndpoint();
+    // Called after pushing to a ring this endpoint reads, only takes the lock if the listener is asleep
+    void notify();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> sleeping;
+
+    bool open; // Guarded by mutex, as is the backlog
+    std::deque<std::unique_ptr<Channel>> backlog; // Connected but not yet accepted
+    std::atomic<unsigned int> pending; // Backlog size, readable without the lock
+};
+
+// Both directions of one connection, side 0 is the end that connected
+struct LoopbackPipe {
+    LoopbackPipe() { closed[0] = false; closed[1] = false; }
+
+    FrameRing rings[2]; // rings[side] is read by that side
+    std::atomic<bool> closed[2];
+    std::shared_ptr<LoopbackEndpoint> endpoints[2];
+    unsigned short ports[2];
+};
+
+class LoopbackChannel : public Channel {
+public:
+    LoopbackChannel(std::shared_ptr<LoopbackPipe> _pipe, int _side);
+    ~LoopbackChannel();
+
+    sf::Socket::Status send(sf::Packet& packet);
+    sf::Socket::Status receive(sf::Packet& packet);
+    void setBlocking(bool _blocking) { blocking = _blocking; }
+
+    unsigned short getLocalPort() const { return pipe->ports[side]; }
+    sf::IpAddress getRemoteAddress() const { return sf::IpAddress::LocalHost; }
+    unsigned short getRemotePort() const { return pipe->ports[1 - side]; }
+
+    bool isReady() const;
+
+private:
+    LoopbackChannel(const LoopbackChannel&);
+
+    std::shared_ptr<LoopbackPipe> pipe;
+    int side;
+    bool blocking;
+    std::atomic_flag sending; // The ring takes one producer, but every node thread sends
+};
+
+// The in-process stand-in for the network: which endpoint listens on which port
+class LoopbackNetwork {
+public:
+    LoopbackNetwork();
+
+    unsigned short bind(unsigned short port, std::shared_ptr<LoopbackEndpoint> endpoint);
+    void unbind(unsigned short port);
+    std::shared_ptr<LoopbackEndpoint> find(unsigned short port);
+    unsigned short nextLocalPort();
+
+private:
+    std::map<unsigned short, std::shared_ptr<LoopbackEndpoint>> listeners;
+    std::mutex mutex;
+    std::atomic<unsigned short> localPorts;
+};
+
+// Connects nodes in the same process through rings instead of sockets. Every node on a network
+// is at 127.0.0.1, connect only looks at the port.
+class LoopbackTransport : public Transport {
+public:
+    LoopbackTransport(std::shared_ptr<LoopbackNetwork> _network);
+    ~LoopbackTransport();
+
+    unsigned short listen(unsigned short port);
+    void close();
+    sf::IpAddress getAddress() { return sf::IpAddress::LocalHost; }
+
+    std::unique_ptr<Channel> connect(sf::IpAddress address, unsigned short port, sf::Time timeout);
+
+    bool wait(sf::Time timeout);
+    std::unique_ptr<Channel> accept();
+    void add(Channel& channel);
+    void remove(Channel& channel);
+    bool isReady(Channel& channel);
+
+private:
+    bool anythingReady();
+
+    std::shared_ptr<LoopbackNetwork> network;
+    std::shared_ptr<LoopbackEndpoint> endpoint;
+    unsigned short port;
+    bool listening;
+
+    std::vector<LoopbackChannel*> channels; // Owned by the node's connections
+    std::mutex channelsMutex;
+};
+
+#endif // __LOOPBACK_H__
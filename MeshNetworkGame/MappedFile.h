@@ -0,0 +1,31 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+#include <string>
+
+// Read-only memory mapping of a whole file, the OS pages it in as it's touched
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(std::string filename);
+    void close();
+    bool isOpen() const { return view != nullptr; }
+    const unsigned char* data() const { return view; }
+    std::size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* view;
+    std::size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int descriptor;
+#endif
+};
+
+#endif // __MAPPED_FILE_H__
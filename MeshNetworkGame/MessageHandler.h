@@ -11,11 +11,19 @@ class MeshNode;
 
 class MessageHandler {
 public:
-    virtual void handleMessage(std::string sender, std::string type, Json::Value message) = 0;
-    void setMeshNode(std::unique_ptr<MeshNode> _node) { node = std::move(_node); }
+    MessageHandler(): node(nullptr) {}
+
+    // The payload is schema encoded, decode it with decodePayload into the struct for that type
+    virtual void handleMessage(std::string sender, std::string type, const std::string& payload) = 0;
+    // Publications on a topic we subscribed with, sender is whoever published
+    virtual void handleTopic(std::string, std::string sender, std::string type, const std::string& payload) { handleMessage(sender, type, payload); }
+    // A peer we were connected to has left the mesh, forget anything kept for them
+    virtual void handleDisconnect(std::string) {}
+    // The node owns itself and outlives its handlers, we only borrow it
+    void setMeshNode(MeshNode* _node) { node = _node; }
     std::vector<std::string> getMessageTypes() { return messageTypes; }
 protected:
-    std::unique_ptr<MeshNode> node;
+    MeshNode* node;
     std::vector<std::string> messageTypes;
 };
 
@@ -0,0 +1,1241 @@
+// Generated by Tools/messagegen.py from Messages.idl, do not edit by hand
+#ifndef __MESSAGES_H__
+#define __MESSAGES_H__
+#include <SFML/Network.hpp>
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+
+// Every struct describes its layout at compile time: Field lists the fields in wire order and
+// kFixedSize is the encoded size in bytes, or 0 when a string or list makes it variable
+
+// sf::Packet stops at 32 bits, so 64 bit fields go out as two words in network order
+inline void writeUint64(sf::Packet& packet, sf::Uint64 value) {
+    packet << static_cast<sf::Uint32>(value >> 32) << static_cast<sf::Uint32>(value & 0xFFFFFFFF);
+}
+
+inline bool readUint64(sf::Packet& packet, sf::Uint64& value) {
+    sf::Uint32 high, low;
+    if (!(packet >> high >> low)) {
+        return false;
+    }
+    value = (static_cast<sf::Uint64>(high) << 32) | low;
+    return true;
+}
+
+struct InfoMessage {
+    static const char* type() { return "info"; }
+    enum Field { kAddress, kListeningPort, kName, kCompression, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string address;
+    sf::Uint16 listeningPort;
+    std::string name;
+    sf::Uint32 compression;
+
+    InfoMessage(): listeningPort(0), compression(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << address;
+        packet << listeningPort;
+        packet << name;
+        packet << compression;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> address)) {
+            return false;
+        }
+        if (!(packet >> listeningPort)) {
+            return false;
+        }
+        if (!(packet >> name)) {
+            return false;
+        }
+        if (!(packet >> compression)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["address"] = address;
+        json["listeningPort"] = static_cast<Json::UInt>(listeningPort);
+        json["name"] = name;
+        json["compression"] = static_cast<Json::UInt>(compression);
+        return json;
+    }
+};
+
+struct PingMessage {
+    static const char* type() { return "ping"; }
+    enum Field { kPing, kFieldCount };
+    static const std::size_t kFixedSize = 8;
+
+    sf::Uint64 ping;
+
+    PingMessage(): ping(0) {}
+
+    void encode(sf::Packet& packet) const {
+        writeUint64(packet, ping);
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!readUint64(packet, ping)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["ping"] = static_cast<Json::UInt64>(ping);
+        return json;
+    }
+};
+
+struct PongMessage {
+    static const char* type() { return "pong"; }
+    enum Field { kPing, kFieldCount };
+    static const std::size_t kFixedSize = 8;
+
+    sf::Uint64 ping;
+
+    PongMessage(): ping(0) {}
+
+    void encode(sf::Packet& packet) const {
+        writeUint64(packet, ping);
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!readUint64(packet, ping)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["ping"] = static_cast<Json::UInt64>(ping);
+        return json;
+    }
+};
+
+struct UserPing {
+    enum Field { kName, kPing, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string name;
+    sf::Uint64 ping;
+
+    UserPing(): ping(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << name;
+        writeUint64(packet, ping);
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> name)) {
+            return false;
+        }
+        if (!readUint64(packet, ping)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["name"] = name;
+        json["ping"] = static_cast<Json::UInt64>(ping);
+        return json;
+    }
+};
+
+struct UserAddress {
+    enum Field { kName, kAddress, kPort, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string name;
+    std::string address;
+    sf::Uint16 port;
+
+    UserAddress(): port(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << name;
+        packet << address;
+        packet << port;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> name)) {
+            return false;
+        }
+        if (!(packet >> address)) {
+            return false;
+        }
+        if (!(packet >> port)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["name"] = name;
+        json["address"] = address;
+        json["port"] = static_cast<Json::UInt>(port);
+        return json;
+    }
+};
+
+struct RequestConnectionsMessage {
+    static const char* type() { return "requestConnections"; }
+    enum Field { kUsers, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::vector<std::string> users;
+
+    void encode(sf::Packet& packet) const {
+        packet << static_cast<sf::Uint32>(users.size());
+        for (auto& element0 : users) {
+            packet << element0;
+        }
+    }
+
+    bool decode(sf::Packet& packet) {
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        users.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            std::string element0;
+            if (!(packet >> element0)) {
+                return false;
+            }
+            users.push_back(element0);
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["users"] = Json::Value(Json::arrayValue);
+        for (auto& element : users) {
+            json["users"].append(element);
+        }
+        return json;
+    }
+};
+
+struct ResponseConnectionsMessage {
+    static const char* type() { return "responseConnections"; }
+    enum Field { kUsers, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::vector<UserAddress> users;
+
+    void encode(sf::Packet& packet) const {
+        packet << static_cast<sf::Uint32>(users.size());
+        for (auto& element0 : users) {
+            element0.encode(packet);
+        }
+    }
+
+    bool decode(sf::Packet& packet) {
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        users.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            UserAddress element0;
+            if (!element0.decode(packet)) {
+                return false;
+            }
+            users.push_back(element0);
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["users"] = Json::Value(Json::arrayValue);
+        for (auto& element : users) {
+            json["users"].append(element.toJson());
+        }
+        return json;
+    }
+};
+
+struct OptimizeRouteMessage {
+    static const char* type() { return "optimizeRoute"; }
+    enum Field { kDestination, kData, kFinalPing, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string destination;
+    std::vector<UserPing> data;
+    sf::Uint64 finalPing;
+
+    OptimizeRouteMessage(): finalPing(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << destination;
+        packet << static_cast<sf::Uint32>(data.size());
+        for (auto& element0 : data) {
+            element0.encode(packet);
+        }
+        writeUint64(packet, finalPing);
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> destination)) {
+            return false;
+        }
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        data.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            UserPing element0;
+            if (!element0.decode(packet)) {
+                return false;
+            }
+            data.push_back(element0);
+        }
+        if (!readUint64(packet, finalPing)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["destination"] = destination;
+        json["data"] = Json::Value(Json::arrayValue);
+        for (auto& element : data) {
+            json["data"].append(element.toJson());
+        }
+        json["finalPing"] = static_cast<Json::UInt64>(finalPing);
+        return json;
+    }
+};
+
+struct RpcRequestMessage {
+    static const char* type() { return "rpcRequest"; }
+    enum Field { kId, kMethod, kPayload, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    sf::Uint32 id;
+    std::string method;
+    std::string payload;
+
+    RpcRequestMessage(): id(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << id;
+        packet << method;
+        packet << payload;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> id)) {
+            return false;
+        }
+        if (!(packet >> method)) {
+            return false;
+        }
+        if (!(packet >> payload)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["id"] = static_cast<Json::UInt>(id);
+        json["method"] = method;
+        json["payload"] = payload;
+        return json;
+    }
+};
+
+struct RpcResponseMessage {
+    static const char* type() { return "rpcResponse"; }
+    enum Field { kId, kStatus, kPayload, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    sf::Uint32 id;
+    sf::Uint8 status;
+    std::string payload;
+
+    RpcResponseMessage(): id(0), status(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << id;
+        packet << status;
+        packet << payload;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> id)) {
+            return false;
+        }
+        if (!(packet >> status)) {
+            return false;
+        }
+        if (!(packet >> payload)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["id"] = static_cast<Json::UInt>(id);
+        json["status"] = static_cast<Json::UInt>(status);
+        json["payload"] = payload;
+        return json;
+    }
+};
+
+struct SubscriptionsMessage {
+    static const char* type() { return "subscriptions"; }
+    enum Field { kSubscriber, kVersion, kTopics, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string subscriber;
+    sf::Uint32 version;
+    std::vector<std::string> topics;
+
+    SubscriptionsMessage(): version(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << subscriber;
+        packet << version;
+        packet << static_cast<sf::Uint32>(topics.size());
+        for (auto& element0 : topics) {
+            packet << element0;
+        }
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> subscriber)) {
+            return false;
+        }
+        if (!(packet >> version)) {
+            return false;
+        }
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        topics.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            std::string element0;
+            if (!(packet >> element0)) {
+                return false;
+            }
+            topics.push_back(element0);
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["subscriber"] = subscriber;
+        json["version"] = static_cast<Json::UInt>(version);
+        json["topics"] = Json::Value(Json::arrayValue);
+        for (auto& element : topics) {
+            json["topics"].append(element);
+        }
+        return json;
+    }
+};
+
+struct PublishMessage {
+    static const char* type() { return "publish"; }
+    enum Field { kTopic, kOrigin, kPayloadType, kPayload, kDestinations, kHops, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string topic;
+    std::string origin;
+    std::string payloadType;
+    std::string payload;
+    std::vector<std::string> destinations;
+    sf::Uint8 hops;
+
+    PublishMessage(): hops(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << topic;
+        packet << origin;
+        packet << payloadType;
+        packet << payload;
+        packet << static_cast<sf::Uint32>(destinations.size());
+        for (auto& element0 : destinations) {
+            packet << element0;
+        }
+        packet << hops;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> topic)) {
+            return false;
+        }
+        if (!(packet >> origin)) {
+            return false;
+        }
+        if (!(packet >> payloadType)) {
+            return false;
+        }
+        if (!(packet >> payload)) {
+            return false;
+        }
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        destinations.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            std::string element0;
+            if (!(packet >> element0)) {
+                return false;
+            }
+            destinations.push_back(element0);
+        }
+        if (!(packet >> hops)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["topic"] = topic;
+        json["origin"] = origin;
+        json["payloadType"] = payloadType;
+        json["payload"] = payload;
+        json["destinations"] = Json::Value(Json::arrayValue);
+        for (auto& element : destinations) {
+            json["destinations"].append(element);
+        }
+        json["hops"] = static_cast<Json::UInt>(hops);
+        return json;
+    }
+};
+
+struct TestMessage {
+    static const char* type() { return "test"; }
+    enum Field { kTest, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string test;
+
+    void encode(sf::Packet& packet) const {
+        packet << test;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> test)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["test"] = test;
+        return json;
+    }
+};
+
+struct StartMessage {
+    static const char* type() { return "start"; }
+    enum Field { kStarter, kLockstep, kInputDelay, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string starter;
+    bool lockstep;
+    sf::Uint8 inputDelay;
+
+    StartMessage(): lockstep(false), inputDelay(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << starter;
+        packet << lockstep;
+        packet << inputDelay;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> starter)) {
+            return false;
+        }
+        if (!(packet >> lockstep)) {
+            return false;
+        }
+        if (!(packet >> inputDelay)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["starter"] = starter;
+        json["lockstep"] = static_cast<bool>(lockstep);
+        json["inputDelay"] = static_cast<Json::UInt>(inputDelay);
+        return json;
+    }
+};
+
+struct ReadyMessage {
+    static const char* type() { return "ready"; }
+    enum Field { kColor, kX, kY, kFieldCount };
+    static const std::size_t kFixedSize = 5;
+
+    sf::Uint8 color;
+    sf::Uint16 x;
+    sf::Uint16 y;
+
+    ReadyMessage(): color(0), x(0), y(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << color;
+        packet << x;
+        packet << y;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> color)) {
+            return false;
+        }
+        if (!(packet >> x)) {
+            return false;
+        }
+        if (!(packet >> y)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["color"] = static_cast<Json::UInt>(color);
+        json["x"] = static_cast<Json::UInt>(x);
+        json["y"] = static_cast<Json::UInt>(y);
+        return json;
+    }
+};
+
+struct PlayerKeyframeMessage {
+    static const char* type() { return "playerKeyframe"; }
+    enum Field { kTick, kX, kY, kColor, kFieldCount };
+    static const std::size_t kFixedSize = 9;
+
+    sf::Uint32 tick;
+    sf::Uint16 x;
+    sf::Uint16 y;
+    sf::Uint8 color;
+
+    PlayerKeyframeMessage(): tick(0), x(0), y(0), color(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        packet << x;
+        packet << y;
+        packet << color;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        if (!(packet >> x)) {
+            return false;
+        }
+        if (!(packet >> y)) {
+            return false;
+        }
+        if (!(packet >> color)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["x"] = static_cast<Json::UInt>(x);
+        json["y"] = static_cast<Json::UInt>(y);
+        json["color"] = static_cast<Json::UInt>(color);
+        return json;
+    }
+};
+
+struct PlayerDeltaMessage {
+    static const char* type() { return "playerDelta"; }
+    enum Field { kTick, kBaseTick, kDx, kDy, kFieldCount };
+    static const std::size_t kFixedSize = 10;
+
+    sf::Uint32 tick;
+    sf::Uint32 baseTick;
+    sf::Int8 dx;
+    sf::Int8 dy;
+
+    PlayerDeltaMessage(): tick(0), baseTick(0), dx(0), dy(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        packet << baseTick;
+        packet << dx;
+        packet << dy;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        if (!(packet >> baseTick)) {
+            return false;
+        }
+        if (!(packet >> dx)) {
+            return false;
+        }
+        if (!(packet >> dy)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["baseTick"] = static_cast<Json::UInt>(baseTick);
+        json["dx"] = static_cast<Json::Int>(dx);
+        json["dy"] = static_cast<Json::Int>(dy);
+        return json;
+    }
+};
+
+struct PlayerAckMessage {
+    static const char* type() { return "playerAck"; }
+    enum Field { kTick, kKeyframe, kFieldCount };
+    static const std::size_t kFixedSize = 5;
+
+    sf::Uint32 tick;
+    bool keyframe;
+
+    PlayerAckMessage(): tick(0), keyframe(false) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        packet << keyframe;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        if (!(packet >> keyframe)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["keyframe"] = static_cast<bool>(keyframe);
+        return json;
+    }
+};
+
+struct LockstepInputMessage {
+    static const char* type() { return "lockstepInput"; }
+    enum Field { kTick, kInputs, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    sf::Uint32 tick;
+    std::vector<sf::Uint8> inputs;
+
+    LockstepInputMessage(): tick(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        packet << static_cast<sf::Uint32>(inputs.size());
+        for (auto& element0 : inputs) {
+            packet << element0;
+        }
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        inputs.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            sf::Uint8 element0 = 0;
+            if (!(packet >> element0)) {
+                return false;
+            }
+            inputs.push_back(element0);
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["inputs"] = Json::Value(Json::arrayValue);
+        for (auto& element : inputs) {
+            json["inputs"].append(static_cast<Json::UInt>(element));
+        }
+        return json;
+    }
+};
+
+struct ChecksumMessage {
+    static const char* type() { return "checksum"; }
+    enum Field { kTick, kChecksum, kFieldCount };
+    static const std::size_t kFixedSize = 12;
+
+    sf::Uint32 tick;
+    sf::Uint64 checksum;
+
+    ChecksumMessage(): tick(0), checksum(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        writeUint64(packet, checksum);
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        if (!readUint64(packet, checksum)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["checksum"] = static_cast<Json::UInt64>(checksum);
+        return json;
+    }
+};
+
+struct ResyncRequestMessage {
+    static const char* type() { return "resyncRequest"; }
+    enum Field { kTick, kFieldCount };
+    static const std::size_t kFixedSize = 4;
+
+    sf::Uint32 tick;
+
+    ResyncRequestMessage(): tick(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        return json;
+    }
+};
+
+struct ResyncPlayer {
+    enum Field { kName, kX, kY, kColor, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::string name;
+    sf::Uint16 x;
+    sf::Uint16 y;
+    sf::Uint8 color;
+
+    ResyncPlayer(): x(0), y(0), color(0) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << name;
+        packet << x;
+        packet << y;
+        packet << color;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> name)) {
+            return false;
+        }
+        if (!(packet >> x)) {
+            return false;
+        }
+        if (!(packet >> y)) {
+            return false;
+        }
+        if (!(packet >> color)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["name"] = name;
+        json["x"] = static_cast<Json::UInt>(x);
+        json["y"] = static_cast<Json::UInt>(y);
+        json["color"] = static_cast<Json::UInt>(color);
+        return json;
+    }
+};
+
+struct ResyncStateMessage {
+    static const char* type() { return "resyncState"; }
+    enum Field { kTick, kPlayers, kTaggedPlayer, kPreviouslyTaggedPlayer, kMadeDistance, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    sf::Uint32 tick;
+    std::vector<ResyncPlayer> players;
+    std::string taggedPlayer;
+    std::string previouslyTaggedPlayer;
+    bool madeDistance;
+
+    ResyncStateMessage(): tick(0), madeDistance(false) {}
+
+    void encode(sf::Packet& packet) const {
+        packet << tick;
+        packet << static_cast<sf::Uint32>(players.size());
+        for (auto& element0 : players) {
+            element0.encode(packet);
+        }
+        packet << taggedPlayer;
+        packet << previouslyTaggedPlayer;
+        packet << madeDistance;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!(packet >> tick)) {
+            return false;
+        }
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        players.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            ResyncPlayer element0;
+            if (!element0.decode(packet)) {
+                return false;
+            }
+            players.push_back(element0);
+        }
+        if (!(packet >> taggedPlayer)) {
+            return false;
+        }
+        if (!(packet >> previouslyTaggedPlayer)) {
+            return false;
+        }
+        if (!(packet >> madeDistance)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["tick"] = static_cast<Json::UInt>(tick);
+        json["players"] = Json::Value(Json::arrayValue);
+        for (auto& element : players) {
+            json["players"].append(element.toJson());
+        }
+        json["taggedPlayer"] = taggedPlayer;
+        json["previouslyTaggedPlayer"] = previouslyTaggedPlayer;
+        json["madeDistance"] = static_cast<bool>(madeDistance);
+        return json;
+    }
+};
+
+struct InterestMessage {
+    static const char* type() { return "interest"; }
+    enum Field { kRegions, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    std::vector<sf::Uint32> regions;
+
+    void encode(sf::Packet& packet) const {
+        packet << static_cast<sf::Uint32>(regions.size());
+        for (auto& element0 : regions) {
+            packet << element0;
+        }
+    }
+
+    bool decode(sf::Packet& packet) {
+        sf::Uint32 count0;
+        if (!(packet >> count0)) {
+            return false;
+        }
+        regions.clear();
+        for (sf::Uint32 i0 = 0; i0 < count0; i0++) {
+            sf::Uint32 element0 = 0;
+            if (!(packet >> element0)) {
+                return false;
+            }
+            regions.push_back(element0);
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["regions"] = Json::Value(Json::arrayValue);
+        for (auto& element : regions) {
+            json["regions"].append(static_cast<Json::UInt>(element));
+        }
+        return json;
+    }
+};
+
+struct BenchmarkMessage {
+    static const char* type() { return "benchmark"; }
+    enum Field { kSent, kSequence, kPadding, kFieldCount };
+    static const std::size_t kFixedSize = 0;
+
+    sf::Uint64 sent;
+    sf::Uint32 sequence;
+    std::string padding;
+
+    BenchmarkMessage(): sent(0), sequence(0) {}
+
+    void encode(sf::Packet& packet) const {
+        writeUint64(packet, sent);
+        packet << sequence;
+        packet << padding;
+    }
+
+    bool decode(sf::Packet& packet) {
+        if (!readUint64(packet, sent)) {
+            return false;
+        }
+        if (!(packet >> sequence)) {
+            return false;
+        }
+        if (!(packet >> padding)) {
+            return false;
+        }
+        return true;
+    }
+
+    Json::Value toJson() const {
+        Json::Value json(Json::objectValue);
+        json["sent"] = static_cast<Json::UInt64>(sent);
+        json["sequence"] = static_cast<Json::UInt>(sequence);
+        json["padding"] = padding;
+        return json;
+    }
+};
+
+
+// Flatten a message into the bytes carried by Message::payload
+template <typename T>
+std::string encodePayload(const T& message) {
+    sf::Packet packet;
+    message.encode(packet);
+    return std::string(static_cast<const char*>(packet.getData()), packet.getDataSize());
+}
+
+// Rebuild a message from Message::payload, false if the bytes don't fit the schema
+template <typename T>
+bool decodePayload(const std::string& payload, T& message) {
+    sf::Packet packet;
+    packet.append(payload.data(), payload.size());
+    return message.decode(packet);
+}
+
+// Debugging view of any known payload, only used for logging
+inline Json::Value payloadToJson(const std::string& type, const std::string& payload) {
+    if (type == "info") {
+        InfoMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "ping") {
+        PingMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "pong") {
+        PongMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "requestConnections") {
+        RequestConnectionsMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "responseConnections") {
+        ResponseConnectionsMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "optimizeRoute") {
+        OptimizeRouteMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "rpcRequest") {
+        RpcRequestMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "rpcResponse") {
+        RpcResponseMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "subscriptions") {
+        SubscriptionsMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "publish") {
+        PublishMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "test") {
+        TestMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "start") {
+        StartMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "ready") {
+        ReadyMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "playerKeyframe") {
+        PlayerKeyframeMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "playerDelta") {
+        PlayerDeltaMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "playerAck") {
+        PlayerAckMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "lockstepInput") {
+        LockstepInputMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "checksum") {
+        ChecksumMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "resyncRequest") {
+        ResyncRequestMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "resyncState") {
+        ResyncStateMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "interest") {
+        InterestMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    if (type == "benchmark") {
+        BenchmarkMessage message;
+        if (decodePayload(payload, message)) {
+            return message.toJson();
+        }
+    }
+    Json::Value unknown;
+    unknown["bytes"] = static_cast<Json::UInt>(payload.size());
+    return unknown;
+}
+
+// Every wire type declared in the schema
+inline std::vector<std::string> knownMessageTypes() {
+    std::vector<std::string> types;
+    types.push_back("info");
+    types.push_back("ping");
+    types.push_back("pong");
+    types.push_back("requestConnections");
+    types.push_back("responseConnections");
+    types.push_back("optimizeRoute");
+    types.push_back("rpcRequest");
+    types.push_back("rpcResponse");
+    types.push_back("subscriptions");
+    types.push_back("publish");
+    types.push_back("test");
+    types.push_back("start");
+    types.push_back("ready");
+    types.push_back("playerKeyframe");
+    types.push_back("playerDelta");
+    types.push_back("playerAck");
+    types.push_back("lockstepInput");
+    types.push_back("checksum");
+    types.push_back("resyncRequest");
+    types.push_back("resyncState");
+    types.push_back("interest");
+    types.push_back("benchmark");
+    return types;
+}
+
+#endif // __MESSAGES_H__
@@ -0,0 +1,139 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <functional>
+
+Histogram::Histogram(): total(0), valueSum(0) {
+    clear();
+}
+
+void Histogram::clear() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    valueSum.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::record(sf::Uint64 value) {
+    buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    valueSum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (int index = 0; index < kHistogramBuckets; index++) {
+        buckets[index].fetch_add(other.bucket(index), std::memory_order_relaxed);
+    }
+    total.fetch_add(other.count(), std::memory_order_relaxed);
+    valueSum.fetch_add(other.sum(), std::memory_order_relaxed);
+}
+
+sf::Uint64 Histogram::percentile(double fraction) const {
+    sf::Uint64 target = static_cast<sf::Uint64>(fraction * static_cast<double>(count()));
+    sf::Uint64 seen = 0;
+    for (int index = 0; index < kHistogramBuckets; index++) {
+        seen += bucket(index);
+        if (seen > target) {
+            return bucketLowerBound(index);
+        }
+    }
+    return bucketLowerBound(kHistogramBuckets - 1);
+}
+
+int Histogram::bucketFor(sf::Uint64 value) {
+    // Small values get a bucket each, after that the top bit picks the power of two and the
+    // next three bits the step within it
+    if (value < kHistogramSubBuckets) {
+        return static_cast<int>(value);
+    }
+
+    int top = 63;
+    while (!(value >> top)) {
+        top--;
+    }
+    int index = (top - 2) * kHistogramSubBuckets + static_cast<int>((value >> (top - 3)) & (kHistogramSubBuckets - 1));
+    return std::min(index, kHistogramBuckets - 1);
+}
+
+sf::Uint64 Histogram::bucketLowerBound(int index) {
+    if (index < kHistogramSubBuckets) {
+        return static_cast<sf::Uint64>(index);
+    }
+
+    int top = index / kHistogramSubBuckets + 2;
+    return static_cast<sf::Uint64>(kHistogramSubBuckets + index % kHistogramSubBuckets) << (top - 3);
+}
+
+MetricsRegistry::MetricsRegistry() {
+    for (auto& slot : slots) {
+        slot.store(nullptr);
+    }
+}
+
+MetricsRegistry::~MetricsRegistry() {
+    for (auto& slot : slots) {
+        delete slot.load();
+    }
+}
+
+Counter& MetricsRegistry::counter(const std::string& name) {
+    Metric* metric = find(name, kCounterMetric);
+    return metric ? metric->counter : overflowCounter;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name) {
+    Metric* metric = find(name, kHistogramMetric);
+    return metric ? *metric->histogram : overflowHistogram;
+}
+
+Metric* MetricsRegistry::find(const std::string& name, MetricKind kind) {
+    std::size_t start = std::hash<std::string>()(name) % kMetricSlots;
+    for (std::size_t probe = 0; probe < kMetricSlots; probe++) {
+        std::atomic<Metric*>& slot = slots[(start + probe) % kMetricSlots];
+        Metric* metric = slot.load(std::memory_order_acquire);
+
+        if (!metric) {
+            // Claim the empty slot, if someone beat us to it look at what they put there
+            std::unique_ptr<Metric> created(new Metric);
+            created->name = name;
+            created->kind = kind;
+            if (kind == kHistogramMetric) {
+                created->histogram = std::unique_ptr<Histogram>(new Histogram);
+            }
+
+            Metric* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, created.get(), std::memory_order_acq_rel)) {
+                return created.release();
+            }
+            metric = expected;
+        }
+
+        if (metric->name == name) {
+            return metric->kind == kind ? metric : nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+std::vector<const Metric*> MetricsRegistry::list() const {
+    std::vector<const Metric*> metrics;
+    for (auto& slot : slots) {
+        const Metric* metric = slot.load(std::memory_order_acquire);
+        if (metric) {
+            metrics.push_back(metric);
+        }
+    }
+
+    std::sort(metrics.begin(), metrics.end(), [](const Metric* a, const Metric* b) { return a->name < b->name; });
+    return metrics;
+}
+
+std::string MetricsRegistry::label(const std::string& name, const std::string& key, const std::string& value) {
+    std::string pair = key + "=\"" + value + "\"";
+    if (!name.empty() && name[name.size() - 1] == '}') {
+        return name.substr(0, name.size() - 1) + "," + pair + "}";
+    }
+    return name + "{" + pair + "}";
+}
@@ -0,0 +1,90 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+#include <SFML/Config.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+const std::size_t kMetricSlots = 4096; // Most distinct metrics one registry can hold
+const int kHistogramSubBuckets = 8; // Linear steps within each power of two, so a bucket is never more than 12.5% wide
+const int kHistogramBuckets = 38 * kHistogramSubBuckets; // Covers values up to 2^40, anything bigger lands in the last bucket
+
+class Counter {
+public:
+    Counter(): value(0) {}
+    void add(sf::Uint64 amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    sf::Uint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    Counter(const Counter&);
+    std::atomic<sf::Uint64> value;
+};
+
+// Log-linear histogram, recording is one relaxed increment per bucket, count and sum
+class Histogram {
+public:
+    Histogram();
+    void record(sf::Uint64 value);
+    void merge(const Histogram& other);
+    void clear(); // Each field goes to zero on its own, a concurrent record may straddle it
+
+    sf::Uint64 count() const { return total.load(std::memory_order_relaxed); }
+    sf::Uint64 sum() const { return valueSum.load(std::memory_order_relaxed); }
+    sf::Uint64 bucket(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Lower edge of the bucket holding the given fraction of values, 0.99 for p99
+    sf::Uint64 percentile(double fraction) const;
+
+    static int bucketFor(sf::Uint64 value);
+    static sf::Uint64 bucketLowerBound(int index);
+
+private:
+    Histogram(const Histogram&);
+    std::atomic<sf::Uint64> buckets[kHistogramBuckets];
+    std::atomic<sf::Uint64> total;
+    std::atomic<sf::Uint64> valueSum;
+};
+
+enum MetricKind {
+    kCounterMetric,
+    kHistogramMetric
+};
+
+struct Metric {
+    std::string name; // Prometheus style, labels included: mesh_frames_out_total{peer="bob"}
+    MetricKind kind;
+    Counter counter;
+    std::unique_ptr<Histogram> histogram;
+};
+
+// Metrics are found by name in a fixed open addressed table. New ones are claimed with a
+// compare and swap and never removed, so lookups never lock and references stay valid for the
+// registry's lifetime. Hot paths can hold on to what counter() and histogram() return.
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    Counter& counter(const std::string& name);
+    Histogram& histogram(const std::string& name);
+
+    // Every metric registered so far, sorted by name
+    std::vector<const Metric*> list() const;
+
+    // Add key="value" to the labels on a name
+    static std::string label(const std::string& name, const std::string& key, const std::string& value);
+
+private:
+    MetricsRegistry(const MetricsRegistry&);
+    Metric* find(const std::string& name, MetricKind kind);
+
+    std::atomic<Metric*> slots[kMetricSlots];
+
+    // Where metrics go once the table is full or a name is reused with another kind
+    Counter overflowCounter;
+    Histogram overflowHistogram;
+};
+
+#endif // __METRICS_H__
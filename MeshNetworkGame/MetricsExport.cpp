@@ -0,0 +1,283 @@
+#include "MetricsExport.h"
+#include "Logging.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+void writeVarint(std::string& output, sf::Uint64 value) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+// Counters only go up, but a histogram read mid-record can briefly look ahead of itself
+sf::Uint64 delta(sf::Uint64 current, sf::Uint64 last) {
+    return current > last ? current - last : 0;
+}
+
+sf::Uint64 nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string numbered(const std::string& filename, int generation) {
+    std::stringstream name;
+    name << filename << "." << generation;
+    return name.str();
+}
+
+// Prometheus wants the family name on its own for TYPE lines and extra labels merged in
+std::string family(const std::string& name) {
+    return name.substr(0, name.find('{'));
+}
+
+std::string withSuffix(const std::string& name, const std::string& suffix) {
+    std::size_t labels = name.find('{');
+    if (labels == std::string::npos) {
+        return name + suffix;
+    }
+    return name.substr(0, labels) + suffix + name.substr(labels);
+}
+}
+
+MetricsExporter::MetricsExporter(const MetricsRegistry& _registry): registry(_registry), format(kMetricsBinary), interval(kDefaultExportInterval), running(false), written(0), lastTimestamp(0) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::parseFormat(std::string name, MetricsFormat& format) {
+    if (name == "binary") {
+        format = kMetricsBinary;
+    } else if (name == "prometheus") {
+        format = kMetricsPrometheus;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool MetricsExporter::start(std::string _filename, MetricsFormat _format, unsigned int _interval) {
+    stop();
+
+    filename = _filename;
+    format = _format;
+    interval = _interval ? _interval : kDefaultExportInterval;
+
+    if (format == kMetricsBinary && !openBinary()) {
+        LOG(kLogError, kLogMesh) << "Unable to open " << filename << " for metrics" << std::endl;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&MetricsExporter::run, this);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+    thread.join();
+
+    // One last snapshot so the file ends with the final values
+    snapshot();
+    file.close();
+}
+
+bool MetricsExporter::isRunning() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+}
+
+void MetricsExporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        lock.unlock();
+        snapshot();
+        lock.lock();
+
+        wake.wait_for(lock, std::chrono::milliseconds(interval), [this]() { return !running; });
+    }
+}
+
+void MetricsExporter::snapshot() {
+    sf::Uint64 timestamp = nowNanoseconds();
+    std::vector<const Metric*> metrics = registry.list();
+
+    if (format == kMetricsBinary) {
+        writeBinary(timestamp, metrics);
+    } else {
+        writePrometheus(timestamp, metrics);
+    }
+}
+
+bool MetricsExporter::openBinary() {
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    std::string header(kMetricsMagic, sizeof(kMetricsMagic));
+    writeVarint(header, kMetricsVersion);
+    file.write(header.data(), header.size());
+
+    written = header.size();
+    lastTimestamp = 0;
+    indices.clear();
+    columns.clear();
+    previous.clear();
+    return static_cast<bool>(file.flush());
+}
+
+void MetricsExporter::rotate() {
+    file.close();
+
+    std::remove(numbered(filename, kMetricsRotateFiles).c_str());
+    for (int generation = kMetricsRotateFiles - 1; generation >= 1; generation--) {
+        std::rename(numbered(filename, generation).c_str(), numbered(filename, generation + 1).c_str());
+    }
+    std::rename(filename.c_str(), numbered(filename, 1).c_str());
+
+    if (!openBinary()) {
+        LOG(kLogError, kLogMesh) << "Unable to reopen " << filename << " for metrics" << std::endl;
+    }
+}
+
+void MetricsExporter::writeBinary(sf::Uint64 timestamp, const std::vector<const Metric*>& metrics) {
+    if (written >= kMetricsRotateBytes) {
+        rotate();
+    }
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string record;
+
+    // Name anything we haven't seen in this file yet
+    for (auto metric : metrics) {
+        if (indices.count(metric)) {
+            continue;
+        }
+        indices[metric] = columns.size();
+        columns.push_back(metric);
+        previous.push_back(std::vector<sf::Uint64>(metric->kind == kCounterMetric ? 1 : 2 + kHistogramBuckets, 0));
+
+        record.push_back(static_cast<char>(kMetricsName));
+        writeVarint(record, indices[metric]);
+        record.push_back(static_cast<char>(metric->kind));
+        writeVarint(record, metric->name.size());
+        record += metric->name;
+    }
+
+    record.push_back(static_cast<char>(kMetricsSnapshot));
+    writeVarint(record, delta(timestamp, lastTimestamp));
+    writeVarint(record, columns.size());
+    lastTimestamp = timestamp;
+
+    // Column by column so similar numbers sit next to each other
+    for (std::size_t index = 0; index < columns.size(); index++) {
+        if (columns[index]->kind == kCounterMetric) {
+            sf::Uint64 value = columns[index]->counter.get();
+            writeVarint(record, delta(value, previous[index][0]));
+            previous[index][0] = value;
+        }
+    }
+    for (std::size_t index = 0; index < columns.size(); index++) {
+        if (columns[index]->kind == kHistogramMetric) {
+            sf::Uint64 count = columns[index]->histogram->count();
+            writeVarint(record, delta(count, previous[index][0]));
+            previous[index][0] = count;
+        }
+    }
+    for (std::size_t index = 0; index < columns.size(); index++) {
+        if (columns[index]->kind == kHistogramMetric) {
+            sf::Uint64 sum = columns[index]->histogram->sum();
+            writeVarint(record, delta(sum, previous[index][1]));
+            previous[index][1] = sum;
+        }
+    }
+    for (std::size_t index = 0; index < columns.size(); index++) {
+        if (columns[index]->kind != kHistogramMetric) {
+            continue;
+        }
+
+        std::string changes;
+        sf::Uint64 changed = 0;
+        int lastBucket = 0;
+        for (int bucket = 0; bucket < kHistogramBuckets; bucket++) {
+            sf::Uint64 value = columns[index]->histogram->bucket(bucket);
+            sf::Uint64& last = previous[index][2 + bucket];
+            if (value > last) {
+                writeVarint(changes, bucket - lastBucket);
+                writeVarint(changes, value - last);
+                last = value;
+                lastBucket = bucket;
+                changed++;
+            }
+        }
+        writeVarint(record, changed);
+        record += changes;
+    }
+
+    file.write(record.data(), record.size());
+    file.flush();
+    written += record.size();
+}
+
+void MetricsExporter::writePrometheus(sf::Uint64 timestamp, const std::vector<const Metric*>& metrics) {
+    // The exposition format counts in milliseconds
+    sf::Uint64 milliseconds = timestamp / 1000000;
+    std::stringstream text;
+    std::string lastFamily;
+
+    for (auto metric : metrics) {
+        if (family(metric->name) != lastFamily) {
+            lastFamily = family(metric->name);
+            text << "# TYPE " << lastFamily << (metric->kind == kCounterMetric ? " counter" : " histogram") << std::endl;
+        }
+
+        if (metric->kind == kCounterMetric) {
+            text << metric->name << " " << metric->counter.get() << " " << milliseconds << std::endl;
+            continue;
+        }
+
+        // Buckets are cumulative and labelled by the largest value they hold
+        const Histogram& histogram = *metric->histogram;
+        sf::Uint64 cumulative = 0;
+        for (int bucket = 0; bucket < kHistogramBuckets - 1; bucket++) {
+            if (!histogram.bucket(bucket)) {
+                continue;
+            }
+            cumulative += histogram.bucket(bucket);
+            std::stringstream edge;
+            edge << Histogram::bucketLowerBound(bucket + 1) - 1;
+            text << MetricsRegistry::label(withSuffix(metric->name, "_bucket"), "le", edge.str()) << " " << cumulative << " " << milliseconds << std::endl;
+        }
+        text << MetricsRegistry::label(withSuffix(metric->name, "_bucket"), "le", "+Inf") << " " << histogram.count() << " " << milliseconds << std::endl;
+        text << withSuffix(metric->name, "_sum") << " " << histogram.sum() << " " << milliseconds << std::endl;
+        text << withSuffix(metric->name, "_count") << " " << histogram.count() << " " << milliseconds << std::endl;
+    }
+
+    // Write beside the real file and swap it in so a scraper never sees half a snapshot
+    std::string temporary = filename + ".tmp";
+    std::ofstream output(temporary, std::ios::trunc);
+    if (!output) {
+        LOG(kLogError, kLogMesh) << "Unable to write metrics to " << temporary << std::endl;
+        return;
+    }
+    output << text.str();
+    output.close();
+
+    std::remove(filename.c_str());
+    std::rename(temporary.c_str(), filename.c_str());
+}
@@ -0,0 +1,80 @@
+#ifndef __METRICSEXPORT_H__
+#define __METRICSEXPORT_H__
+#include <SFML/Config.hpp>
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+const char kMetricsMagic[4] = { 'M', 'N', 'G', 'M' };
+const sf::Uint32 kMetricsVersion = 1;
+const unsigned int kDefaultExportInterval = 1000; // Take a snapshot every x ms
+const std::size_t kMetricsRotateBytes = 8 * 1024 * 1024; // Start a new binary file past this size
+const int kMetricsRotateFiles = 4; // Keep this many old files around as name.1, name.2, ...
+
+enum MetricsFormat {
+    kMetricsBinary,
+    kMetricsPrometheus
+};
+
+// Binary layout: magic and version, then records of u8 kind followed by
+//     kMetricsName: varint index, u8 MetricKind, varint length, name
+//     kMetricsSnapshot: varint nanoseconds since the previous snapshot, varint metrics known, then
+//         one column each of counter deltas, histogram count deltas and histogram sum deltas, and
+//         per histogram a varint number of changed buckets followed by (index gap, delta) pairs
+// Metrics are numbered in the order they first show up. Every file starts over from zero so it
+// can be read without the ones before it.
+enum MetricsRecord {
+    kMetricsName = 1,
+    kMetricsSnapshot
+};
+
+// Snapshots a registry from a background thread. The Prometheus format rewrites the whole file
+// each time, the binary one appends deltas and rotates.
+class MetricsExporter {
+public:
+    MetricsExporter(const MetricsRegistry& registry);
+    ~MetricsExporter();
+
+    bool start(std::string filename, MetricsFormat format, unsigned int interval = kDefaultExportInterval);
+    void stop();
+    bool isRunning();
+
+    static bool parseFormat(std::string name, MetricsFormat& format);
+
+private:
+    MetricsExporter(const MetricsExporter&);
+
+    void run();
+    void snapshot();
+    void writeBinary(sf::Uint64 timestamp, const std::vector<const Metric*>& metrics);
+    void writePrometheus(sf::Uint64 timestamp, const std::vector<const Metric*>& metrics);
+    bool openBinary();
+    void rotate();
+
+    const MetricsRegistry& registry;
+    std::string filename;
+    MetricsFormat format;
+    unsigned int interval;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+
+    // Binary state, reset whenever a new file is started
+    std::ofstream file;
+    std::size_t written;
+    sf::Uint64 lastTimestamp;
+    std::map<const Metric*, std::size_t> indices;
+    std::vector<const Metric*> columns; // Metrics by index
+    std::vector<std::vector<sf::Uint64>> previous; // Last values written, counter or count, sum, buckets
+};
+
+#endif // __METRICSEXPORT_H__
@@ -0,0 +1,79 @@
+#include "OccupancyGrid.h"
+
+#include <algorithm>
+
+void OccupancyGrid::place(const std::string& player, unsigned int x, unsigned int y) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sf::Uint64 cell = key(x, y);
+
+    auto position = positions.find(player);
+    if (position != positions.end()) {
+        if (position->second == cell) {
+            return;
+        }
+
+        // Pull the player out of the cell they were in
+        auto& previous = cells[position->second];
+        previous.erase(std::remove(previous.begin(), previous.end(), player), previous.end());
+        if (previous.empty()) {
+            cells.erase(position->second);
+        }
+    }
+
+    positions[player] = cell;
+    cells[cell].push_back(player);
+}
+
+void OccupancyGrid::remove(const std::string& player) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto position = positions.find(player);
+    if (position == positions.end()) {
+        return;
+    }
+
+    auto& cell = cells[position->second];
+    cell.erase(std::remove(cell.begin(), cell.end(), player), cell.end());
+    if (cell.empty()) {
+        cells.erase(position->second);
+    }
+    positions.erase(position);
+}
+
+void OccupancyGrid::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cells.clear();
+    positions.clear();
+}
+
+bool OccupancyGrid::isOccupied(unsigned int x, unsigned int y) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cells.find(key(x, y)) != cells.end();
+}
+
+bool OccupancyGrid::firstNeighbour(unsigned int x, unsigned int y, const std::string& except, std::string& neighbour) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool found = false;
+
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dy == 0) {
+                continue;
+            }
+
+            // Unsigned wrap at the board edge lands on a cell nobody can stand in
+            auto cell = cells.find(key(x + dx, y + dy));
+            if (cell == cells.end()) {
+                continue;
+            }
+
+            for (auto& player : cell->second) {
+                if (player != except && (!found || player < neighbour)) {
+                    neighbour = player;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,31 @@
+#ifndef __OCCUPANCY_GRID_H__
+#define __OCCUPANCY_GRID_H__
+#include <SFML/Config.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Spatial hash from tile to the players standing on it, kept up to date as players move.
+// Collision is a single cell lookup and neighbour queries only touch the eight cells around
+// a tile, so both stay constant time no matter how many players are on the board.
+class OccupancyGrid {
+public:
+    void place(const std::string& player, unsigned int x, unsigned int y);
+    void remove(const std::string& player);
+    void clear();
+
+    bool isOccupied(unsigned int x, unsigned int y) const;
+    // First player (by name) in the eight tiles around x, y other than the one asking
+    bool firstNeighbour(unsigned int x, unsigned int y, const std::string& except, std::string& neighbour) const;
+
+private:
+    static sf::Uint64 key(unsigned int x, unsigned int y) { return (static_cast<sf::Uint64>(x) << 32) | y; }
+
+    std::unordered_map<sf::Uint64, std::vector<std::string>> cells;
+    std::unordered_map<std::string, sf::Uint64> positions;
+    mutable std::mutex mutex;
+};
+
+#endif // __OCCUPANCY_GRID_H__
@@ -0,0 +1,89 @@
+#include "Pathfinding.h"
+
+#include <algorithm>
+#include <deque>
+
+DistanceField::DistanceField(Board& board, unsigned int targetX, unsigned int targetY):
+    left(static_cast<int>(targetX) - kFieldRadius), top(static_cast<int>(targetY) - kFieldRadius), steps(kSide * kSide, kUnreachable) {
+    const int neighbourX[] = { 0, -1, 0, 1 };
+    const int neighbourY[] = { -1, 0, 1, 0 };
+
+    std::deque<int> frontier;
+    int start = kFieldRadius * kSide + kFieldRadius;
+    steps[start] = 0;
+    frontier.push_back(start);
+
+    while (!frontier.empty()) {
+        int tile = frontier.front();
+        frontier.pop_front();
+
+        // Anything further than a byte can count is as good as unreachable
+        if (steps[tile] + 1 >= kUnreachable) {
+            continue;
+        }
+        int x = tile % kSide;
+        int y = tile / kSide;
+
+        for (int i = 0; i < 4; i++) {
+            int nextX = x + neighbourX[i];
+            int nextY = y + neighbourY[i];
+            if (nextX < 0 || nextY < 0 || nextX >= kSide || nextY >= kSide) {
+                continue;
+            }
+
+            int next = nextY * kSide + nextX;
+            int boardX = left + nextX;
+            int boardY = top + nextY;
+            if (steps[next] != kUnreachable || boardX < 0 || boardY < 0 || board.isWall(boardX, boardY)) {
+                continue;
+            }
+
+            steps[next] = static_cast<sf::Uint8>(steps[tile] + 1);
+            frontier.push_back(next);
+        }
+    }
+}
+
+bool DistanceField::distance(unsigned int x, unsigned int y, unsigned int& walk) const {
+    int fieldX = static_cast<int>(x) - left;
+    int fieldY = static_cast<int>(y) - top;
+    if (fieldX < 0 || fieldY < 0 || fieldX >= kSide || fieldY >= kSide) {
+        return false;
+    }
+
+    walk = steps[fieldY * kSide + fieldX];
+    return true;
+}
+
+Pathfinder::Pathfinder() {
+}
+
+bool Pathfinder::open(std::string filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    fields.clear();
+    recentlyUsed.clear();
+    return board.open(filename);
+}
+
+std::shared_ptr<const DistanceField> Pathfinder::fieldTo(unsigned int x, unsigned int y) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sf::Uint64 target = key(x, y);
+
+    auto field = fields.find(target);
+    if (field != fields.end()) {
+        recentlyUsed.remove(target);
+        recentlyUsed.push_front(target);
+        return field->second;
+    }
+
+    if (fields.size() >= kFieldCacheSize) {
+        fields.erase(recentlyUsed.back());
+        recentlyUsed.pop_back();
+    }
+
+    // Bots holding on to an evicted field keep it alive until they're done with it
+    std::shared_ptr<const DistanceField> created(new DistanceField(board, x, y));
+    fields[target] = created;
+    recentlyUsed.push_front(target);
+    return created;
+}
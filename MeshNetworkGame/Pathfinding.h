@@ -0,0 +1,55 @@
+#ifndef __PATHFINDING_H__
+#define __PATHFINDING_H__
+#include <SFML/Config.hpp>
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Board.h"
+
+const int kFieldRadius = 48; // Fields cover x tiles in every direction around their target
+const std::size_t kFieldCacheSize = 64; // Distance fields kept around before the oldest is dropped
+const sf::Uint8 kUnreachable = 255;
+
+// Walking distance from every tile near a target to that target, found once by a breadth
+// first search over the walls. Beyond kFieldRadius callers fall back to straight line distance.
+class DistanceField {
+public:
+    DistanceField(Board& board, unsigned int targetX, unsigned int targetY);
+
+    // False when the tile is outside the field
+    bool distance(unsigned int x, unsigned int y, unsigned int& walk) const;
+
+private:
+    static const int kSide = 2 * kFieldRadius + 1;
+
+    int left;
+    int top;
+    std::vector<sf::Uint8> steps; // kSide * kSide, row major, kUnreachable when walled off
+};
+
+// Shares distance fields between every bot that reads from it. Fields depend only on the walls,
+// so bots chasing the same player reuse one search until that player moves to a new tile.
+// Other players are moving obstacles and are stepped around locally instead of baked in.
+class Pathfinder {
+public:
+    Pathfinder();
+    bool open(std::string filename);
+
+    std::shared_ptr<const DistanceField> fieldTo(unsigned int x, unsigned int y);
+
+private:
+    Pathfinder(const Pathfinder&);
+    static sf::Uint64 key(unsigned int x, unsigned int y) { return (static_cast<sf::Uint64>(x) << 32) | y; }
+
+    Board board; // Our own copy, loading chunks isn't safe alongside the game drawing them
+    std::unordered_map<sf::Uint64, std::shared_ptr<const DistanceField>> fields;
+    std::list<sf::Uint64> recentlyUsed; // Front is the field used most recently
+    std::mutex mutex;
+};
+
+#endif // __PATHFINDING_H__
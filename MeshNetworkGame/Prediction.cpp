@@ -0,0 +1,73 @@
+#include "Prediction.h"
+#include "Game.h"
+
+#include <algorithm>
+
+Predictor::Predictor(): confirmedX(0), confirmedY(0) {
+}
+
+void Predictor::reset(unsigned int x, unsigned int y) {
+    confirmedX = x;
+    confirmedY = y;
+    pending.clear();
+}
+
+void Predictor::record(sf::Keyboard::Key key, sf::Uint32 snapshot) {
+    Input input;
+    input.snapshot = snapshot;
+    input.key = key;
+    pending.push_back(input);
+
+    // A peer that never acks would otherwise make us hold on to everything
+    if (pending.size() > kMaxPendingInputs) {
+        pending.pop_front();
+    }
+}
+
+void Predictor::confirm(sf::Uint32 snapshot, unsigned int x, unsigned int y) {
+    confirmedX = x;
+    confirmedY = y;
+    while (!pending.empty() && pending.front().snapshot <= snapshot) {
+        pending.pop_front();
+    }
+}
+
+void InterpolationBuffer::push(sf::Int64 arrival, sf::Vector2f position) {
+    Sample sample;
+    sample.time = arrival;
+    sample.position = position;
+    samples.push_back(sample);
+
+    if (samples.size() > kInterpolationSamples) {
+        samples.pop_front();
+    }
+}
+
+bool InterpolationBuffer::sample(sf::Int64 renderTime, sf::Vector2f& position) {
+    if (samples.empty()) {
+        return false;
+    }
+
+    // Only the newest sample at or before renderTime is still needed
+    while (samples.size() > 1 && samples[1].time <= renderTime) {
+        samples.pop_front();
+    }
+
+    const Sample& from = samples.front();
+    if (samples.size() == 1 || renderTime <= from.time) {
+        position = from.position;
+        return true;
+    }
+
+    const Sample& to = samples[1];
+    float alpha = static_cast<float>(renderTime - from.time) / static_cast<float>(to.time - from.time);
+    position = from.position + (to.position - from.position) * alpha;
+    return true;
+}
+
+sf::Int64 InterpolationBuffer::delayFor(unsigned long long routePing) {
+    // Two replication intervals covers one lost or late update, longer routes jitter more on top of that
+    sf::Int64 interval = 1000000 * kTicksPerReplication / kTickRate;
+    sf::Int64 delay = 2 * interval + static_cast<sf::Int64>(routePing) * 1000 / 4;
+    return std::min(delay, kMaxInterpolationDelay);
+}
@@ -0,0 +1,58 @@
+#ifndef __PREDICTION_H__
+#define __PREDICTION_H__
+#include <SFML/System.hpp>
+#include <SFML/Window/Keyboard.hpp>
+
+#include <deque>
+
+const unsigned int kMaxPendingInputs = 256; // Unconfirmed inputs kept for replay before we give up on them
+const unsigned int kInterpolationSamples = 32; // Remote positions buffered per player
+const sf::Int64 kMaxInterpolationDelay = 400000; // Never show remote players more than x us in the past
+
+// Our own moves are applied the moment they're pressed. Each one is tagged with the replication
+// snapshot that first carries it, which is also its sequence number on the wire, and kept until
+// every peer has acked that snapshot. If a peer turns out to have moved into our tile we rewind
+// to the last position everyone agreed on and replay the inputs they haven't seen yet.
+class Predictor {
+public:
+    struct Input {
+        sf::Uint32 snapshot;
+        sf::Keyboard::Key key;
+    };
+
+    Predictor();
+
+    void reset(unsigned int x, unsigned int y);
+    void record(sf::Keyboard::Key key, sf::Uint32 snapshot);
+    void confirm(sf::Uint32 snapshot, unsigned int x, unsigned int y);
+
+    unsigned int getConfirmedX() const { return confirmedX; }
+    unsigned int getConfirmedY() const { return confirmedY; }
+    const std::deque<Input>& pendingInputs() const { return pending; }
+
+private:
+    unsigned int confirmedX;
+    unsigned int confirmedY;
+    std::deque<Input> pending;
+};
+
+// Remote players are drawn a little in the past, between the two updates that straddle that
+// moment, so late or bunched up updates over long routes don't make them stutter
+class InterpolationBuffer {
+public:
+    void push(sf::Int64 arrival, sf::Vector2f position);
+    bool sample(sf::Int64 renderTime, sf::Vector2f& position);
+
+    // How far behind to draw a player whose route has the given round trip
+    static sf::Int64 delayFor(unsigned long long routePing);
+
+private:
+    struct Sample {
+        sf::Int64 time;
+        sf::Vector2f position;
+    };
+
+    std::deque<Sample> samples;
+};
+
+#endif // __PREDICTION_H__
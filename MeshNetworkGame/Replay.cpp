@@ -0,0 +1,247 @@
+#include "Replay.h"
+
+#include <cstring>
+
+namespace {
+void writeVarint(std::string& output, sf::Uint64 value) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+bool readVarint(const unsigned char* data, std::size_t size, std::size_t& offset, sf::Uint64& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= size) {
+            return false;
+        }
+        unsigned char byte = data[offset++];
+        value |= static_cast<sf::Uint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+ReplayWriter::ReplayWriter(): lastTick(0) {
+}
+
+bool ReplayWriter::open(std::string filename, std::string playerName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    std::string header(kReplayMagic, sizeof(kReplayMagic));
+    writeVarint(header, kReplayVersion);
+    writeVarint(header, playerName.size());
+    header += playerName;
+    file.write(header.data(), header.size());
+
+    lastTick = 0;
+    names.clear();
+    return static_cast<bool>(file.flush());
+}
+
+void ReplayWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.close();
+}
+
+bool ReplayWriter::isOpen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return file.is_open();
+}
+
+void ReplayWriter::recordMessage(sf::Uint64 tick, const std::string& sender, const std::string& type, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) {
+        return;
+    }
+
+    sf::Uint32 senderIndex = nameIndex(sender);
+    sf::Uint32 typeIndex = nameIndex(type);
+    std::string body;
+    writeVarint(body, senderIndex);
+    writeVarint(body, typeIndex);
+    body += payload;
+    write(kReplayMessage, tick, body);
+}
+
+void ReplayWriter::recordInput(sf::Uint64 tick, sf::Uint8 key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_open()) {
+        write(kReplayInput, tick, std::string(1, static_cast<char>(key)));
+    }
+}
+
+void ReplayWriter::recordSnapshot(sf::Uint64 tick, const std::string& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_open()) {
+        write(kReplaySnapshot, tick, state);
+    }
+}
+
+sf::Uint32 ReplayWriter::nameIndex(const std::string& name) {
+    auto known = names.find(name);
+    if (known != names.end()) {
+        return known->second;
+    }
+
+    sf::Uint32 index = static_cast<sf::Uint32>(names.size());
+    names[name] = index;
+    write(kReplayName, lastTick, name);
+    return index;
+}
+
+void ReplayWriter::write(ReplayRecord kind, sf::Uint64 tick, const std::string& body) {
+    // Messages can come in from the network while a tick is being recorded, never go backwards
+    if (tick < lastTick) {
+        tick = lastTick;
+    }
+
+    std::string record(1, static_cast<char>(kind));
+    writeVarint(record, tick - lastTick);
+    writeVarint(record, body.size());
+    record += body;
+    file.write(record.data(), record.size());
+    file.flush();
+    lastTick = tick;
+}
+
+ReplayReader::ReplayReader(): firstRecord(0), position(0), tick(0), indexed(false) {
+}
+
+bool ReplayReader::open(std::string filename) {
+    if (!map.open(filename) || map.size() < sizeof(kReplayMagic) || std::memcmp(map.data(), kReplayMagic, sizeof(kReplayMagic)) != 0) {
+        return false;
+    }
+
+    std::size_t offset = sizeof(kReplayMagic);
+    sf::Uint64 version;
+    sf::Uint64 nameLength;
+    if (!readVarint(map.data(), map.size(), offset, version) || version != kReplayVersion ||
+        !readVarint(map.data(), map.size(), offset, nameLength) || nameLength > map.size() - offset) {
+        return false;
+    }
+
+    playerName.assign(reinterpret_cast<const char*>(map.data()) + offset, static_cast<std::size_t>(nameLength));
+    firstRecord = position = offset + static_cast<std::size_t>(nameLength);
+    tick = 0;
+    names.clear();
+    indexed = false;
+    snapshots.clear();
+    return true;
+}
+
+bool ReplayReader::readHeader(std::size_t offset, sf::Uint64 previousTick, Header& header) const {
+    if (offset >= map.size()) {
+        return false;
+    }
+
+    header.kind = static_cast<ReplayRecord>(map.data()[offset++]);
+    sf::Uint64 delta;
+    sf::Uint64 length;
+    if (!readVarint(map.data(), map.size(), offset, delta) || !readVarint(map.data(), map.size(), offset, length) || length > map.size() - offset) {
+        return false;
+    }
+
+    header.tick = previousTick + delta;
+    header.body = offset;
+    header.length = static_cast<std::size_t>(length);
+    return true;
+}
+
+bool ReplayReader::next(ReplayEvent& event) {
+    Header header;
+    while (readHeader(position, tick, header)) {
+        const char* body = reinterpret_cast<const char*>(map.data()) + header.body;
+        position = header.body + header.length;
+        tick = header.tick;
+
+        if (header.kind == kReplayName) {
+            // Seeking may already have collected every name
+            if (!indexed) {
+                names.push_back(std::string(body, header.length));
+            }
+            continue;
+        }
+
+        event.kind = header.kind;
+        event.tick = header.tick;
+        if (header.kind == kReplayMessage) {
+            std::size_t offset = header.body;
+            sf::Uint64 sender;
+            sf::Uint64 type;
+            if (!readVarint(map.data(), position, offset, sender) || !readVarint(map.data(), position, offset, type) || sender >= names.size() || type >= names.size()) {
+                return false;
+            }
+            event.sender = names[static_cast<std::size_t>(sender)];
+            event.type = names[static_cast<std::size_t>(type)];
+            event.data.assign(reinterpret_cast<const char*>(map.data()) + offset, position - offset);
+        } else if (header.kind == kReplayInput) {
+            if (header.length < 1) {
+                return false;
+            }
+            event.key = static_cast<sf::Uint8>(body[0]);
+        } else if (header.kind == kReplaySnapshot) {
+            event.data.assign(body, header.length);
+        } else {
+            // Something newer than us, skip it
+            continue;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void ReplayReader::index() {
+    // One pass over the headers finds every snapshot and every name, bodies are skipped over
+    names.clear();
+    snapshots.clear();
+
+    std::size_t offset = firstRecord;
+    sf::Uint64 previousTick = 0;
+    Header header;
+    while (readHeader(offset, previousTick, header)) {
+        if (header.kind == kReplayName) {
+            names.push_back(std::string(reinterpret_cast<const char*>(map.data()) + header.body, header.length));
+        } else if (header.kind == kReplaySnapshot) {
+            SnapshotPosition snapshot;
+            snapshot.tick = header.tick;
+            snapshot.previousTick = previousTick;
+            snapshot.offset = offset;
+            snapshots.push_back(snapshot);
+        }
+
+        previousTick = header.tick;
+        offset = header.body + header.length;
+    }
+    indexed = true;
+}
+
+bool ReplayReader::seek(sf::Uint64 target) {
+    if (!indexed) {
+        index();
+    }
+
+    const SnapshotPosition* best = nullptr;
+    for (auto& snapshot : snapshots) {
+        if (snapshot.tick <= target) {
+            best = &snapshot;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+
+    position = best->offset;
+    tick = best->previousTick;
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+#include <SFML/Config.hpp>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+const char kReplayMagic[4] = { 'M', 'N', 'G', 'R' };
+const sf::Uint32 kReplayVersion = 1;
+const unsigned int kReplaySnapshotTicks = 600; // Ticks between snapshots, the granularity of seeking
+
+// A replay is the magic, version and recording player's name, followed by records of
+//     u8 kind, varint ticks since the previous record, varint body length, body
+// Names (senders and message types) are written once as a kReplayName record and referred
+// to by index afterwards, so a message costs a few bytes on top of its payload.
+enum ReplayRecord {
+    kReplayName = 1, // body: the name, it gets the next index
+    kReplayMessage, // body: varint sender index, varint type index, payload
+    kReplayInput, // body: u8 sf::Keyboard::Key
+    kReplaySnapshot // body: whatever the game saved, opaque to the replay
+};
+
+struct ReplayEvent {
+    ReplayRecord kind;
+    sf::Uint64 tick;
+    std::string sender;
+    std::string type;
+    std::string data; // Payload or snapshot
+    sf::Uint8 key;
+};
+
+// Append only, every record is flushed as it's written so a crash loses at most the last one
+class ReplayWriter {
+public:
+    ReplayWriter();
+
+    bool open(std::string filename, std::string playerName);
+    void close();
+    bool isOpen();
+
+    void recordMessage(sf::Uint64 tick, const std::string& sender, const std::string& type, const std::string& payload);
+    void recordInput(sf::Uint64 tick, sf::Uint8 key);
+    void recordSnapshot(sf::Uint64 tick, const std::string& state);
+
+private:
+    ReplayWriter(const ReplayWriter&);
+
+    sf::Uint32 nameIndex(const std::string& name);
+    void write(ReplayRecord kind, sf::Uint64 tick, const std::string& body);
+
+    std::ofstream file;
+    sf::Uint64 lastTick;
+    std::map<std::string, sf::Uint32> names;
+    std::mutex mutex;
+};
+
+// Reads a replay straight out of a memory mapping, skipping over bodies is just pointer math
+class ReplayReader {
+public:
+    ReplayReader();
+
+    bool open(std::string filename);
+    const std::string& getPlayerName() const { return playerName; }
+
+    bool next(ReplayEvent& event);
+
+    // Continue from the last snapshot at or before tick, false if there isn't one
+    bool seek(sf::Uint64 tick);
+
+private:
+    struct Header {
+        ReplayRecord kind;
+        sf::Uint64 tick;
+        std::size_t body;
+        std::size_t length;
+    };
+
+    struct SnapshotPosition {
+        sf::Uint64 tick;
+        sf::Uint64 previousTick;
+        std::size_t offset;
+    };
+
+    bool readHeader(std::size_t offset, sf::Uint64 previousTick, Header& header) const;
+    void index();
+
+    MappedFile map;
+    std::string playerName;
+    std::size_t firstRecord;
+    std::size_t position;
+    sf::Uint64 tick;
+    std::vector<std::string> names;
+    bool indexed; // Every name and snapshot has been found up front
+    std::vector<SnapshotPosition> snapshots;
+};
+
+#endif // __REPLAY_H__
@@ -0,0 +1,195 @@
+#include "Replication.h"
+
+Replicator::Replicator(): tick(0) {
+}
+
+void Replicator::snapshot(const PlayerState& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tick++;
+    history[tick % kReplicationHistory] = state;
+}
+
+bool Replicator::buildUpdate(std::string peer, PlayerKeyframeMessage& keyframe, PlayerDeltaMessage& delta, bool& isKeyframe) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tick == 0) {
+        return false;
+    }
+
+    const PlayerState& current = history[tick % kReplicationHistory];
+    auto base = acked.find(peer);
+
+    if (base != acked.end()) {
+        // The peer already has what we'd send
+        if (base->second.state == current) {
+            return false;
+        }
+
+        int dx = static_cast<int>(current.x) - static_cast<int>(base->second.state.x);
+        int dy = static_cast<int>(current.y) - static_cast<int>(base->second.state.y);
+        if (current.color == base->second.state.color && dx >= -128 && dx <= 127 && dy >= -128 && dy <= 127) {
+            delta.tick = tick;
+            delta.baseTick = base->second.tick;
+            delta.dx = static_cast<sf::Int8>(dx);
+            delta.dy = static_cast<sf::Int8>(dy);
+            isKeyframe = false;
+            return true;
+        }
+    }
+
+    // New peers, desynced peers and changes too big for a delta get the whole state
+    keyframe.tick = tick;
+    keyframe.x = current.x;
+    keyframe.y = current.y;
+    keyframe.color = current.color;
+    isKeyframe = true;
+    return true;
+}
+
+void Replicator::acknowledge(std::string peer, PlayerAckMessage ack) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ack.keyframe) {
+        acked.erase(peer);
+        return;
+    }
+
+    // Only ticks still in our history can become a base
+    if (ack.tick == 0 || ack.tick > tick || tick - ack.tick >= kReplicationHistory) {
+        return;
+    }
+
+    auto base = acked.find(peer);
+    if (base == acked.end() || base->second.tick < ack.tick) {
+        AckedState state;
+        state.tick = ack.tick;
+        state.state = history[ack.tick % kReplicationHistory];
+        acked[peer] = state;
+    }
+}
+
+void Replicator::forgetPeer(std::string peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    acked.erase(peer);
+    received.erase(peer);
+    acks.erase(peer);
+}
+
+sf::Uint32 Replicator::currentTick() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tick;
+}
+
+bool Replicator::ackedByAll(const std::vector<std::string>& peers, sf::Uint32& ackedTick, PlayerState& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tick == 0) {
+        return false;
+    }
+
+    const PlayerState& current = history[tick % kReplicationHistory];
+    ackedTick = tick;
+    state = current;
+    for (auto& peer : peers) {
+        auto base = acked.find(peer);
+        if (base == acked.end()) {
+            return false;
+        }
+
+        // We stop sending to peers that already match us, so an old ack of the current state is as good as a new one
+        if (base->second.state != current && base->second.tick < ackedTick) {
+            ackedTick = base->second.tick;
+            state = base->second.state;
+        }
+    }
+
+    return true;
+}
+
+bool Replicator::applyKeyframe(std::string sender, PlayerKeyframeMessage keyframe, PlayerState& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& states = received[sender];
+    if (!states.empty() && keyframe.tick <= states.rbegin()->first) {
+        return false;
+    }
+
+    state.x = keyframe.x;
+    state.y = keyframe.y;
+    state.color = keyframe.color;
+    store(sender, keyframe.tick, state);
+    return true;
+}
+
+bool Replicator::applyDelta(std::string sender, PlayerDeltaMessage delta, PlayerState& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& states = received[sender];
+    if (!states.empty() && delta.tick <= states.rbegin()->first) {
+        return false;
+    }
+
+    auto base = states.find(delta.baseTick);
+    if (base == states.end()) {
+        // We've lost the state this delta builds on, ask for a fresh keyframe
+        acks[sender].tick = 0;
+        acks[sender].keyframe = true;
+        return false;
+    }
+
+    state = base->second;
+    state.x = static_cast<sf::Uint16>(state.x + delta.dx);
+    state.y = static_cast<sf::Uint16>(state.y + delta.dy);
+    store(sender, delta.tick, state);
+    return true;
+}
+
+std::map<std::string, PlayerAckMessage> Replicator::takeAcks() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, PlayerAckMessage> pending;
+    pending.swap(acks);
+    return pending;
+}
+
+void Replicator::saveReceived(sf::Packet& packet) {
+    std::lock_guard<std::mutex> lock(mutex);
+    packet << static_cast<sf::Uint32>(received.size());
+    for (auto& sender : received) {
+        packet << sender.first << static_cast<sf::Uint32>(sender.second.size());
+        for (auto& state : sender.second) {
+            packet << state.first << state.second.x << state.second.y << state.second.color;
+        }
+    }
+}
+
+bool Replicator::loadReceived(sf::Packet& packet) {
+    std::lock_guard<std::mutex> lock(mutex);
+    received.clear();
+
+    sf::Uint32 senders;
+    if (!(packet >> senders)) {
+        return false;
+    }
+    for (sf::Uint32 i = 0; i < senders; i++) {
+        std::string sender;
+        sf::Uint32 count;
+        if (!(packet >> sender >> count)) {
+            return false;
+        }
+        for (sf::Uint32 j = 0; j < count; j++) {
+            sf::Uint32 stateTick;
+            PlayerState state;
+            if (!(packet >> stateTick >> state.x >> state.y >> state.color)) {
+                return false;
+            }
+            received[sender][stateTick] = state;
+        }
+    }
+    return true;
+}
+
+void Replicator::store(std::string sender, sf::Uint32 stateTick, const PlayerState& state) {
+    auto& states = received[sender];
+    states[stateTick] = state;
+    while (states.size() > kReplicationHistory) {
+        states.erase(states.begin());
+    }
+
+    acks[sender].tick = stateTick;
+    acks[sender].keyframe = false;
+}
@@ -0,0 +1,65 @@
+#ifndef __REPLICATION_H__
+#define __REPLICATION_H__
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Messages.h"
+
+const unsigned int kReplicationHistory = 64; // Ticks of state kept around to be used as delta bases
+
+// The quantized state of one player, as it travels on the wire
+struct PlayerState {
+    sf::Uint16 x;
+    sf::Uint16 y;
+    sf::Uint8 color;
+
+    PlayerState(): x(0), y(0), color(0) {}
+    bool operator==(const PlayerState& other) const { return x == other.x && y == other.y && color == other.color; }
+    bool operator!=(const PlayerState& other) const { return !(*this == other); }
+};
+
+// Replicates our own player to every peer with deltas against the last state each peer acked,
+// and rebuilds remote players from the keyframes and deltas they send us
+class Replicator {
+public:
+    Replicator();
+
+    // Sending side: snapshot our player once per tick, then ask what each peer still needs
+    void snapshot(const PlayerState& state);
+    bool buildUpdate(std::string peer, PlayerKeyframeMessage& keyframe, PlayerDeltaMessage& delta, bool& isKeyframe);
+    void acknowledge(std::string peer, PlayerAckMessage ack);
+    void forgetPeer(std::string peer);
+    sf::Uint32 currentTick();
+
+    // Newest snapshot every one of these peers is known to have, false until they all have one
+    bool ackedByAll(const std::vector<std::string>& peers, sf::Uint32& ackedTick, PlayerState& state);
+
+    // Receiving side: false when the update was stale or couldn't be applied
+    bool applyKeyframe(std::string sender, PlayerKeyframeMessage keyframe, PlayerState& state);
+    bool applyDelta(std::string sender, PlayerDeltaMessage delta, PlayerState& state);
+    std::map<std::string, PlayerAckMessage> takeAcks();
+
+    // What we've received so far, so a replay can pick deltas up again after seeking
+    void saveReceived(sf::Packet& packet);
+    bool loadReceived(sf::Packet& packet);
+
+private:
+    struct AckedState {
+        sf::Uint32 tick;
+        PlayerState state;
+    };
+
+    sf::Uint32 tick;
+    PlayerState history[kReplicationHistory];
+    std::map<std::string, AckedState> acked; // Missing means the peer needs a keyframe
+
+    std::map<std::string, std::map<sf::Uint32, PlayerState>> received;
+    std::map<std::string, PlayerAckMessage> acks;
+
+    void store(std::string sender, sf::Uint32 stateTick, const PlayerState& state);
+    std::mutex mutex;
+};
+
+#endif // __REPLICATION_H__
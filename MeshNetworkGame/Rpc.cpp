@@ -0,0 +1,160 @@
+#include "Rpc.h"
+
+#include <algorithm>
+
+const char* rpcStatusName(RpcStatus status) {
+    switch (status) {
+    case kRpcOk: return "ok";
+    case kRpcFailed: return "failed";
+    case kRpcUnknownMethod: return "unknown method";
+    case kRpcTimedOut: return "timed out";
+    case kRpcCancelled: return "cancelled";
+    case kRpcUnreachable: return "unreachable";
+    case kRpcDeferred: return "deferred";
+    }
+    return "unknown";
+}
+
+RpcTable::RpcTable(): nextDeadline(std::chrono::steady_clock::time_point::max()), nextId(1) {
+}
+
+sf::Uint32 RpcTable::begin(std::string peer, unsigned int timeout, bool gathering, RpcCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sf::Uint32 id = nextId++;
+    PendingCall& call = pending[id];
+    call.peer = peer;
+    call.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    call.gathering = gathering;
+    call.answered = false;
+    call.callback = callback;
+    nextDeadline = std::min(nextDeadline, call.deadline);
+    return id;
+}
+
+void RpcTable::complete(sf::Uint32 id, const RpcReply& reply) {
+    RpcCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto call = pending.find(id);
+        if (call == pending.end()) {
+            return;
+        }
+
+        callback = call->second.callback;
+        if (call->second.gathering) {
+            call->second.answered = true;
+        } else {
+            pending.erase(call);
+        }
+    }
+
+    // Callbacks may well make calls of their own
+    callback(reply);
+}
+
+bool RpcTable::fail(sf::Uint32 id, RpcStatus status) {
+    std::vector<RpcCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto call = pending.find(id);
+        if (call == pending.end()) {
+            return false;
+        }
+        if (!call->second.answered) {
+            callbacks.push_back(call->second.callback);
+        }
+        pending.erase(call);
+    }
+
+    notify(callbacks, status);
+    return true;
+}
+
+// A gathering call that heard anything just ends, the rest time out
+void RpcTable::expire() {
+    std::vector<RpcCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now < nextDeadline) {
+            return;
+        }
+
+        nextDeadline = std::chrono::steady_clock::time_point::max();
+        for (auto call = pending.begin(); call != pending.end(); ) {
+            if (call->second.deadline <= now) {
+                if (!call->second.answered) {
+                    callbacks.push_back(call->second.callback);
+                }
+                pending.erase(call++);
+            } else {
+                nextDeadline = std::min(nextDeadline, call->second.deadline);
+                ++call;
+            }
+        }
+    }
+
+    notify(callbacks, kRpcTimedOut);
+}
+
+void RpcTable::failPeer(std::string peer) {
+    std::vector<RpcCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto call = pending.begin(); call != pending.end(); ) {
+            if (call->second.peer == peer) {
+                if (!call->second.answered) {
+                    callbacks.push_back(call->second.callback);
+                }
+                pending.erase(call++);
+            } else {
+                ++call;
+            }
+        }
+    }
+
+    notify(callbacks, kRpcUnreachable);
+}
+
+void RpcTable::failAll(RpcStatus status) {
+    std::vector<RpcCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& call : pending) {
+            if (!call.second.answered) {
+                callbacks.push_back(call.second.callback);
+            }
+        }
+        pending.clear();
+    }
+
+    notify(callbacks, status);
+}
+
+std::size_t RpcTable::pendingCalls() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+void RpcTable::serve(std::string method, RpcMethod handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    methods[method] = handler;
+}
+
+bool RpcTable::findMethod(std::string method, RpcMethod& handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = methods.find(method);
+    if (found == methods.end()) {
+        return false;
+    }
+    handler = found->second;
+    return true;
+}
+
+void RpcTable::notify(std::vector<RpcCallback>& callbacks, RpcStatus status) {
+    RpcReply reply;
+    reply.status = status;
+    for (auto& callback : callbacks) {
+        callback(reply);
+    }
+}
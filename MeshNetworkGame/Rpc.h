@@ -0,0 +1,89 @@
+#ifndef __RPC_H__
+#define __RPC_H__
+#include <SFML/Config.hpp>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const unsigned int kRpcTimeout = 5000; // Calls give up after x ms unless given a deadline of their own
+
+enum RpcStatus {
+    kRpcOk,
+    kRpcFailed, // The method couldn't make sense of the request or turned it down
+    kRpcUnknownMethod, // Nobody on the other end serves it
+    kRpcTimedOut,
+    kRpcCancelled,
+    kRpcUnreachable, // No route, or our connection to its first hop dropped. A destination lost further along times out instead.
+    kRpcDeferred // Only from a method: no answer from here, the request was passed on
+};
+
+const char* rpcStatusName(RpcStatus status);
+
+struct RpcRequest {
+    sf::Uint32 id;
+    std::string method;
+    std::string payload;
+    std::vector<std::string> route; // Front is the caller, the reply retraces it
+};
+
+struct RpcReply {
+    RpcStatus status;
+    std::string payload;
+    std::vector<std::string> route; // Front is whoever answered
+};
+
+// Runs once per call, or once per reply for a gathering call. Replies and deadlines run it on the
+// node's listener thread, so it shouldn't block for long.
+typedef std::function<void(const RpcReply& reply)> RpcCallback;
+// Fills in the encoded reply when answering kRpcOk
+typedef std::function<RpcStatus(const RpcRequest& request, std::string& reply)> RpcMethod;
+
+template <typename Response>
+struct RpcResult {
+    RpcStatus status;
+    Response response; // Only filled in when status is kRpcOk
+};
+
+// Calls waiting on an answer and the methods this node serves. Ids only have to be unique
+// among our own calls, responses come back addressed to us.
+class RpcTable {
+public:
+    RpcTable();
+
+    // A gathering call hears every reply until its deadline, for requests that fan out
+    sf::Uint32 begin(std::string peer, unsigned int timeout, bool gathering, RpcCallback callback);
+    // Replies to calls that already finished are ignored
+    void complete(sf::Uint32 id, const RpcReply& reply);
+    // Ends a call early, the callback hears status unless a gathering call already had a reply
+    bool fail(sf::Uint32 id, RpcStatus status);
+    void expire();
+    void failPeer(std::string peer);
+    void failAll(RpcStatus status);
+    std::size_t pendingCalls();
+
+    void serve(std::string method, RpcMethod handler);
+    bool findMethod(std::string method, RpcMethod& handler);
+
+private:
+    struct PendingCall {
+        std::string peer;
+        std::chrono::steady_clock::time_point deadline;
+        bool gathering;
+        bool answered;
+        RpcCallback callback;
+    };
+
+    void notify(std::vector<RpcCallback>& callbacks, RpcStatus status);
+
+    std::map<sf::Uint32, PendingCall> pending;
+    std::chrono::steady_clock::time_point nextDeadline; // No call is due before this, expire has nothing to do
+    std::map<std::string, RpcMethod> methods;
+    sf::Uint32 nextId;
+    std::mutex mutex;
+};
+
+#endif // __RPC_H__
@@ -0,0 +1,137 @@
+#include "Topics.h"
+
+#include <algorithm>
+
+TopicTable::TopicTable(): version(0) {
+}
+
+bool TopicTable::subscribe(std::string topic, std::shared_ptr<MessageHandler> handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<MessageHandler>>& topicHandlers = local[topic];
+    if (std::find(topicHandlers.begin(), topicHandlers.end(), handler) != topicHandlers.end()) {
+        return false;
+    }
+
+    topicHandlers.push_back(handler);
+    if (topicHandlers.size() == 1) {
+        version++;
+        return true;
+    }
+    return false;
+}
+
+bool TopicTable::unsubscribe(std::string topic, std::shared_ptr<MessageHandler> handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto topicHandlers = local.find(topic);
+    if (topicHandlers == local.end()) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<MessageHandler>>& list = topicHandlers->second;
+    list.erase(std::remove(list.begin(), list.end(), handler), list.end());
+    if (list.empty()) {
+        local.erase(topicHandlers);
+        version++;
+        return true;
+    }
+    return false;
+}
+
+std::vector<std::shared_ptr<MessageHandler>> TopicTable::handlers(std::string topic) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto topicHandlers = local.find(topic);
+    return topicHandlers != local.end() ? topicHandlers->second : std::vector<std::shared_ptr<MessageHandler>>();
+}
+
+bool TopicTable::hasSubscriptions() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !local.empty();
+}
+
+SubscriptionsMessage TopicTable::announcement(std::string self) {
+    std::lock_guard<std::mutex> lock(mutex);
+    SubscriptionsMessage message;
+    message.subscriber = self;
+    message.version = version;
+    for (auto& topic : local) {
+        message.topics.push_back(topic.first);
+    }
+    return message;
+}
+
+std::vector<SubscriptionsMessage> TopicTable::remoteAnnouncements() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SubscriptionsMessage> announcements;
+    for (auto& peer : remote) {
+        SubscriptionsMessage message;
+        message.subscriber = peer.first;
+        message.version = peer.second.version;
+        message.topics = std::vector<std::string>(peer.second.topics.begin(), peer.second.topics.end());
+        announcements.push_back(message);
+    }
+    return announcements;
+}
+
+bool TopicTable::update(std::string neighbour, const SubscriptionsMessage& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto known = remote.find(message.subscriber);
+    if (known != remote.end() && known->second.version >= message.version) {
+        return false;
+    }
+
+    PeerTopics& topics = remote[message.subscriber];
+    topics.version = message.version;
+    topics.topics = std::set<std::string>(message.topics.begin(), message.topics.end());
+    topics.via = neighbour;
+    return true;
+}
+
+void TopicTable::forgetPeer(std::string peer) {
+    // Whoever is still out there is heard of again once discovery connects us to them
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto known = remote.begin(); known != remote.end();) {
+        if (known->first == peer || known->second.via == peer) {
+            remote.erase(known++);
+        } else {
+            ++known;
+        }
+    }
+}
+
+std::vector<std::string> TopicTable::subscribers(std::string topic) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> peers;
+    for (auto& peer : remote) {
+        if (peer.second.topics.count(topic) > 0) {
+            peers.push_back(peer.first);
+        }
+    }
+    return peers;
+}
+
+bool TopicTable::learnedFrom(std::string subscriber, std::string& neighbour) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto known = remote.find(subscriber);
+    if (known == remote.end()) {
+        return false;
+    }
+    neighbour = known->second.via;
+    return true;
+}
+
+void TopicTable::print(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stream << "Subscribed to (version " << version << "):" << std::endl;
+    for (auto& topic : local) {
+        stream << "  " << topic.first << " (" << topic.second.size() << " handlers)" << std::endl;
+    }
+
+    stream << "Peer subscriptions:" << std::endl;
+    for (auto& peer : remote) {
+        stream << "  " << peer.first << " (version " << peer.second.version << ", via " << peer.second.via << "):";
+        for (auto& topic : peer.second.topics) {
+            stream << " " << topic;
+        }
+        stream << std::endl;
+    }
+}
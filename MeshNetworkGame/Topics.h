@@ -0,0 +1,58 @@
+#ifndef __TOPICS_H__
+#define __TOPICS_H__
+#include <SFML/Config.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Messages.h"
+
+class MessageHandler;
+
+const sf::Uint8 kMaxPublishHops = 8; // Drop a publication relayed more than x times, routes can briefly disagree and loop
+
+// Who subscribes to what: our own handlers per topic, and the topics every subscriber in the mesh
+// has announced along with the neighbour we first heard the latest announcement from. Publications
+// follow that neighbour when the routing table has nothing better.
+class TopicTable {
+public:
+    TopicTable();
+
+    // True when the set of topics we announce changed
+    bool subscribe(std::string topic, std::shared_ptr<MessageHandler> handler);
+    bool unsubscribe(std::string topic, std::shared_ptr<MessageHandler> handler);
+    std::vector<std::shared_ptr<MessageHandler>> handlers(std::string topic);
+    bool hasSubscriptions();
+    SubscriptionsMessage announcement(std::string self);
+    std::vector<SubscriptionsMessage> remoteAnnouncements(); // What a new neighbour needs to catch up
+
+    // True when the announcement was news and should be passed on, ones no newer than the last
+    // heard from that subscriber are ignored
+    bool update(std::string neighbour, const SubscriptionsMessage& message);
+    // Forgets the peer and everyone we only heard about through them
+    void forgetPeer(std::string peer);
+    std::vector<std::string> subscribers(std::string topic);
+    bool learnedFrom(std::string subscriber, std::string& neighbour);
+
+    void print(std::ostream& stream);
+
+private:
+    std::map<std::string, std::vector<std::shared_ptr<MessageHandler>>> local;
+    sf::Uint32 version; // Bumped whenever local gains or loses a topic
+
+    struct PeerTopics {
+        sf::Uint32 version;
+        std::set<std::string> topics;
+        std::string via; // The neighbour that passed the announcement to us
+    };
+    std::map<std::string, PeerTopics> remote;
+
+    std::mutex mutex;
+};
+
+#endif // __TOPICS_H__
@@ -0,0 +1,210 @@
+#include "Tracing.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace {
+// One producer, the owning thread. Readers copy what they want and then check the head again
+// to throw away anything that was overwritten while they were copying.
+struct TraceRing {
+    TraceRing(std::size_t _thread): thread(_thread), head(0) {}
+
+    std::size_t thread;
+    std::atomic<sf::Uint64> head;
+    TraceEvent events[kTraceRingSize];
+};
+
+// Rings are never freed so a thread's pointer stays good for the life of the process
+std::atomic<TraceRing*> rings[kMaxTraceRings];
+std::atomic<std::size_t> ringCount(0);
+TRACE_THREAD_LOCAL TraceRing* threadRing = nullptr;
+TRACE_THREAD_LOCAL bool threadDropped = false;
+
+TraceRing* ringForThread() {
+    if (!threadRing && !threadDropped) {
+        std::size_t index = ringCount.fetch_add(1);
+        if (index >= kMaxTraceRings) {
+            threadDropped = true;
+            return nullptr;
+        }
+        threadRing = new TraceRing(index);
+        rings[index].store(threadRing, std::memory_order_release);
+    }
+    return threadRing;
+}
+
+void copyName(char* destination, const std::string& name) {
+    std::size_t length = std::min(name.size(), kTraceNameLength - 1);
+    std::memcpy(destination, name.data(), length);
+    destination[length] = 0;
+}
+
+const char* spanName(TraceSpan span) {
+    switch (span) {
+    case kSpanReceived: return "received";
+    case kSpanDecoded: return "decoded";
+    case kSpanQueued: return "queued";
+    case kSpanSent: return "sent";
+    case kSpanDispatched: return "dispatched";
+    }
+    return "unknown";
+}
+
+struct RingEvent {
+    TraceEvent event;
+    std::size_t thread;
+};
+
+std::vector<RingEvent> collect() {
+    std::vector<RingEvent> collected;
+    std::size_t count = std::min(ringCount.load(), kMaxTraceRings);
+    for (std::size_t index = 0; index < count; index++) {
+        TraceRing* ring = rings[index].load(std::memory_order_acquire);
+        if (!ring) {
+            continue;
+        }
+
+        sf::Uint64 head = ring->head.load(std::memory_order_acquire);
+        sf::Uint64 first = head > kTraceRingSize ? head - kTraceRingSize : 0;
+        std::vector<RingEvent> copied;
+        for (sf::Uint64 position = first; position < head; position++) {
+            RingEvent copy = { ring->events[position % kTraceRingSize], ring->thread };
+            copied.push_back(copy);
+        }
+
+        // The owner kept writing while we copied, the oldest entries may have been replaced and the
+        // slot for position after is being written right now, which is where after - kTraceRingSize was
+        sf::Uint64 after = ring->head.load(std::memory_order_acquire);
+        sf::Uint64 overwritten = after >= kTraceRingSize ? after - kTraceRingSize + 1 : 0;
+        std::size_t skip = overwritten > first ? static_cast<std::size_t>(std::min<sf::Uint64>(overwritten - first, copied.size())) : 0;
+        collected.insert(collected.end(), copied.begin() + skip, copied.end());
+    }
+
+    std::sort(collected.begin(), collected.end(), [](const RingEvent& a, const RingEvent& b) { return a.event.timestamp < b.event.timestamp; });
+    return collected;
+}
+
+std::string hexId(sf::Uint64 traceId) {
+    std::stringstream id;
+    id << "0x" << std::hex << traceId;
+    return id.str();
+}
+
+Json::Value chromeEvent(const char* phase, const std::string& name, sf::Uint64 timestamp, int process, std::size_t thread) {
+    Json::Value event(Json::objectValue);
+    event["ph"] = phase;
+    event["name"] = name;
+    event["cat"] = "mesh";
+    event["ts"] = static_cast<double>(timestamp) / 1000.0;
+    event["pid"] = process;
+    event["tid"] = static_cast<Json::UInt>(thread);
+    return event;
+}
+}
+
+sf::Uint64 traceClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void traceEvent(sf::Uint64 traceId, TraceSpan span, const std::string& node, const std::string& type, sf::Uint64 timestamp) {
+    TraceRing* ring = ringForThread();
+    if (!ring) {
+        return;
+    }
+
+    sf::Uint64 head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head % kTraceRingSize];
+    event.traceId = traceId;
+    event.timestamp = timestamp ? timestamp : traceClock();
+    event.span = span;
+    copyName(event.node, node);
+    copyName(event.type, type);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool exportTraces(std::string filename) {
+    std::vector<RingEvent> events = collect();
+
+    Json::Value trace(Json::objectValue);
+    Json::Value& output = trace["traceEvents"];
+    output = Json::Value(Json::arrayValue);
+
+    // Every node becomes a numbered process
+    std::map<std::string, int> processes;
+    for (auto& ringEvent : events) {
+        std::string node = ringEvent.event.node;
+        if (!processes.count(node)) {
+            int process = static_cast<int>(processes.size()) + 1;
+            processes[node] = process;
+
+            Json::Value metadata = chromeEvent("M", "process_name", 0, process, 0);
+            metadata["args"]["name"] = node;
+            output.append(metadata);
+        }
+    }
+
+    // A hop is everything one node did with one trace, the events are already in time order
+    struct Hop {
+        std::string node;
+        std::string type;
+        std::size_t thread;
+        sf::Uint64 begin;
+        sf::Uint64 end;
+    };
+    std::map<sf::Uint64, std::vector<Hop>> hops;
+
+    for (auto& ringEvent : events) {
+        const TraceEvent& event = ringEvent.event;
+        Json::Value instant = chromeEvent("i", std::string(spanName(event.span)) + " " + event.type, event.timestamp, processes[event.node], ringEvent.thread);
+        instant["s"] = "t";
+        instant["args"]["trace"] = hexId(event.traceId);
+        output.append(instant);
+
+        std::vector<Hop>& trail = hops[event.traceId];
+        if (trail.empty() || trail.back().node != event.node) {
+            Hop hop = { event.node, event.type, ringEvent.thread, event.timestamp, event.timestamp };
+            trail.push_back(hop);
+        } else {
+            trail.back().end = event.timestamp;
+        }
+    }
+
+    for (auto& trail : hops) {
+        for (std::size_t index = 0; index < trail.second.size(); index++) {
+            const Hop& hop = trail.second[index];
+            int process = processes[hop.node];
+
+            Json::Value slice = chromeEvent("X", hop.type, hop.begin, process, hop.thread);
+            slice["dur"] = std::max(static_cast<double>(hop.end - hop.begin) / 1000.0, 1.0);
+            slice["args"]["trace"] = hexId(trail.first);
+            output.append(slice);
+
+            // Arrows from hop to hop, bound to the slices they start in
+            if (trail.second.size() > 1) {
+                const char* phase = index == 0 ? "s" : (index + 1 == trail.second.size() ? "f" : "t");
+                Json::Value flow = chromeEvent(phase, "hop", hop.begin, process, hop.thread);
+                flow["id"] = hexId(trail.first);
+                if (index > 0) {
+                    flow["bp"] = "e";
+                }
+                output.append(flow);
+            }
+        }
+    }
+
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    Json::FastWriter writer;
+    file << writer.write(trace);
+    return static_cast<bool>(file);
+}
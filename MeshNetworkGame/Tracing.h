@@ -0,0 +1,44 @@
+#ifndef __TRACING_H__
+#define __TRACING_H__
+#include <SFML/Config.hpp>
+
+#include <string>
+
+// VS2012 has no thread_local, but both compilers can keep a plain pointer per thread
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+const std::size_t kTraceRingSize = 4096; // Events each thread keeps before overwriting its oldest
+const std::size_t kMaxTraceRings = 64; // Threads that can record, later ones are dropped
+const std::size_t kTraceNameLength = 24; // Node names and message types are cut to this
+
+// Points in a message's life on one node
+enum TraceSpan {
+    kSpanReceived, // Frame came off the socket
+    kSpanDecoded, // Frame parsed into a message
+    kSpanQueued, // Handed to the transport for the next hop
+    kSpanSent, // Socket accepted the frame
+    kSpanDispatched // Handler returned
+};
+
+struct TraceEvent {
+    sf::Uint64 traceId;
+    sf::Uint64 timestamp; // Nanoseconds since the epoch
+    TraceSpan span;
+    char node[kTraceNameLength];
+    char type[kTraceNameLength];
+};
+
+sf::Uint64 traceClock();
+
+// Record an event into the calling thread's ring, lock free after the thread's first event
+void traceEvent(sf::Uint64 traceId, TraceSpan span, const std::string& node, const std::string& type, sf::Uint64 timestamp = 0);
+
+// Write everything still held in the rings as Chrome trace event JSON (chrome://tracing or
+// Perfetto). Each node is a process, each hop a slice, and flow arrows join the hops of a trace.
+bool exportTraces(std::string filename);
+
+#endif // __TRACING_H__
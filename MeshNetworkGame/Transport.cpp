@@ -0,0 +1,59 @@
+#include "Transport.h"
+
+TcpTransport::TcpTransport() {
+    // Blocking so that the listen thread will wait properly
+    listener.setBlocking(true);
+}
+
+unsigned short TcpTransport::listen(unsigned short port) {
+    while (listener.listen(port) == sf::TcpListener::Error) {
+        port++;
+    }
+    selector.add(listener);
+    return port;
+}
+
+void TcpTransport::close() {
+    listener.close();
+}
+
+sf::IpAddress TcpTransport::getAddress() {
+    return sf::IpAddress::getPublicAddress();
+}
+
+std::unique_ptr<Channel> TcpTransport::connect(sf::IpAddress address, unsigned short port, sf::Time timeout) {
+    std::unique_ptr<sf::TcpSocket> socket(new sf::TcpSocket());
+    if (socket->connect(address, port, timeout) != sf::Socket::Done) {
+        return std::unique_ptr<Channel>();
+    }
+    return std::unique_ptr<Channel>(new TcpChannel(std::move(socket)));
+}
+
+bool TcpTransport::wait(sf::Time timeout) {
+    return selector.wait(timeout);
+}
+
+std::unique_ptr<Channel> TcpTransport::accept() {
+    if (!selector.isReady(listener)) {
+        return std::unique_ptr<Channel>();
+    }
+
+    std::unique_ptr<sf::TcpSocket> socket(new sf::TcpSocket());
+    if (listener.accept(*socket) != sf::Socket::Done) {
+        return std::unique_ptr<Channel>();
+    }
+    return std::unique_ptr<Channel>(new TcpChannel(std::move(socket)));
+}
+
+// A TcpTransport only ever hands out TcpChannels
+void TcpTransport::add(Channel& channel) {
+    selector.add(static_cast<TcpChannel&>(channel).getSocket());
+}
+
+void TcpTransport::remove(Channel& channel) {
+    selector.remove(static_cast<TcpChannel&>(channel).getSocket());
+}
+
+bool TcpTransport::isReady(Channel& channel) {
+    return selector.isReady(static_cast<TcpChannel&>(channel).getSocket());
+}
@@ -0,0 +1,87 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+#include <SFML/Network.hpp>
+
+#include <memory>
+
+// One end of a connection to a peer. Statuses mean what they do on an sf::TcpSocket: Done, NotReady
+// when a non blocking call would have to wait, Disconnected once the other end has gone.
+class Channel {
+public:
+    virtual ~Channel() {}
+
+    virtual sf::Socket::Status send(sf::Packet& packet) = 0;
+    virtual sf::Socket::Status receive(sf::Packet& packet) = 0;
+    virtual void setBlocking(bool blocking) = 0;
+
+    virtual unsigned short getLocalPort() const = 0;
+    virtual sf::IpAddress getRemoteAddress() const = 0;
+    virtual unsigned short getRemotePort() const = 0;
+};
+
+// How a node listens for, makes and multiplexes its connections. Only the node's listener thread
+// waits and accepts, anyone may connect.
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    // Listens on the first free port from port upwards and returns it
+    virtual unsigned short listen(unsigned short port) = 0;
+    virtual void close() = 0;
+    // The address peers are told to reach us on
+    virtual sf::IpAddress getAddress() = 0;
+
+    // Null when nobody answers within timeout
+    virtual std::unique_ptr<Channel> connect(sf::IpAddress address, unsigned short port, sf::Time timeout) = 0;
+
+    // Waits up to timeout for a connection attempt or for a channel with something to receive
+    virtual bool wait(sf::Time timeout) = 0;
+    // Null unless someone is trying to connect
+    virtual std::unique_ptr<Channel> accept() = 0;
+    virtual void add(Channel& channel) = 0;
+    virtual void remove(Channel& channel) = 0;
+    // Something to receive, or the other end has gone
+    virtual bool isReady(Channel& channel) = 0;
+};
+
+class TcpChannel : public Channel {
+public:
+    TcpChannel(std::unique_ptr<sf::TcpSocket> _socket): socket(std::move(_socket)) {}
+
+    sf::Socket::Status send(sf::Packet& packet) { return socket->send(packet); }
+    sf::Socket::Status receive(sf::Packet& packet) { return socket->receive(packet); }
+    void setBlocking(bool blocking) { socket->setBlocking(blocking); }
+
+    unsigned short getLocalPort() const { return socket->getLocalPort(); }
+    sf::IpAddress getRemoteAddress() const { return socket->getRemoteAddress(); }
+    unsigned short getRemotePort() const { return socket->getRemotePort(); }
+
+    sf::TcpSocket& getSocket() { return *socket; }
+
+private:
+    std::unique_ptr<sf::TcpSocket> socket;
+};
+
+// Real sockets: an sf::TcpListener and an sf::SocketSelector over every channel
+class TcpTransport : public Transport {
+public:
+    TcpTransport();
+
+    unsigned short listen(unsigned short port);
+    void close();
+    sf::IpAddress getAddress();
+
+    std::unique_ptr<Channel> connect(sf::IpAddress address, unsigned short port, sf::Time timeout);
+
+    bool wait(sf::Time timeout);
+    std::unique_ptr<Channel> accept();
+    void add(Channel& channel);
+    void remove(Channel& channel);
+    bool isReady(Channel& channel);
+
+private:
+    sf::TcpListener listener;
+    sf::SocketSelector selector;
+};
+
+#endif // __TRANSPORT_H__
@@ -2,11 +2,140 @@
 #include <SFML/Graphics.hpp>
 #include <iostream>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
 #include "Game.h"
 #include "MeshNode.h"
+#include "Loopback.h"
+
+const unsigned int kBotSettleSeconds = 5; // Time for the mesh to fill in before bots ready up
+
+// Prints whatever arrives on the topics subscribed to from the menu
+class ConsoleHandler : public MessageHandler {
+public:
+    void handleMessage(std::string sender, std::string type, const std::string& payload) {
+        out << sender << ": " << payloadToJson(type, payload).toStyledString();
+    }
+
+    void handleTopic(std::string topic, std::string sender, std::string type, const std::string& payload) {
+        out << "[" << topic << "] ";
+        handleMessage(sender, type, payload);
+    }
+};
+
+// Runs count headless bots in this process. The first one joins host:port, or becomes the seed
+// everyone else connects to when no host is given. Run it again from another process with that
+// seed's address to spread the same load over several processes. A host of loopback keeps every
+// bot on in-memory connections instead, nothing outside the process can join those.
+int runBots(std::string name, unsigned int count, BotPolicy policy, std::string host, unsigned short port) {
+    std::vector<std::unique_ptr<MeshNode>> nodes;
+    std::vector<std::shared_ptr<Game>> games;
+
+    std::shared_ptr<LoopbackNetwork> loopback;
+    if (host == "loopback") {
+        loopback = std::make_shared<LoopbackNetwork>();
+        host.clear();
+    }
+
+    // Every bot reads the same distance fields, so a target moving costs one search in total
+    std::shared_ptr<Pathfinder> pathfinder(new Pathfinder);
+    if (!pathfinder->open(binaryBoardFilename) && !pathfinder->open(boardFilename)) {
+        pathfinder.reset();
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        std::string botName = name + std::to_string(i);
+        std::shared_ptr<Game> game(new Game(botName));
+        std::unique_ptr<Transport> transport;
+        if (loopback) {
+            transport = std::unique_ptr<Transport>(new LoopbackTransport(loopback));
+        }
+        std::unique_ptr<MeshNode> node(new MeshNode(10010, botName, std::move(transport)));
+        node->registerHandler(game);
+        game->setBot(policy, pathfinder);
+
+        if (host.empty() && i > 0) {
+            node->connectTo(sf::IpAddress::LocalHost, nodes.front()->getListeningPort());
+        } else if (!host.empty() && !node->connectTo(host, port)) {
+            LOG(kLogError, kLogMesh) << botName << " failed to connect to " << host << ":" << port << std::endl;
+        }
+
+        nodes.push_back(std::move(node));
+        games.push_back(game);
+    }
+
+    sf::sleep(sf::seconds(static_cast<float>(kBotSettleSeconds)));
+    // Green makes a player IT, only the seed starts out green so there's one IT per run
+    for (unsigned int i = 0; i < count; i++) {
+        bool seed = i == 0 && host.empty();
+        unsigned int color = seed ? static_cast<unsigned int>(kGreen) : kGreen + 1 + i % (kMagenta - kGreen);
+        games[i]->readyUp(static_cast<sf::Uint8>(color));
+    }
+
+    std::string choice;
+
+    while (choice != "quit") {
+        out << "Bots are ready, type start, lockstep, info, compression or quit" << std::endl;
+        in >> choice;
+
+        if (choice == "lockstep") {
+            // Whoever starts decides for everyone
+            games.front()->setLockstep(true);
+        } else if (choice == "start") {
+            games.front()->startGame(true);
+        } else if (choice == "info") {
+            nodes.front()->listConnections();
+        } else if (choice == "compression") {
+            for (auto& node : nodes) {
+                node->listCompression();
+            }
+        }
+    }
+
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
+    // MeshNetworkGame convert <board.txt> <board.map> [x,y spawn points...]
+    if (argc >= 4 && std::string(argv[1]) == "convert") {
+        std::vector<sf::Vector2u> spawnPoints;
+        for (int i = 4; i < argc; i++) {
+            unsigned int x, y;
+            if (sscanf(argv[i], "%u,%u", &x, &y) == 2) {
+                spawnPoints.push_back(sf::Vector2u(x, y));
+            }
+        }
+
+        if (!Board::convert(argv[2], argv[3], spawnPoints)) {
+            LOG(kLogError, kLogGame) << "Failed to convert " << argv[2] << std::endl;
+            return 1;
+        }
+        out << "Wrote " << argv[3] << std::endl;
+        return 0;
+    }
+
+    // MeshNetworkGame replay <file> [speed, 0 for as fast as possible] [seek tick] [headless]
+    if (argc >= 3 && std::string(argv[1]) == "replay") {
+        std::shared_ptr<Game> viewer(new Game("replay"));
+        viewer->setHeadless(argc >= 6 && std::string(argv[5]) == "headless");
+        viewer->playReplay(argv[2], argc >= 4 ? static_cast<float>(atof(argv[3])) : 1.0f, argc >= 5 ? strtoull(argv[4], nullptr, 10) : 0);
+        return 0;
+    }
+
+    // MeshNetworkGame bots <name> <count> <random|chase|flee> [host port | loopback]
+    if (argc >= 5 && std::string(argv[1]) == "bots") {
+        BotPolicy policy;
+        if (!Bot::parsePolicy(argv[4], policy)) {
+            LOG(kLogError, kLogGame) << "Unknown bot policy " << argv[4] << std::endl;
+            return 1;
+        }
+
+        std::string host = argc >= 6 ? argv[5] : "";
+        unsigned short port = argc >= 7 ? static_cast<unsigned short>(atoi(argv[6])) : 0;
+        return runBots(argv[2], static_cast<unsigned int>(atoi(argv[3])), policy, host, port);
+    }
+
     std::string name;
 
     std::cout << "Please give your node a name" << std::endl;
@@ -15,6 +144,7 @@ int main(int argc, char *argv[]) {
     std::shared_ptr<Game> game(new Game(name));
     std::unique_ptr<MeshNode> node(new MeshNode(10010, name));
     node->registerHandler(game);
+    std::shared_ptr<ConsoleHandler> console(new ConsoleHandler());
 
     std::string address;
     unsigned short port;
@@ -27,7 +157,7 @@ int main(int argc, char *argv[]) {
         in >> port;
 
         if (!node->connectTo(address, port)) {
-            log << "Failed to connect to " << address << ":" << port << std::endl;
+            LOG(kLogError, kLogMesh) << "Failed to connect to " << address << ":" << port << std::endl;
         }
 
         out << "Please enter a host to connect to (or quit to move into the menu): " << std::endl;
@@ -42,6 +172,75 @@ int main(int argc, char *argv[]) {
 
         if (choice == "info") {
             node->listConnections();
+        } else if (choice == "compression") {
+            node->listCompression();
+        } else if (choice == "metrics") {
+            node->listMetrics();
+        } else if (choice == "export") {
+            std::string filename;
+            std::string formatName;
+            unsigned int interval;
+            MetricsFormat format;
+
+            out << "Export metrics to which file, in which format (binary/prometheus) and every how many ms? ";
+            in >> filename >> formatName >> interval;
+            if (!MetricsExporter::parseFormat(formatName, format)) {
+                LOG(kLogError, kLogMesh) << "Unknown metrics format " << formatName << std::endl;
+            } else {
+                node->getExporter().start(filename, format, interval);
+            }
+        } else if (choice == "stopexport") {
+            node->getExporter().stop();
+        } else if (choice == "loglevel") {
+            std::string categoryName;
+            std::string levelName;
+            LogCategory category;
+            LogLevel level;
+
+            out << "Set the level of which category (mesh/routing/game/sync/all) to what (error/warning/info/debug)? ";
+            in >> categoryName >> levelName;
+            if (!parseLogLevel(levelName, level)) {
+                out << "Unknown log level " << levelName << std::endl;
+            } else if (categoryName == "all") {
+                setLogLevel(level);
+            } else if (parseLogCategory(categoryName, category)) {
+                setLogLevel(category, level);
+            } else {
+                out << "Unknown log category " << categoryName << std::endl;
+            }
+        } else if (choice == "trace") {
+            unsigned int every;
+
+            out << "Trace one in how many messages (0 to stop)? ";
+            in >> every;
+            node->setTraceSampling(every);
+        } else if (choice == "exporttrace") {
+            std::string filename;
+
+            out << "Write traces to which file? ";
+            in >> filename;
+            if (!exportTraces(filename)) {
+                LOG(kLogError, kLogMesh) << "Unable to write traces to " << filename << std::endl;
+            }
+        } else if (choice == "subscribe" || choice == "unsubscribe") {
+            std::string topic;
+
+            out << "Which topic? ";
+            in >> topic;
+            if (choice == "subscribe") {
+                node->subscribe(topic, console);
+            } else {
+                node->unsubscribe(topic, console);
+            }
+        } else if (choice == "publish") {
+            std::string topic;
+            TestMessage message;
+
+            out << "Publish what on which topic? ";
+            in >> message.test >> topic;
+            node->publish(topic, message);
+        } else if (choice == "topics") {
+            node->listTopics();
         } else if (choice == "lag") {
             std::string user;
             unsigned int lag;
@@ -52,14 +251,78 @@ int main(int argc, char *argv[]) {
             in >> lag;
 
             node->setLag(user, lag);
+        } else if (choice == "link") {
+            std::string user;
+            std::string setting;
+            std::string value;
+
+            out << "Which user's link, and which setting (delay/jitter/distribution/loss/burststart/burstend/burstloss/reorder/bandwidth/bucket/clear)? ";
+            in >> user >> setting;
+            if (setting != "clear") {
+                out << "To what (ms, %, bytes per second, or uniform/normal/pareto)? ";
+                in >> value;
+            }
+
+            LinkProfile profile = node->getLink(user);
+            if (LinkEmulator::parseSetting(profile, setting, value)) {
+                node->setLink(user, profile);
+            } else {
+                out << "Unknown link setting " << setting << " " << value << std::endl;
+            }
+        } else if (choice == "fps") {
+            unsigned int limit;
+
+            out << "Frame limit (0 for unlimited)? ";
+            in >> limit;
+
+            game->setFrameLimit(limit);
+        } else if (choice == "vsync") {
+            std::string enabled;
+
+            out << "Enable vsync (on/off)? ";
+            in >> enabled;
+
+            game->setVerticalSync(enabled == "on");
+        } else if (choice == "record") {
+            std::string filename;
+
+            out << "Record to which file? ";
+            in >> filename;
+
+            game->startRecording(filename);
+        } else if (choice == "stoprecord") {
+            game->stopRecording();
+        } else if (choice == "replay") {
+            std::string filename;
+            float speed;
+
+            out << "Replay which file? ";
+            in >> filename;
+            out << "At what speed (0 for as fast as possible)? ";
+            in >> speed;
+
+            // Plays in its own window alongside the live game
+            std::shared_ptr<Game> viewer(new Game(name));
+            std::thread([viewer, filename, speed]() { viewer->playReplay(filename, speed, 0); }).detach();
+        } else if (choice == "desync") {
+            game->listDesyncs();
+        } else if (choice == "lockstep") {
+            std::string enabled;
+
+            out << "Run the next game in lockstep (on/off)? ";
+            in >> enabled;
+
+            game->setLockstep(enabled == "on");
+        } else if (choice == "headless") {
+            game->setHeadless(true);
         } else if (choice == "start") {
             game->startGame(true);
         } else if (choice == "ready") {
             game->readyUp();
         } else {
-            Json::Value message;
-            message["test"] = choice;
-            node->broadcast("test", message);
+            TestMessage message;
+            message.test = choice;
+            node->broadcast(message);
         }
     }
 
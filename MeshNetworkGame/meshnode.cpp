@@ -1,30 +1,36 @@
 #include "MeshNode.h"
 
-MeshNode::MeshNode(unsigned short _listeningPort, std::string _name): listeningPort(_listeningPort), name(_name) {
-    listener = std::unique_ptr<sf::TcpListener>(new sf::TcpListener);
-    selector = std::unique_ptr<sf::SocketSelector>(new sf::SocketSelector);
-
-    // Set the listener to be blocking so that the listen thread will wait properly
-    listener->setBlocking(true);
-
-    // Determine an open listening port and our address
-    while (listener->listen(listeningPort) == sf::TcpListener::Error) {
-        listeningPort++;
+MeshNode::MeshNode(unsigned short _listeningPort, std::string _name, std::unique_ptr<Transport> _transport): listeningPort(_listeningPort), name(_name), transport(std::move(_transport)), exporter(metrics), linkEmulator([this](EmulatedFrame& frame) { transmit(frame); }) {
+    if (!transport) {
+        transport = std::unique_ptr<Transport>(new TcpTransport());
     }
-    localAddress = sf::IpAddress::getPublicAddress();
-    log << "Listening on " << localAddress << ":" << listeningPort << std::endl;
 
-    selector->add(*listener);
+    // Determine an open listening port and our address
+    listeningPort = transport->listen(listeningPort);
+    localAddress = transport->getAddress();
+    LOG(kLogInfo, kLogMesh) << "Listening on " << localAddress << ":" << listeningPort << std::endl;
 
     // Set the start time to keep our map valid
     connectionsInvalidated = std::chrono::system_clock::now();
     routingInvalidated = std::chrono::system_clock::now();
 
+    traceSampling = 0;
+    traceCounter = 0;
+
+    // What every node answers for the rest of the mesh
+    serve<RequestConnectionsMessage, ResponseConnectionsMessage>([this](std::string sender, const RequestConnectionsMessage& request, ResponseConnectionsMessage& response) {
+        return answerConnections(sender, request, response);
+    });
+    rpc.serve(OptimizeRouteMessage::type(), [this](const RpcRequest& request, std::string& reply) {
+        return forwardOptimization(request, reply);
+    });
+
     listening = true;
     listenerThread = std::thread(&MeshNode::listen, this);
 }
 
 MeshNode::~MeshNode() {
+    linkEmulator.stop();
     listening = false;
     listenerThread.join();
 
@@ -35,19 +41,21 @@ MeshNode::~MeshNode() {
         connection->second->connectionRequestThread.join();
         connection->second->optimizationThread.join();
     }
+
+    // No reply can arrive any more
+    rpc.failAll(kRpcCancelled);
 }
 
 void MeshNode::listen() {
     while (listening) {
-        if (selector->wait(sf::milliseconds(kListenerWaitTime))) {
+        rpc.expire();
+        if (transport->wait(sf::milliseconds(kListenerWaitTime))) {
             // Check our listener for a new connection
-            if (selector->isReady(*listener)) {
-                std::unique_ptr<sf::TcpSocket> client = std::unique_ptr<sf::TcpSocket>(new sf::TcpSocket());
-                if (listener->accept(*client) == sf::Socket::Done) {
-                    log << "Got new connection attempt from " << client->getRemoteAddress() << ":" << client->getRemotePort() << std::endl;
-                    if (!addConnection(std::move(client))) {
-                        log << "Failed to get new connection" << std::endl;
-                    }
+            std::unique_ptr<Channel> client = transport->accept();
+            if (client) {
+                LOG(kLogInfo, kLogMesh) << "Got new connection attempt from " << client->getRemoteAddress() << ":" << client->getRemotePort() << std::endl;
+                if (!addConnection(std::move(client))) {
+                    LOG(kLogWarning, kLogMesh) << "Failed to get new connection" << std::endl;
                 }
             } else {
                 if (!connections.empty()) {
@@ -55,34 +63,30 @@ void MeshNode::listen() {
                     auto end = connections.end();
                     for (auto connection = connections.begin(); connection != end && !connections.empty(); ++connection) {
                         // Check the multiplexer for sockets with data
-                        if (selector->isReady(*connection->second->socket)) {
+                        if (transport->isReady(*connection->second->channel)) {
                             sf::Packet packet;
-                            sf::Socket::Status status = connection->second->socket->receive(packet);
+                            sf::Socket::Status status = connection->second->channel->receive(packet);
 
                             if (status == sf::Socket::Done) {
-                                // Attempt to parse the message for JSON
-                                std::string buffer;
-                                if (packet >> buffer) {
-                                    Json::Reader reader;
-                                    Json::Value message;
-                                    reader.parse(buffer, message);
-
-                                    // Craft a message object to be handled
-                                    Message incomingMessage;
-                                    incomingMessage.contents = message["contents"];
-                                    incomingMessage.type = message["type"].asString();
-                                    std::vector<std::string> route;
-                                    for (auto node : message["route"]) {
-                                        route.push_back(node.asString());
+                                sf::Uint64 receivedAt = traceClock();
+                                connection->second->metrics.framesIn->add();
+                                connection->second->metrics.bytesIn->add(packet.getDataSize());
+
+                                // Attempt to parse the frame into a message object to be handled
+                                Message incomingMessage;
+                                if (unpackFrame(packet, incomingMessage) && !incomingMessage.route.empty()) {
+                                    typeMetrics(incomingMessage.type).messagesIn->add();
+                                    if (incomingMessage.traceId) {
+                                        traceEvent(incomingMessage.traceId, kSpanReceived, name, incomingMessage.type, receivedAt);
+                                        traceEvent(incomingMessage.traceId, kSpanDecoded, name, incomingMessage.type);
                                     }
-                                    incomingMessage.route = route;
-
                                     handleMessage(incomingMessage);
                                 } else {
-                                    log << "Unable to parse message" << std::endl;
+                                    connection->second->metrics.drops->add();
+                                    LOG(kLogWarning, kLogMesh) << "Unable to parse message" << std::endl;
                                 }
                             } else {
-                                log << connection->first << " has disconnected" << std::endl;
+                                LOG(kLogInfo, kLogMesh) << connection->first << " has disconnected" << std::endl;
                                 // Invalidate the map and remove the connection so that any thread with an iterator will refresh it
                                 removeConnection(connection->first); 
                                 if (!connections.empty()) {
@@ -94,7 +98,7 @@ void MeshNode::listen() {
                                 }
                             }
                         } else if (connection->second->disconnected) {
-                            log << connection->first << " has timed out" << std::endl;
+                            LOG(kLogWarning, kLogMesh) << connection->first << " has timed out" << std::endl;
                             removeConnection(connection->first); 
                             if (!connections.empty()) {
                                 connection = connections.begin();
@@ -109,7 +113,7 @@ void MeshNode::listen() {
         }
     }
 
-    listener->close();
+    transport->close();
     return;
 }
 
@@ -124,7 +128,7 @@ void MeshNode::pingConnection(std::string user) {
 
 void MeshNode::searchConnections(std::string user) {
     while (!connections[user]->disconnected) {
-        sendConnections(user);
+        requestConnections(user);
         std::this_thread::sleep_for(std::chrono::milliseconds(kUpdateNetworkRate));
     }
 
@@ -152,29 +156,33 @@ void MeshNode::optimize(std::string user) {
 }
 
 void MeshNode::ping(std::string user) {
-    Json::Value message;
-    message["ping"] = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    PingMessage message;
+    message.ping = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    Message outgoingMessage = craftMessage(user, "ping", message, true);
+    Message outgoingMessage = craftMessage(user, message, true);
     sendMessage(user, outgoingMessage);
 }
 
-void MeshNode::pong(std::string user, Json::Value message) {
-    Message outgoingMessage = craftMessage(user, "pong", message, true);
+void MeshNode::pong(std::string user, PingMessage message) {
+    PongMessage reply;
+    reply.ping = message.ping;
+
+    Message outgoingMessage = craftMessage(user, reply, true);
     sendMessage(user, outgoingMessage);
 }
 
-void MeshNode::updatePing(std::string user, Json::Value message) {
-    message["pong"] = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
-    // Parse the contents of the ping/pong message and determine the time elapsed from this machine
-    unsigned long long thisPing = std::stoll(message["pong"].asString()) - std::stoll(message["ping"].asString());
+void MeshNode::updatePing(std::string user, PongMessage message) {
+    unsigned long long pong = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    // Determine the time elapsed from this machine since the ping was sent
+    unsigned long long thisPing = pong - message.ping;
+    connections[user]->metrics.rtt->record(thisPing);
     connections[user]->ping.count++;
     connections[user]->ping.sum += thisPing;
     connections[user]->ping.lastPing = std::chrono::system_clock::now();
 
     if (connections[user]->ping.count % kPingUpdateRate == 0) {
         // Cast the long longs to doubles to remove integer division before storage
-        unsigned long long newPing = static_cast<unsigned long long>(static_cast<double>(connections[user]->ping.sum) / static_cast<double>(connections[user]->ping.count)) + connections[user]->lag;
+        unsigned long long newPing = static_cast<unsigned long long>(static_cast<double>(connections[user]->ping.sum) / static_cast<double>(connections[user]->ping.count));
         connections[user]->ping.currentPing = newPing;
 
         // Clear out the ping values so that we get a new history to work with (keeps variance low)
@@ -182,9 +190,7 @@ void MeshNode::updatePing(std::string user, Json::Value message) {
         connections[user]->ping.sum = 0;
         if (connections[user]->ping.currentPing < connections[user]->ping.optimumPing) {
             connections[user]->ping.optimumPing = connections[user]->ping.currentPing;
-#if verbose
-            log << "Direct route is more efficient with " << newPing << "ms" << std::endl;
-#endif
+            LOG(kLogDebug, kLogRouting) << "Direct route is more efficient with " << newPing << "ms";
             std::vector<std::string> newRoute;
             newRoute.push_back(name);
             newRoute.push_back(user);
@@ -193,16 +199,17 @@ void MeshNode::updatePing(std::string user, Json::Value message) {
     }
 }
 
-bool MeshNode::addConnection(std::unique_ptr<sf::TcpSocket> user) {
+bool MeshNode::addConnection(std::unique_ptr<Channel> user) {
     sf::Packet request;
 
-    Json::Value message;
-    message["type"] = "info";
-    message["address"] = localAddress.toString();
-    message["listeningPort"] = listeningPort;
-    message["name"] = name;
+    InfoMessage message;
+    message.address = localAddress.toString();
+    message.listeningPort = listeningPort;
+    message.name = name;
+    message.compression = compressionVersion();
 
-    request << message.toStyledString();
+    request << std::string(InfoMessage::type());
+    message.encode(request);
 
     // Perform first part of the handshake
     if (user->send(request) == sf::Socket::Done) {
@@ -210,16 +217,11 @@ bool MeshNode::addConnection(std::unique_ptr<sf::TcpSocket> user) {
 
         // Perform second part of the handshake
         if (user->receive(response) == sf::Socket::Done) {
-            std::string buffer;
-            Json::Reader reader;
-            Json::Value info;
-
-            response >> buffer;
-
-            reader.parse(buffer, info);
+            std::string type;
+            InfoMessage info;
 
             // Handshake finished, add to our map
-            if (craftConnection(std::move(user), info)) {
+            if (response >> type && type == InfoMessage::type() && info.decode(response) && craftConnection(std::move(user), info)) {
                 return true;
             }
         }
@@ -228,20 +230,20 @@ bool MeshNode::addConnection(std::unique_ptr<sf::TcpSocket> user) {
     return false;
 }
 
-bool MeshNode::craftConnection(std::unique_ptr<sf::TcpSocket> user, Json::Value info) {
-    std::string clientName = info["name"].asString();
-    if (info["type"].asString() == "info" && !connectionExists(clientName)) {
+bool MeshNode::craftConnection(std::unique_ptr<Channel> user, InfoMessage info) {
+    std::string clientName = info.name;
+    if (!connectionExists(clientName)) {
         // Add a new object to the map
         connections[clientName] = std::unique_ptr<Connection>(new Connection());
 
         // Copy over all of the relevant info from the message
-        connections[clientName]->address = sf::IpAddress(info["address"].asString());
-        connections[clientName]->listeningPort = static_cast<unsigned short>(info["listeningPort"].asUInt());
+        connections[clientName]->address = sf::IpAddress(info.address);
+        connections[clientName]->listeningPort = info.listeningPort;
         connections[clientName]->personalPort = user->getLocalPort();
-        connections[clientName]->socket = std::move(user);
+        connections[clientName]->channel = std::move(user);
 
         // Set the port to be nonblocking in order to allow all of the threads to send messages at their will
-        connections[clientName]->socket->setBlocking(false);
+        connections[clientName]->channel->setBlocking(false);
 
         // Zero out all of the ping variables for the first run
         connections[clientName]->ping.count = 0;
@@ -249,11 +251,22 @@ bool MeshNode::craftConnection(std::unique_ptr<sf::TcpSocket> user, Json::Value
         connections[clientName]->ping.currentPing = 9999;
         connections[clientName]->ping.optimumPing = 9999;
         connections[clientName]->ping.lastPing = std::chrono::system_clock::now();
-        connections[clientName]->lag = 0;
+        connections[clientName]->compression = compressionVersion() != 0 && info.compression == compressionVersion();
         connections[clientName]->disconnected = false;
 
+        // Everything counted against this peer from now on goes straight to these
+        PeerMetrics& peerMetrics = connections[clientName]->metrics;
+        peerMetrics.framesIn = &metrics.counter(MetricsRegistry::label("mesh_frames_in_total", "peer", clientName));
+        peerMetrics.bytesIn = &metrics.counter(MetricsRegistry::label("mesh_bytes_in_total", "peer", clientName));
+        peerMetrics.framesOut = &metrics.counter(MetricsRegistry::label("mesh_frames_out_total", "peer", clientName));
+        peerMetrics.bytesOut = &metrics.counter(MetricsRegistry::label("mesh_bytes_out_total", "peer", clientName));
+        peerMetrics.drops = &metrics.counter(MetricsRegistry::label("mesh_drops_total", "peer", clientName));
+        peerMetrics.emulatedDrops = &metrics.counter(MetricsRegistry::label("mesh_emulated_drops_total", "peer", clientName));
+        peerMetrics.sendFailures = &metrics.counter(MetricsRegistry::label("mesh_send_failures_total", "peer", clientName));
+        peerMetrics.rtt = &metrics.histogram(MetricsRegistry::label("mesh_rtt_ms", "peer", clientName));
+
         // Add to the multiplexer and make a direct routing table entry
-        selector->add(*connections[clientName]->socket);
+        transport->add(*connections[clientName]->channel);
         routingTable[clientName].push_back(name);
         routingTable[clientName].push_back(clientName);
 
@@ -262,7 +275,17 @@ bool MeshNode::craftConnection(std::unique_ptr<sf::TcpSocket> user, Json::Value
         connections[clientName]->connectionRequestThread = std::move(std::thread(&MeshNode::searchConnections, this, clientName));
         connections[clientName]->optimizationThread = std::move(std::thread(&MeshNode::optimize, this, clientName));
 
-        log << "Connection to " << clientName << " on " << connections[clientName]->address << ":" << connections[clientName]->listeningPort << " established on " << connections[clientName]->personalPort << std::endl;
+        // Nobody new knows what we or anyone we've heard of are subscribed to
+        if (topics.hasSubscriptions()) {
+            sendMessage(clientName, craftMessage(clientName, topics.announcement(name), true));
+        }
+        for (auto& announcement : topics.remoteAnnouncements()) {
+            if (announcement.subscriber != clientName) {
+                sendMessage(clientName, craftMessage(clientName, announcement, true));
+            }
+        }
+
+        LOG(kLogInfo, kLogMesh) << "Connection to " << clientName << " on " << connections[clientName]->address << ":" << connections[clientName]->listeningPort << " established on " << connections[clientName]->personalPort << std::endl;
         return true;
     }
 
@@ -270,12 +293,14 @@ bool MeshNode::craftConnection(std::unique_ptr<sf::TcpSocket> user, Json::Value
 }
 
 void MeshNode::removeConnection(std::string user) {
+    linkEmulator.forget(user);
+
     // Mark the map invalid for any other thread using an iterator can respond accordingly
     connectionsInvalidated = std::chrono::system_clock::now();
     routingInvalidated = std::chrono::system_clock::now();
 
     // Remove from the multiplexer
-    selector->remove(*connections[user]->socket);
+    transport->remove(*connections[user]->channel);
 
     // Kill all threads belonging to that connections[user]
     connections[user]->disconnected = true;
@@ -285,10 +310,21 @@ void MeshNode::removeConnection(std::string user) {
 
     // Remove any references of this user from the routing table
     purgeFromRoutes(user);
+    topics.forgetPeer(user);
+    rpc.failPeer(user);
 
     // Finally remove the entry
     connections.erase(user);
     routingTable.erase(user);
+
+    // Handlers registered for several types still only hear about it once
+    std::vector<MessageHandler*> told;
+    for (auto& handler : handlers) {
+        if (std::find(told.begin(), told.end(), handler.second.get()) == told.end()) {
+            told.push_back(handler.second.get());
+            handler.second->handleDisconnect(user);
+        }
+    }
 }
 
 bool MeshNode::connectionExists(std::string user) {
@@ -300,11 +336,11 @@ bool MeshNode::connectionExists(std::string user) {
 }
 
 bool MeshNode::connectTo(sf::IpAddress address, unsigned short port) {
-    std::unique_ptr<sf::TcpSocket> user = std::unique_ptr<sf::TcpSocket>(new sf::TcpSocket()); 
     if (address != localAddress || port != listeningPort) {
-        if (user->connect(address, port, sf::milliseconds(kConnectionTimeout)) == sf::Socket::Done) {
+        std::unique_ptr<Channel> user = transport->connect(address, port, sf::milliseconds(kConnectionTimeout));
+        if (user) {
             if (!addConnection(std::move(user))) {
-                log << "Failed to connect to user from " << address << ":" << port << std::endl;
+                LOG(kLogWarning, kLogMesh) << "Failed to connect to user from " << address << ":" << port << std::endl;
             }
             return true;
         }
@@ -314,8 +350,16 @@ bool MeshNode::connectTo(sf::IpAddress address, unsigned short port) {
 }
 
 void MeshNode::setLag(std::string user, unsigned int lag) {
-    if (user != name) {
-        connections[user]->lag = lag;
+    LinkProfile profile = linkEmulator.getProfile(user);
+    profile.delay = lag;
+    setLink(user, profile);
+}
+
+void MeshNode::setLink(std::string user, const LinkProfile& profile) {
+    if (user != name && connectionExists(user)) {
+        linkEmulator.setProfile(user, profile);
+
+        // Measure the link again now that it behaves differently
         connections[user]->ping.optimumPing = 9999;
         connections[user]->ping.currentPing = 9999;
         connections[user]->ping.sum = 0;
@@ -324,10 +368,19 @@ void MeshNode::setLag(std::string user, unsigned int lag) {
     }
 }
 
-Message MeshNode::craftMessage(std::string user, std::string type, Json::Value contents, bool directRoute) {
+std::vector<std::string> MeshNode::getRoute(std::string user) {
+    auto route = routingTable.find(user);
+    return route != routingTable.end() ? route->second : std::vector<std::string>();
+}
+
+LinkProfile MeshNode::getLink(std::string user) {
+    return linkEmulator.getProfile(user);
+}
+
+Message MeshNode::craftMessage(std::string user, std::string type, std::string payload, bool directRoute) {
     Message outgoingMessage;
     // Add in the contents
-    outgoingMessage.contents = contents;
+    outgoingMessage.payload = payload;
 
 
     // Determine how to design the route
@@ -338,7 +391,7 @@ Message MeshNode::craftMessage(std::string user, std::string type, Json::Value c
     } else {
         // Add in the sender and all the relevant route
         if (routingTable[user].empty()) {
-            log << "Routing table for " << user << " is empty!!";
+            LOG(kLogWarning, kLogRouting) << "Routing table for " << user << " is empty!!";
         }
         for (auto node : routingTable[user]) {
             outgoingMessage.route.push_back(node);
@@ -352,276 +405,608 @@ Message MeshNode::craftMessage(std::string user, std::string type, Json::Value c
 }
 
 void MeshNode::sendMessage(std::string user, Message message) {
-    if (connectionExists(user)) {
-        sf::Packet packet;
+    if (message.traceId) {
+        traceEvent(message.traceId, kSpanQueued, name, message.type);
+    }
 
-        Json::Value finalMessage;
-        finalMessage["contents"] = message.contents;
-        finalMessage["type"] = message.type;
-        for (auto node : message.route) {
-            finalMessage["route"].append(node);
+    if (connectionExists(user)) {
+        EmulatedFrame frame;
+        frame.peer = user;
+        frame.type = message.type;
+        frame.traceId = message.traceId;
+        packFrame(user, message, frame.packet);
+
+        if (!linkEmulator.isImpaired(user)) {
+            transmit(frame);
+        } else if (!linkEmulator.submit(frame)) {
+            connections[user]->metrics.emulatedDrops->add();
         }
+        return;
+    } else {
+        metrics.counter(MetricsRegistry::label("mesh_drops_total", "peer", user)).add();
+        LOG(kLogWarning, kLogMesh) << "Connection to " << user << " does not exist to send message: " << std::endl << message.toString() << std::endl;
+    }
+}
 
-        packet << finalMessage.toStyledString();
+void MeshNode::transmit(EmulatedFrame& frame) {
+    // Emulated frames come back after a delay, the peer may have gone meanwhile
+    if (!connectionExists(frame.peer)) {
+        metrics.counter(MetricsRegistry::label("mesh_drops_total", "peer", frame.peer)).add();
+        return;
+    }
 
-        if (connections[user]->socket->send(packet) != sf::Socket::Done) {
-            log << "Failed to send a message to " << user << ":" << std::endl << finalMessage.toStyledString() << std::endl;
-            connections[user]->disconnected = true;
-        }
+    if (connections[frame.peer]->channel->send(frame.packet) != sf::Socket::Done) {
+        connections[frame.peer]->metrics.sendFailures->add();
+        LOG(kLogError, kLogMesh) << "Failed to send a " << frame.type << " message to " << frame.peer;
+        connections[frame.peer]->disconnected = true;
         return;
+    }
+
+    PeerMetrics& peerMetrics = connections[frame.peer]->metrics;
+    peerMetrics.framesOut->add();
+    peerMetrics.bytesOut->add(frame.packet.getDataSize());
+    typeMetrics(frame.type).messagesOut->add();
+    if (frame.traceId) {
+        traceEvent(frame.traceId, kSpanSent, name, frame.type);
+    }
+}
+
+void MeshNode::packFrame(std::string user, const Message& message, sf::Packet& packet) {
+    sf::Packet body;
+    message.encode(body);
+
+    sf::Uint8 flags = message.traceId ? kFrameTraced : 0;
+    std::string raw, compressed;
+
+    // Small frames aren't worth the CPU, and the peer has to have agreed to the codec
+    if (connections[user]->compression && body.getDataSize() >= kCompressionThreshold) {
+        raw.assign(static_cast<const char*>(body.getData()), body.getDataSize());
+
+        std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
+        bool smaller = compressFrame(raw, compressed);
+        unsigned long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count();
+
+        recordCompression(message.type, raw.size(), smaller ? compressed.size() : raw.size(), elapsed, 0);
+        if (smaller) {
+            flags |= kFrameCompressed;
+        }
+    }
+
+    packet << flags;
+    if (flags & kFrameTraced) {
+        writeUint64(packet, message.traceId);
+    }
+
+    if (flags & kFrameCompressed) {
+        packet << static_cast<sf::Uint32>(raw.size()) << compressed;
     } else {
-        log << "Connection to " << user << " does not exist to send message: " << std::endl << message.toString() << std::endl;
+        packet.append(body.getData(), body.getDataSize());
     }
 }
 
-void MeshNode::forwardMessage(Message message) {
-    std::string nextUser;
+bool MeshNode::unpackFrame(sf::Packet& packet, Message& message) {
+    sf::Uint8 flags;
+    if (!(packet >> flags)) {
+        return false;
+    }
+
+    message.traceId = 0;
+    if ((flags & kFrameTraced) && !readUint64(packet, message.traceId)) {
+        return false;
+    }
+
+    if (!(flags & kFrameCompressed)) {
+        return message.decode(packet);
+    }
+
+    sf::Uint32 rawSize;
+    std::string compressed, raw;
+    if (!(packet >> rawSize >> compressed)) {
+        return false;
+    }
+
+    std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
+    if (!decompressFrame(compressed, rawSize, raw)) {
+        LOG(kLogWarning, kLogMesh) << "Unable to decompress frame" << std::endl;
+        return false;
+    }
+    unsigned long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count();
+
+    sf::Packet body;
+    body.append(raw.data(), raw.size());
+    if (!message.decode(body)) {
+        return false;
+    }
+
+    recordCompression(message.type, 0, 0, 0, elapsed);
+    return true;
+}
+
+void MeshNode::recordCompression(std::string type, std::size_t rawBytes, std::size_t compressedBytes, unsigned long long compressMicroseconds, unsigned long long decompressMicroseconds) {
+    std::lock_guard<std::mutex> lock(compressionMutex);
+    CompressionStats& stats = compressionStats[type];
+    if (rawBytes > 0) {
+        stats.frames++;
+        stats.rawBytes += rawBytes;
+        stats.compressedBytes += compressedBytes;
+        stats.compressMicroseconds += compressMicroseconds;
+    }
+    stats.decompressMicroseconds += decompressMicroseconds;
+}
+
+MeshNode::TypeMetrics& MeshNode::typeMetrics(const std::string& type) {
+    std::lock_guard<std::mutex> lock(metricsCacheMutex);
+    auto cached = typeMetricsCache.find(type);
+    if (cached != typeMetricsCache.end()) {
+        return cached->second;
+    }
+
+    TypeMetrics& found = typeMetricsCache[type];
+    found.messagesIn = &metrics.counter(MetricsRegistry::label("mesh_messages_in_total", "type", type));
+    found.messagesOut = &metrics.counter(MetricsRegistry::label("mesh_messages_out_total", "type", type));
+    found.dispatch = &metrics.histogram(MetricsRegistry::label("mesh_dispatch_us", "type", type));
+    return found;
+}
+
+MeshNode::TopicMetrics& MeshNode::topicMetrics(const std::string& topic) {
+    std::lock_guard<std::mutex> lock(metricsCacheMutex);
+    auto cached = topicMetricsCache.find(topic);
+    if (cached != topicMetricsCache.end()) {
+        return cached->second;
+    }
+
+    TopicMetrics& found = topicMetricsCache[topic];
+    found.published = &metrics.counter(MetricsRegistry::label("mesh_published_total", "topic", topic));
+    found.deliveries = &metrics.counter(MetricsRegistry::label("mesh_topic_deliveries_total", "topic", topic));
+    found.copies = &metrics.counter(MetricsRegistry::label("mesh_publish_copies_total", "topic", topic));
+    return found;
+}
+
+MeshNode::MethodMetrics& MeshNode::methodMetrics(const std::string& method) {
+    std::lock_guard<std::mutex> lock(metricsCacheMutex);
+    auto cached = methodMetricsCache.find(method);
+    if (cached != methodMetricsCache.end()) {
+        return cached->second;
+    }
+
+    MethodMetrics& found = methodMetricsCache[method];
+    found.calls = &metrics.counter(MetricsRegistry::label("mesh_rpc_calls_total", "method", method));
+    found.serve = &metrics.histogram(MetricsRegistry::label("mesh_rpc_serve_us", "method", method));
+    return found;
+}
+
+std::string MeshNode::nextHop(const Message& message) {
+    // Find where this node is in the pathway and move onto the next one
     for (auto user = message.route.begin(); user != message.route.end(); user++) {
-        // Find where this node is in the pathway and move onto the next one
-        if (*user == name) {
-            nextUser = *(++user);
+        if (*user == name && user + 1 != message.route.end()) {
+            return *(user + 1);
         }
     }
+    return std::string();
+}
+
+void MeshNode::forwardMessage(Message message) {
+    std::string nextUser = nextHop(message);
 
-#if verbose
     if (!isSystemMessage(message)) {
-        log << "Forwarding message of type " << message.type << " to " << message.route.back() << std::endl;
+        LOG(kLogDebug, kLogRouting) << "Forwarding message of type " << message.type << " to " << message.route.back();
     }
-#endif
 
     sendMessage(nextUser, message);
 }
 
-void MeshNode::broadcast(std::string type) {
-    Json::Value message;
-    broadcast(type, message);
+void MeshNode::send(std::string user, std::string type, std::string payload) {
+    Message outgoingMessage = craftMessage(user, type, payload);
+    outgoingMessage.traceId = nextTraceId();
+    sendMessage(user, outgoingMessage);
 }
 
-void MeshNode::broadcast(std::string type, Json::Value message) {
+void MeshNode::broadcast(std::string type, std::string payload) {
+    // One trace covers every copy of a broadcast
+    sf::Uint64 traceId = nextTraceId();
+
     // Iterate through all available connections and broadcast the same message
     for (auto connection = connections.begin(); connection != connections.end(); connection++) {
-        Message outgoingMessage = craftMessage(connection->first, type, message);
-        log << "Broadcasting " << std::endl << outgoingMessage.toString();
+        Message outgoingMessage = craftMessage(connection->first, type, payload);
+        outgoingMessage.traceId = traceId;
+        LOG(kLogDebug, kLogMesh) << "Broadcasting " << std::endl << outgoingMessage.toString();
         sendMessage(connection->first, outgoingMessage);
     }
 }
 
+void MeshNode::subscribe(std::string topic, std::shared_ptr<MessageHandler> handler) {
+    handler->setMeshNode(this);
+    if (topics.subscribe(topic, handler)) {
+        announceSubscriptions();
+    }
+}
+
+void MeshNode::unsubscribe(std::string topic, std::shared_ptr<MessageHandler> handler) {
+    if (topics.unsubscribe(topic, handler)) {
+        announceSubscriptions();
+    }
+}
+
+void MeshNode::announceSubscriptions() {
+    relaySubscriptions(name, topics.announcement(name));
+}
+
+// Floods an announcement on to every neighbour but the one it came from and its subscriber
+void MeshNode::relaySubscriptions(std::string neighbour, const SubscriptionsMessage& message) {
+    for (auto connection = connections.begin(); connection != connections.end(); connection++) {
+        if (connection->first != neighbour && connection->first != message.subscriber) {
+            sendMessage(connection->first, craftMessage(connection->first, message, true));
+        }
+    }
+}
+
+void MeshNode::publish(std::string topic, std::string type, std::string payload) {
+    PublishMessage message;
+    message.topic = topic;
+    message.origin = name;
+    message.payloadType = type;
+    message.payload = std::move(payload);
+    message.destinations = topics.subscribers(topic);
+    message.hops = 0;
+    topicMetrics(topic).published->add();
+
+    deliverPublication(message);
+    routePublication(message);
+}
+
+void MeshNode::receivePublication(PublishMessage message) {
+    if (std::find(message.destinations.begin(), message.destinations.end(), name) != message.destinations.end()) {
+        deliverPublication(message);
+    }
+
+    if (message.hops >= kMaxPublishHops) {
+        LOG(kLogWarning, kLogRouting) << "Dropping publication on " << message.topic << " from " << message.origin << " after " << static_cast<unsigned int>(message.hops) << " hops" << std::endl;
+        return;
+    }
+    routePublication(message);
+}
+
+void MeshNode::deliverPublication(const PublishMessage& message) {
+    std::vector<std::shared_ptr<MessageHandler>> subscribed = topics.handlers(message.topic);
+    if (subscribed.empty()) {
+        return;
+    }
+
+    TypeMetrics& dispatchMetrics = typeMetrics(message.payloadType);
+    TopicMetrics& deliveryMetrics = topicMetrics(message.topic);
+    for (auto& handler : subscribed) {
+        std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
+        handler->handleTopic(message.topic, message.origin, message.payloadType, message.payload);
+        dispatchMetrics.dispatch->record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count());
+        deliveryMetrics.deliveries->add();
+    }
+}
+
+void MeshNode::routePublication(const PublishMessage& message) {
+    // Subscribers sharing a first hop share one copy as far as their routes agree, instead of one each
+    std::map<std::string, std::vector<std::string>> branches;
+    for (auto& destination : message.destinations) {
+        if (destination == name) {
+            continue;
+        }
+
+        // Without a route of our own, follow the subscription back the way it reached us
+        auto route = routingTable.find(destination);
+        std::string neighbour;
+        if (route != routingTable.end() && route->second.size() >= 2) {
+            branches[route->second[1]].push_back(destination);
+        } else if (topics.learnedFrom(destination, neighbour) && connectionExists(neighbour)) {
+            branches[neighbour].push_back(destination);
+        } else {
+            LOG(kLogWarning, kLogRouting) << "No route to " << destination << " for publication on " << message.topic << std::endl;
+            metrics.counter(MetricsRegistry::label("mesh_drops_total", "peer", destination)).add();
+        }
+    }
+
+    if (branches.empty()) {
+        return;
+    }
+
+    Counter& copies = *topicMetrics(message.topic).copies;
+    for (auto& branch : branches) {
+        PublishMessage copy;
+        copy.topic = message.topic;
+        copy.origin = message.origin;
+        copy.payloadType = message.payloadType;
+        copy.payload = message.payload;
+        copy.destinations = std::move(branch.second);
+        copy.hops = message.hops + 1;
+        sendMessage(branch.first, craftMessage(branch.first, copy, true));
+        copies.add();
+    }
+}
+
+bool MeshNode::cancel(sf::Uint32 id) {
+    return rpc.fail(id, kRpcCancelled);
+}
+
+std::vector<std::string> MeshNode::routeTo(std::string user) {
+    auto route = routingTable.find(user);
+    return route != routingTable.end() ? route->second : std::vector<std::string>();
+}
+
+sf::Uint32 MeshNode::callAlong(std::vector<std::string> route, std::string method, std::string payload, unsigned int timeout, bool gathering, RpcCallback callback) {
+    methodMetrics(method).calls->add();
+    sf::Uint32 id = rpc.begin(route.size() > 1 ? route[1] : std::string(), timeout, gathering, callback);
+    if (route.size() < 2 || !connectionExists(route[1])) {
+        LOG(kLogWarning, kLogRouting) << "No route for " << method << " call to " << (route.empty() ? std::string("nobody") : route.back()) << std::endl;
+        rpc.fail(id, kRpcUnreachable);
+        return id;
+    }
+
+    RpcRequestMessage request;
+    request.id = id;
+    request.method = method;
+    request.payload = std::move(payload);
+
+    Message outgoingMessage;
+    outgoingMessage.type = RpcRequestMessage::type();
+    outgoingMessage.route = std::move(route);
+    outgoingMessage.payload = encodePayload(request);
+    outgoingMessage.traceId = nextTraceId();
+    sendMessage(outgoingMessage.route[1], outgoingMessage);
+    return id;
+}
+
+void MeshNode::answerRequest(std::vector<std::string> route, RpcRequestMessage request) {
+    RpcRequest incoming;
+    incoming.id = request.id;
+    incoming.method = request.method;
+    incoming.payload = std::move(request.payload);
+    incoming.route = std::move(route);
+
+    RpcResponseMessage response;
+    response.id = request.id;
+    RpcStatus status = kRpcUnknownMethod;
+    RpcMethod method;
+    if (rpc.findMethod(request.method, method)) {
+        std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
+        status = method(incoming, response.payload);
+        methodMetrics(request.method).serve->record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count());
+    } else {
+        LOG(kLogWarning, kLogMesh) << incoming.route.front() << " called " << request.method << ", which isn't served here" << std::endl;
+    }
+
+    if (status == kRpcDeferred) {
+        return;
+    }
+    response.status = static_cast<sf::Uint8>(status);
+
+    // Back the way the request came
+    Message outgoingMessage;
+    outgoingMessage.type = RpcResponseMessage::type();
+    outgoingMessage.route.assign(incoming.route.rbegin(), incoming.route.rend());
+    outgoingMessage.payload = encodePayload(response);
+    if (outgoingMessage.route.size() > 1) {
+        sendMessage(outgoingMessage.route[1], outgoingMessage);
+    }
+}
+
+// Passes a request on one more hop, whoever answers it replies straight to the caller
+void MeshNode::relayRequest(const RpcRequest& request, std::string user, std::string payload) {
+    RpcRequestMessage relayed;
+    relayed.id = request.id;
+    relayed.method = request.method;
+    relayed.payload = std::move(payload);
+
+    Message outgoingMessage;
+    outgoingMessage.type = RpcRequestMessage::type();
+    outgoingMessage.route = request.route;
+    outgoingMessage.route.push_back(user);
+    outgoingMessage.payload = encodePayload(relayed);
+    sendMessage(user, outgoingMessage);
+}
+
 void MeshNode::handleMessage(Message message) {
     // Check to see if we're the destination
     if (message.route.back() == name) {
         handleContent(message);
     } else {
-#if verbose
         // If this isn't a system message, put it into the log for view
         if (!isSystemMessage(message)) {
-            log << "Forwarding " << std::endl << message.toString() << std::endl;
+            LOG(kLogDebug, kLogRouting) << "Forwarding " << std::endl << message.toString();
         }
-#endif
+        std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
         forwardMessage(message);
+        metrics.histogram("mesh_forward_us").record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count());
     }
 }
 
 void MeshNode::handleContent(Message message) {
-    if (message.type == "ping") {
-        pong(message.route.front(), message.contents);
-    } else if (message.type == "pong") {
-        updatePing(message.route.front(), message.contents);
-    } else if (message.type == "sendConnections") {
-        receiveConnections(message.route.front(), message.contents);
-    } else if (message.type == "requestConnections") {
-        std::vector<std::string> users;
-        for (auto user : message.contents["users"]) {
-            users.push_back(user.asString());
-        }
-        sendRequestedConnections(message.route.front(), std::move(users));
-    } else if (message.type == "responseConnections") {
-        parseConnections(message.contents);
-    } else if (message.type == "optimizeRoute") {
-        forwardOptimization(message);
-    } else if (message.type == "receiveOptimizedRoute"){
-        returnOptimization(message);
+    if (message.type == PingMessage::type()) {
+        PingMessage contents;
+        if (decodePayload(message.payload, contents)) {
+            pong(message.route.front(), contents);
+        }
+    } else if (message.type == PongMessage::type()) {
+        PongMessage contents;
+        if (decodePayload(message.payload, contents)) {
+            updatePing(message.route.front(), contents);
+        }
+    } else if (message.type == RpcRequestMessage::type()) {
+        RpcRequestMessage contents;
+        if (decodePayload(message.payload, contents)) {
+            answerRequest(std::move(message.route), std::move(contents));
+        }
+    } else if (message.type == RpcResponseMessage::type()) {
+        RpcResponseMessage contents;
+        if (decodePayload(message.payload, contents)) {
+            RpcReply reply;
+            reply.status = contents.status < kRpcDeferred ? static_cast<RpcStatus>(contents.status) : kRpcFailed;
+            reply.payload = std::move(contents.payload);
+            reply.route = std::move(message.route);
+            rpc.complete(contents.id, reply);
+        }
+    } else if (message.type == SubscriptionsMessage::type()) {
+        SubscriptionsMessage contents;
+        if (decodePayload(message.payload, contents) && contents.subscriber != name && topics.update(message.route.front(), contents)) {
+            relaySubscriptions(message.route.front(), contents);
+        }
+    } else if (message.type == PublishMessage::type()) {
+        PublishMessage contents;
+        if (decodePayload(message.payload, contents)) {
+            receivePublication(std::move(contents));
+        }
     } else if (handlers.find(message.type) != handlers.end()) {
-        handlers[message.type]->handleMessage(message.route.front(), message.type, message.contents);
+        std::chrono::high_resolution_clock::time_point began = std::chrono::high_resolution_clock::now();
+        handlers[message.type]->handleMessage(message.route.front(), message.type, message.payload);
+        if (message.traceId) {
+            traceEvent(message.traceId, kSpanDispatched, name, message.type);
+        }
+        typeMetrics(message.type).dispatch->record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - began).count());
     } else {
-        log << message.toString() << std::endl;
+        LOG(kLogWarning, kLogMesh) << message.toString() << std::endl;
     }
 }
 
 bool MeshNode::isSystemMessage(Message message) {
     if (message.type != "ping" && 
         message.type != "pong" &&
-        message.type != "sendConnections" &&
-        message.type != "requestConnections" &&
-        message.type != "responseConnections" &&
-        message.type != "optimizeRoute" &&
-        message.type != "receiveOptimizedRoute") {
+        message.type != "rpcRequest" &&
+        message.type != "rpcResponse" &&
+        message.type != "subscriptions") {
         return false;
     } else {
         return true;
     }
 }
 
-void MeshNode::sendConnections(std::string user) {
-    Json::Value message;
+// One round trip: tell the peer who we already know and hear back about everyone else it's connected to
+void MeshNode::requestConnections(std::string user) {
+    RequestConnectionsMessage request;
     for (auto connection = connections.begin(); connection != connections.end(); connection++) {
-        Json::Value user;
-        user["name"] = connection->first;
-        user["ping"] = connection->second->ping.currentPing;
-        message["users"].append(user);
+        request.users.push_back(connection->first);
     }
 
-    Message outgoingMessage = craftMessage(user, "sendConnections", message);
-    sendMessage(user, outgoingMessage);
-}
-
-void MeshNode::receiveConnections(std::string user, Json::Value message) {
-    std::vector<std::string> users;
-
-    for (auto unknownUser : message["users"]) {
-        std::string newUser = unknownUser["name"].asString();
-        if (!connectionExists(newUser) && newUser != name) {
-            log << "Requesting connection to " << newUser << std::endl;
-            users.push_back(newUser);
+    // Nothing is lost by an answer that doesn't come, the next round asks again
+    call<ResponseConnectionsMessage>(user, request, [this](RpcStatus status, const ResponseConnectionsMessage& response) {
+        if (status == kRpcOk) {
+            parseConnections(response);
         }
-    }
-
-    if (!users.empty()) {
-        requestConnections(user, std::move(users));
-    }
+    }, kUpdateNetworkRate);
 }
 
-void MeshNode::requestConnections(std::string user, std::vector<std::string> requestedUsers) {
-    Json::Value message;
-    for (auto requestedUser : requestedUsers) {
-        message["users"].append(requestedUser);
-    }
-
-    Message outgoingMessage = craftMessage(user, "requestConnections", message);
-    sendMessage(user, outgoingMessage);
-}
-
-void MeshNode::sendRequestedConnections(std::string user, std::vector<std::string> requestedUsers) {
-    Json::Value message;
-    for (auto requestedUser : requestedUsers) {
-        if (connectionExists(requestedUser)) {
-            Json::Value newUser;
-            newUser["address"] = connections[requestedUser]->address.toString();
-            newUser["port"] = connections[requestedUser]->listeningPort;
-            message["users"].append(newUser);
+RpcStatus MeshNode::answerConnections(std::string user, const RequestConnectionsMessage& request, ResponseConnectionsMessage& response) {
+    for (auto connection = connections.begin(); connection != connections.end(); connection++) {
+        if (connection->first != user && std::find(request.users.begin(), request.users.end(), connection->first) == request.users.end()) {
+            UserAddress newUser;
+            newUser.name = connection->first;
+            newUser.address = connection->second->address.toString();
+            newUser.port = connection->second->listeningPort;
+            response.users.push_back(newUser);
         }
     }
-
-    Message outgoingMessage = craftMessage(user, "responseConnections", message);
-    sendMessage(user, outgoingMessage);
+    return kRpcOk;
 }
 
-void MeshNode::parseConnections(Json::Value message) {
-    std::vector<sf::IpAddress> addresses;
-    std::vector<unsigned short> ports;
-
-    for (auto user : message["users"]) {
-        addresses.push_back(sf::IpAddress(user["address"].asString()));
-        ports.push_back(static_cast<unsigned short>(user["port"].asUInt()));
-    }
+void MeshNode::parseConnections(const ResponseConnectionsMessage& message) {
+    // Anyone who can't be reached now gets offered to us again on the next exchange
+    for (auto& user : message.users) {
+        // Only the lower name connects, they hear about us just as we hear about them. Two nodes
+        // connecting to each other at once would each wait on the other's listener to finish the handshake.
+        if (connectionExists(user.name) || user.name <= name) {
+            continue;
+        }
 
-    while (!addresses.empty() && !ports.empty()) {
-        if (connectTo(addresses.back(), ports.back())) {
-            addresses.pop_back();
-            ports.pop_back();
-        } 
+        LOG(kLogInfo, kLogMesh) << "Connecting to " << user.name << std::endl;
+        if (!connectTo(sf::IpAddress(user.address), user.port)) {
+            LOG(kLogWarning, kLogMesh) << "Unable to reach " << user.name << " at " << user.address << ":" << user.port << std::endl;
+        }
     }
 }
 
 void MeshNode::beginOptimization(std::string userToBeOptimized, std::string userToSendThrough) {
-    Json::Value message, firstUser;
-    message["destination"] = userToBeOptimized;
-    firstUser["name"] = userToSendThrough;
-    firstUser["ping"] = connections[userToSendThrough]->ping.currentPing + connections[userToSendThrough]->lag;
-    message["data"].append(firstUser);
-
-    Message outgoingMessage = craftMessage(userToSendThrough, "optimizeRoute", message, true);
-    sendMessage(userToSendThrough, outgoingMessage);
+    OptimizeRouteMessage message;
+    UserPing firstUser;
+    message.destination = userToBeOptimized;
+    firstUser.name = userToSendThrough;
+    firstUser.ping = connections[userToSendThrough]->ping.currentPing;
+    message.data.push_back(firstUser);
+
+    std::vector<std::string> route;
+    route.push_back(name);
+    route.push_back(userToSendThrough);
+
+    // The destination answers every path the probe finds, until the next round sends a new one
+    callAlong(route, OptimizeRouteMessage::type(), encodePayload(message), kRouteOptimizationRate, true, [this](const RpcReply& reply) {
+        if (reply.status == kRpcOk) {
+            returnOptimization(reply);
+        }
+    });
 }
 
-void MeshNode::forwardOptimization(Message message) {
+RpcStatus MeshNode::forwardOptimization(const RpcRequest& request, std::string& reply) {
+    OptimizeRouteMessage contents;
+    if (!decodePayload(request.payload, contents)) {
+        return kRpcFailed;
+    }
+
     // See if we're the node being optimized for
-    if (message.contents["destination"] == name) {
+    if (contents.destination == name) {
         // Compute the ping from this optimization message
-        message.contents["finalPing"] = 0;
-        for (auto user : message.contents["data"]) {
-            message.contents["finalPing"] = message.contents["finalPing"].asUInt() + user["ping"].asUInt();
-        }
-
-        // Turn the vector around to send it back the way it came
-        std::vector<std::string> reverseRoute;
-        for (auto node = message.route.rbegin(); node != message.route.rend(); ++node) {
-            reverseRoute.push_back(*node);
+        contents.finalPing = 0;
+        for (auto& user : contents.data) {
+            contents.finalPing += user.ping;
         }
 
-        // Swap the route and the message type
-        message.route = reverseRoute;
-        message.type = "receiveOptimizedRoute";
+        // The reply retraces the probe's route back
+        reply = encodePayload(contents);
+        return kRpcOk;
+    }
 
-        // Send the message along the way
-        returnOptimization(message);
-    } else {
-        // Look through all of my existing connections
-        for (auto& connection : connections) {
-            // Determine if that node has already been visited
-            bool alreadyInRoute = false;
-            for (auto node : message.route) {
-                if (connection.first == node) {
-                    alreadyInRoute = true;
-                }
+    // Look through all of my existing connections
+    for (auto& connection : connections) {
+        // Determine if that node has already been visited
+        bool alreadyInRoute = false;
+        for (auto node : request.route) {
+            if (connection.first == node) {
+                alreadyInRoute = true;
             }
-            
-            // If it's not already in the path, append ourselves and send it on it's way 
-            if (!alreadyInRoute) {
-                // Make a copy of our existing message
-                Message newMessage = message;
-
-                // Add the ping of that user to this message
-                Json::Value nextUser;
-                nextUser["name"] = connection.first;
-                nextUser["ping"] = connection.second->ping.currentPing + connection.second->lag;
+        }
 
-                // Add the path to that user to this message
-                newMessage.contents["data"].append(nextUser);
-                newMessage.route.push_back(connection.first);
+        // If it's not already in the path, add the ping of that user and send it on it's way
+        if (!alreadyInRoute) {
+            OptimizeRouteMessage newContents = contents;
+            UserPing nextUser;
+            nextUser.name = connection.first;
+            nextUser.ping = connection.second->ping.currentPing;
+            newContents.data.push_back(nextUser);
 
-                // Send it off
-                forwardMessage(newMessage);
-            } 
+            relayRequest(request, connection.first, encodePayload(newContents));
         }
     }
+    return kRpcDeferred;
 }
 
-void MeshNode::returnOptimization(Message message) {
-    if (message.route.back() == name) {
-        std::string destination = message.contents["destination"].asString();
-        // See if the final ping is < the current ping + lag && it's not the same as the old route
-        if (message.contents["finalPing"].asUInt() < connections[destination]->ping.optimumPing) {
-#if verbose
-            log << "Updating route to " << message.contents["destination"].asString() << " with " << message.contents["finalPing"].asString() << "ms with route: " << std::endl;
-#endif
-            connections[destination]->ping.optimumPing = message.contents["finalPing"].asUInt();
+void MeshNode::returnOptimization(const RpcReply& reply) {
+    OptimizeRouteMessage contents;
+    if (!decodePayload(reply.payload, contents)) {
+        return;
+    }
 
-            std::vector<std::string> newRoute;
-            for (auto route = message.route.rbegin(); route != message.route.rend(); ++route) {
-#if verbose
-                if (*route != message.route.front()) {
-                    log << *route << " -> ";
-                } else {
-                    log << *route << std::endl;
-                }
-#endif
-                newRoute.push_back(*route);
-            }
-            routingTable[destination] = newRoute;
-            return;
+    // The destination may have disconnected while the probe was out
+    std::string destination = contents.destination;
+    if (!connectionExists(destination)) {
+        return;
+    }
+
+    // See if the final ping is < the current ping + lag && it's not the same as the old route
+    if (contents.finalPing < connections[destination]->ping.optimumPing) {
+        connections[destination]->ping.optimumPing = contents.finalPing;
+
+        std::vector<std::string> newRoute;
+        std::string path;
+        for (auto route = reply.route.rbegin(); route != reply.route.rend(); ++route) {
+            path += (route == reply.route.rbegin() ? "" : " -> ") + *route;
+            newRoute.push_back(*route);
         }
-    } else {
-        forwardMessage(message);
+        LOG(kLogDebug, kLogRouting) << "Updating route to " << destination << " with " << contents.finalPing << "ms with route: " << path;
+        routingTable[destination] = newRoute;
     }
 }
 
@@ -647,8 +1032,8 @@ void MeshNode::purgeFromRoutes(std::string user) {
                 route.second.push_back(beginning);
                 route.second.push_back(end);
 
-                log << "Purged " << user << " from route to " << route.second.back() << std::endl;
-                log << "Resetting route to " << end << std::endl;
+                LOG(kLogInfo, kLogRouting) << "Purged " << user << " from route to " << route.second.back() << std::endl;
+                LOG(kLogInfo, kLogRouting) << "Resetting route to " << end << std::endl;
 
                 connections[end]->ping.currentPing = 9999;
                 connections[end]->ping.optimumPing = 9999;
@@ -661,27 +1046,28 @@ void MeshNode::purgeFromRoutes(std::string user) {
 
 void MeshNode::listConnections() {
     for (auto connection = connections.begin(); connection != connections.end(); connection++) {
-        log << connection->first << ": " << connection->second->address << ":" << connection->second->listeningPort << " on " << connection->second->personalPort << std::endl;
+        out << connection->first << ": " << connection->second->address << ":" << connection->second->listeningPort << " on " << connection->second->personalPort << std::endl;
         if (connection->second->ping.currentPing == 9999 || connection->second->ping.optimumPing == 9999) {
-            log << "Currently calculating ping: " << kPingUpdateRate - connection->second->ping.count << " more pings required" <<std::endl;
+            out << "Currently calculating ping: " << kPingUpdateRate - connection->second->ping.count << " more pings required" <<std::endl;
         } else {
-            log << "Direct ping to " << connection->first << ": " << connection->second->ping.currentPing << "ms" << std::endl;
-            log << "Current route's ping to " << connection->first << ": " << connection->second->ping.optimumPing << "ms " << std::endl; 
+            out << "Direct ping to " << connection->first << ": " << connection->second->ping.currentPing << "ms" << std::endl;
+            out << "Current route's ping to " << connection->first << ": " << connection->second->ping.optimumPing << "ms " << std::endl; 
         }
-        if (connection->second->lag > 0) {
-            log << "Has " << connection->second->lag << "ms artificial lag" << std::endl;
+        LinkProfile link = linkEmulator.getProfile(connection->first);
+        if (!link.isClear()) {
+            out << "Emulating " << link.toString() << ", " << linkEmulator.queued(connection->first) << " frames queued" << std::endl;
         }
         if (routingTable[connection->first].size() > 1) {
-            log << "Route to " << connection->first << ":" << std::endl;
+            out << "Route to " << connection->first << ":" << std::endl;
             for (auto route = routingTable[connection->first].begin(); route != routingTable[connection->first].end(); route++) {
                 if (*route != routingTable[connection->first].back()) {
-                    log << *route << " -> ";
+                    out << *route << " -> ";
                 } else {
-                    log << *route << std::endl;
+                    out << *route << std::endl;
                 }
             }
         }
-        log << std::endl;
+        out << std::endl;
     }
 }
 
@@ -689,20 +1075,86 @@ unsigned int MeshNode::numberOfConnections() {
     return connections.size();
 }
 
+bool MeshNode::getRoutePing(std::string user, unsigned long long& ping) {
+    auto connection = connections.find(user);
+    if (connection == connections.end() || connection->second->ping.optimumPing == 9999) {
+        return false;
+    }
+
+    ping = connection->second->ping.optimumPing;
+    return true;
+}
+
 bool MeshNode::registerHandler(std::shared_ptr<MessageHandler> handler) {
     for (auto handle : handler->getMessageTypes()) {
         if (handlers.find(handle) != handlers.end()) {
-            log << "Handle " << handle << " already exists, overwritten by a new handler" << std::endl;
+            LOG(kLogWarning, kLogMesh) << "Handle " << handle << " already exists, overwritten by a new handler" << std::endl;
         }
         handlers[handle] = handler;
     }
-    handler->setMeshNode(std::unique_ptr<MeshNode>(this));
+    handler->setMeshNode(this);
     return true;
 }
 
+void MeshNode::setTraceSampling(unsigned int every) {
+    traceSampling = every;
+}
+
+sf::Uint64 MeshNode::nextTraceId() {
+    unsigned int every = traceSampling;
+    if (!every) {
+        return 0;
+    }
+
+    sf::Uint32 count = traceCounter.fetch_add(1);
+    if (count % every) {
+        return 0;
+    }
+
+    // Who started it and how many they've started keeps ids apart across the mesh
+    return (static_cast<sf::Uint64>(std::hash<std::string>()(name)) << 32) | (count + 1);
+}
+
+void MeshNode::listMetrics() {
+    for (auto metric : metrics.list()) {
+        if (metric->kind == kCounterMetric) {
+            out << metric->name << " " << metric->counter.get() << std::endl;
+        } else if (metric->histogram->count()) {
+            const Histogram& histogram = *metric->histogram;
+            out << metric->name << " count " << histogram.count() << " mean " << histogram.sum() / histogram.count()
+                << " p50 " << histogram.percentile(0.5) << " p90 " << histogram.percentile(0.9) << " p99 " << histogram.percentile(0.99) << std::endl;
+        }
+    }
+}
+
+void MeshNode::listCompression() {
+    std::lock_guard<std::mutex> lock(compressionMutex);
+    if (compressionStats.empty()) {
+        out << "No frames have been large enough to compress" << std::endl;
+        return;
+    }
+
+    for (auto& entry : compressionStats) {
+        const CompressionStats& stats = entry.second;
+        out << entry.first << ": ";
+        if (stats.frames > 0) {
+            out << stats.frames << " frames, " << stats.rawBytes << " -> " << stats.compressedBytes << " bytes ("
+                << stats.compressedBytes * 100 / stats.rawBytes << "% of raw), "
+                << stats.compressMicroseconds / stats.frames << "us to compress";
+        } else {
+            out << "nothing sent compressed";
+        }
+        out << ", " << stats.decompressMicroseconds << "us spent decompressing" << std::endl;
+    }
+}
+
+void MeshNode::listTopics() {
+    topics.print(out);
+}
+
 void MeshNode::listHandlers() {
-    log << "All registered handles: " << std::endl;
+    out << "All registered handles: " << std::endl;
     for (auto& handle : handlers) {
-        log << handle.first << std::endl;
+        out << handle.first << std::endl;
     }
 }
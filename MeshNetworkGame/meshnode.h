@@ -19,15 +19,26 @@
 #include <memory>
 #include <functional>
 #include <chrono>
+#include <atomic>
+#include <future>
+#include <algorithm>
 
+#include "Messages.h"
+#include "Compression.h"
+#include "Metrics.h"
+#include "MetricsExport.h"
+#include "Tracing.h"
+#include "Logging.h"
+#include "LinkEmulator.h"
+#include "Transport.h"
+#include "Topics.h"
+#include "Rpc.h"
 #include "MessageHandler.h"
 
 class MessageHandler;
 
-#define verbose 1
 #define out std::cout 
 #define in  std::cin
-#define log std::cerr
 
 struct PingInfo {
     unsigned long long sum;
@@ -37,13 +48,26 @@ struct PingInfo {
     std::chrono::system_clock::time_point lastPing;
 };
 
+// A connection's own metrics, looked up once when it's made so frames don't build label strings
+struct PeerMetrics {
+    Counter* framesIn;
+    Counter* bytesIn;
+    Counter* framesOut;
+    Counter* bytesOut;
+    Counter* drops;
+    Counter* emulatedDrops;
+    Counter* sendFailures;
+    Histogram* rtt;
+};
+
 struct Connection {
-    std::unique_ptr<sf::TcpSocket> socket;
+    std::unique_ptr<Channel> channel;
     sf::IpAddress address;
     unsigned short personalPort;
     unsigned short listeningPort;
     PingInfo ping;
-    unsigned int lag;
+    bool compression; // Both ends advertised the same compressionVersion()
+    PeerMetrics metrics;
 
     bool disconnected;
     std::thread pingThread;
@@ -52,9 +76,12 @@ struct Connection {
 };
 
 struct Message {
-    Json::Value contents;
     std::string type;
     std::vector<std::string> route;
+    std::string payload;
+    sf::Uint64 traceId; // Carried in the frame header, 0 when the message isn't traced
+
+    Message(): traceId(0) {}
 
     std::string toString() {
         std::stringstream buffer;
@@ -72,14 +99,42 @@ struct Message {
             }
         }
         buffer << "Contents: " << std::endl;
-        buffer << contents.toStyledString() << std::endl;
+        buffer << payloadToJson(type, payload).toStyledString() << std::endl;
         return buffer.str();
     }
 
+    // Wire layout: type, route length, route, then the schema encoded payload
+    void encode(sf::Packet& packet) const {
+        packet << type;
+        packet << static_cast<sf::Uint32>(route.size());
+        for (auto& node : route) {
+            packet << node;
+        }
+        packet << payload;
+    }
+
+    bool decode(sf::Packet& packet) {
+        sf::Uint32 routeLength;
+        if (!(packet >> type >> routeLength)) {
+            return false;
+        }
+        route.clear();
+        for (sf::Uint32 i = 0; i < routeLength; i++) {
+            std::string node;
+            if (!(packet >> node)) {
+                return false;
+            }
+            route.push_back(node);
+        }
+        return (packet >> payload) ? true : false;
+    }
+
     Message& operator=(const Message& other) {
-        contents = other.contents;
         type = other.type;
         route = other.route;
+        payload = other.payload;
+        traceId = other.traceId;
+        return *this;
     }
 };
 
@@ -92,19 +147,54 @@ const int kPingUpdateRate = 50; // Compute the average ping every x ms
 const int kUpdateNetworkRate = 1000; // Every x pings, ask other nodes for more nodes
 const int kRouteOptimizationRate = 1500; // Attempt to optimize the route after x ms
 
+const sf::Uint8 kFrameCompressed = 0x01; // Frame flag: the message is compressed
+const sf::Uint8 kFrameTraced = 0x02; // Frame flag: a u64 trace id follows the flags
+
 class MeshNode {
 public:
-    MeshNode(unsigned short _listening_port = kListeningPort, std::string name = kDefaultName);
+    // Listens on real sockets unless handed another transport, such as a LoopbackTransport
+    MeshNode(unsigned short _listening_port = kListeningPort, std::string name = kDefaultName, std::unique_ptr<Transport> _transport = nullptr);
     ~MeshNode();
 
     bool connectTo(sf::IpAddress address, unsigned short port);
     bool registerHandler(std::shared_ptr<MessageHandler> handler);
     void setLag(std::string user, unsigned int lag);
-    void broadcast(std::string type);
-    void broadcast(std::string type, Json::Value message);
+    void setLink(std::string user, const LinkProfile& profile);
+    LinkProfile getLink(std::string user);
+    void send(std::string user, std::string type, std::string payload);
+    template <typename T>
+    void send(std::string user, const T& message) { send(user, T::type(), encodePayload(message)); }
+    void broadcast(std::string type, std::string payload);
+    template <typename T>
+    void broadcast(const T& message) { broadcast(T::type(), encodePayload(message)); }
+    // Topics reach every node subscribed to them, wherever it is in the mesh, including us
+    void subscribe(std::string topic, std::shared_ptr<MessageHandler> handler);
+    void unsubscribe(std::string topic, std::shared_ptr<MessageHandler> handler);
+    void publish(std::string topic, std::string type, std::string payload);
+    template <typename T>
+    void publish(std::string topic, const T& message) { publish(topic, T::type(), encodePayload(message)); }
+    // Request/response. A method is named after its request's message type and answers with a
+    // message of its own, calls finish through their callback or future with a status either way.
+    template <typename Request, typename Response>
+    void serve(std::function<RpcStatus(std::string sender, const Request& request, Response& response)> method);
+    template <typename Response, typename Request>
+    sf::Uint32 call(std::string user, const Request& request, std::function<void(RpcStatus status, const Response& response)> callback, unsigned int timeout = kRpcTimeout);
+    template <typename Response, typename Request>
+    std::future<RpcResult<Response>> call(std::string user, const Request& request, unsigned int timeout = kRpcTimeout, sf::Uint32* id = nullptr);
+    bool cancel(sf::Uint32 id);
     unsigned int numberOfConnections();
+    bool getRoutePing(std::string user, unsigned long long& ping);
+    std::vector<std::string> getRoute(std::string user);
+    unsigned short getListeningPort() const { return listeningPort; }
+    std::string getName() const { return name; }
     void listConnections();
     void listHandlers();
+    void listTopics();
+    void listCompression();
+    void listMetrics();
+    MetricsRegistry& getMetrics() { return metrics; }
+    MetricsExporter& getExporter() { return exporter; }
+    void setTraceSampling(unsigned int every);
 private:
     // Local info
     sf::IpAddress localAddress;
@@ -115,52 +205,160 @@ private:
 
     // Listening and handling new clients
     void listen();
-    bool addConnection(std::unique_ptr<sf::TcpSocket> user);
-    bool craftConnection(std::unique_ptr<sf::TcpSocket> user, Json::Value info);
+    bool addConnection(std::unique_ptr<Channel> user);
+    bool craftConnection(std::unique_ptr<Channel> user, InfoMessage info);
     void removeConnection(std::string user);
     bool connectionExists(std::string user);
 
     std::thread listenerThread;
-    std::unique_ptr<sf::TcpListener> listener; // Socket listener
-    std::unique_ptr<sf::SocketSelector> selector;
+    std::unique_ptr<Transport> transport; // Listener and multiplexer for every connection
     bool listening;
 
     // Ping measuring 
     void pingConnection(std::string);
     void ping(std::string name);
-    void pong(std::string name, Json::Value message);
-    void updatePing(std::string name, Json::Value message);
+    void pong(std::string name, PingMessage message);
+    void updatePing(std::string name, PongMessage message);
 
     // Message handling
     void handleMessage(Message message);
     void handleContent(Message message);
     void sendMessage(std::string userToSendTo, Message message);
+    void transmit(EmulatedFrame& frame);
     void forwardMessage(Message message);
+    std::string nextHop(const Message& message);
     bool isSystemMessage(Message message);
-    Message craftMessage(std::string userToSendTo, std::string type, Json::Value contents, bool directRoute = false);
+    void packFrame(std::string userToSendTo, const Message& message, sf::Packet& packet);
+    bool unpackFrame(sf::Packet& packet, Message& message);
+    Message craftMessage(std::string userToSendTo, std::string type, std::string payload, bool directRoute = false);
+    template <typename T>
+    Message craftMessage(std::string userToSendTo, const T& contents, bool directRoute = false) {
+        return craftMessage(userToSendTo, T::type(), encodePayload(contents), directRoute);
+    }
 
     std::thread heartbeatThread;
     bool sendingHeartbeats;
 
+    // Frame compression, keyed by message type
+    void recordCompression(std::string type, std::size_t rawBytes, std::size_t compressedBytes, unsigned long long compressMicroseconds, unsigned long long decompressMicroseconds);
+    std::map<std::string, CompressionStats> compressionStats;
+    std::mutex compressionMutex;
+
+    // Traffic, failures and latencies per peer and per message type. Per peer ones live on the
+    // connection, the rest are cached by name the first time they're used.
+    struct TypeMetrics {
+        Counter* messagesIn;
+        Counter* messagesOut;
+        Histogram* dispatch;
+    };
+    struct TopicMetrics {
+        Counter* published;
+        Counter* deliveries;
+        Counter* copies;
+    };
+    struct MethodMetrics {
+        Counter* calls;
+        Histogram* serve;
+    };
+    TypeMetrics& typeMetrics(const std::string& type);
+    TopicMetrics& topicMetrics(const std::string& topic);
+    MethodMetrics& methodMetrics(const std::string& method);
+    MetricsRegistry metrics;
+    MetricsExporter exporter;
+    std::map<std::string, TypeMetrics> typeMetricsCache;
+    std::map<std::string, TopicMetrics> topicMetricsCache;
+    std::map<std::string, MethodMetrics> methodMetricsCache;
+    std::mutex metricsCacheMutex;
+
+    // Every traceSampling'th message this node sends gets a trace id, 0 turns tracing off
+    sf::Uint64 nextTraceId();
+    std::atomic<unsigned int> traceSampling;
+    std::atomic<sf::Uint32> traceCounter;
+
+    // Impaired links hold frames here before they reach the transport
+    LinkEmulator linkEmulator;
+
     // Connection exploring
     void searchConnections(std::string user);
-    void sendConnections(std::string user);
-    void receiveConnections(std::string user, Json::Value message);
-    void requestConnections(std::string user, std::vector<std::string> requestedUsers);
-    void parseConnections(Json::Value message);
-    void sendRequestedConnections(std::string user, std::vector<std::string> requestedUsers);
+    void requestConnections(std::string user);
+    RpcStatus answerConnections(std::string user, const RequestConnectionsMessage& request, ResponseConnectionsMessage& response);
+    void parseConnections(const ResponseConnectionsMessage& message);
 
     // Route handling
     void optimize(std::string user);
     bool isInRoute(std::string newUser, std::string routeToCheck);
     void purgeFromRoutes(std::string user);
     void beginOptimization(std::string userToBeOptimized, std::string userToSendThrough);
-    void forwardOptimization(Message message);
-    void returnOptimization(Message message);
+    RpcStatus forwardOptimization(const RpcRequest& request, std::string& reply);
+    void returnOptimization(const RpcReply& reply);
     std::map<std::string, std::vector<std::string>> routingTable;
     std::chrono::system_clock::time_point routingInvalidated;
 
     // Message handlers
     std::map<std::string, std::shared_ptr<MessageHandler>> handlers;
+
+    // Publish/subscribe
+    void announceSubscriptions();
+    void relaySubscriptions(std::string neighbour, const SubscriptionsMessage& message);
+    void receivePublication(PublishMessage message);
+    void deliverPublication(const PublishMessage& message);
+    void routePublication(const PublishMessage& message);
+    TopicTable topics;
+
+    // Request/response
+    sf::Uint32 callAlong(std::vector<std::string> route, std::string method, std::string payload, unsigned int timeout, bool gathering, RpcCallback callback);
+    void answerRequest(std::vector<std::string> route, RpcRequestMessage request);
+    void relayRequest(const RpcRequest& request, std::string user, std::string payload);
+    std::vector<std::string> routeTo(std::string user);
+    RpcTable rpc;
+
+    // Benchmarks/Microbenchmarks.cpp times the private primitives above directly
+    friend class MicrobenchmarkAccess;
 };
+
+template <typename Request, typename Response>
+void MeshNode::serve(std::function<RpcStatus(std::string sender, const Request& request, Response& response)> method) {
+    rpc.serve(Request::type(), [method](const RpcRequest& request, std::string& reply) -> RpcStatus {
+        Request contents;
+        if (!decodePayload(request.payload, contents)) {
+            return kRpcFailed;
+        }
+
+        Response response;
+        RpcStatus status = method(request.route.front(), contents, response);
+        if (status == kRpcOk) {
+            reply = encodePayload(response);
+        }
+        return status;
+    });
+}
+
+template <typename Response, typename Request>
+sf::Uint32 MeshNode::call(std::string user, const Request& request, std::function<void(RpcStatus status, const Response& response)> callback, unsigned int timeout) {
+    return callAlong(routeTo(user), Request::type(), encodePayload(request), timeout, false, [callback](const RpcReply& reply) {
+        Response response;
+        RpcStatus status = reply.status;
+        if (status == kRpcOk && !decodePayload(reply.payload, response)) {
+            status = kRpcFailed;
+        }
+        callback(status, response);
+    });
+}
+
+template <typename Response, typename Request>
+std::future<RpcResult<Response>> MeshNode::call(std::string user, const Request& request, unsigned int timeout, sf::Uint32* id) {
+    std::shared_ptr<std::promise<RpcResult<Response>>> promise(new std::promise<RpcResult<Response>>());
+    std::future<RpcResult<Response>> future = promise->get_future();
+
+    sf::Uint32 callId = call<Response>(user, request, [promise](RpcStatus status, const Response& response) {
+        RpcResult<Response> result;
+        result.status = status;
+        result.response = response;
+        promise->set_value(result);
+    }, timeout);
+    if (id) {
+        *id = callId;
+    }
+    return future;
+}
 #endif // __MESHNODE_H__
@@ -0,0 +1,313 @@
+#!/usr/bin/env python
+"""Generates Messages.h from the message schemas in Messages.idl.
+
+Every struct and message in the IDL becomes a plain C++ struct with typed fields, a compile time
+field layout, binary encode/decode over sf::Packet and a toJson() view for logging.
+
+Usage: python Tools/messagegen.py MeshNetworkGame/Messages.idl MeshNetworkGame/Messages.h
+"""
+import re
+import sys
+
+SCALARS = {
+    # idl type: (c++ type, json cast, fixed size in bytes)
+    'bool': ('bool', 'bool', 1),
+    'u8': ('sf::Uint8', 'Json::UInt', 1),
+    'u16': ('sf::Uint16', 'Json::UInt', 2),
+    'u32': ('sf::Uint32', 'Json::UInt', 4),
+    'u64': ('sf::Uint64', 'Json::UInt64', 8),
+    'i8': ('sf::Int8', 'Json::Int', 1),
+    'i16': ('sf::Int16', 'Json::Int', 2),
+    'i32': ('sf::Int32', 'Json::Int', 4),
+}
+
+TOKEN = re.compile(r'\s*(?:(//[^\n]*)|("[^"]*")|([A-Za-z_][A-Za-z0-9_]*)|(<|>|\{|\}|;))')
+
+
+class Field(object):
+    def __init__(self, kind, name):
+        self.kind = kind
+        self.name = name
+
+
+class Struct(object):
+    def __init__(self, name, wire_types):
+        self.name = name
+        self.wire_types = wire_types
+        self.fields = []
+
+
+def tokenize(text):
+    tokens = []
+    position = 0
+    text = text.rstrip()
+    while position < len(text):
+        match = TOKEN.match(text, position)
+        if not match:
+            raise SyntaxError('Unexpected input at offset %d: %r' % (position, text[position:position + 20]))
+        position = match.end()
+        if match.group(1):
+            continue
+        tokens.append(match.group(2) or match.group(3) or match.group(4))
+    return tokens
+
+
+def parse_kind(tokens, structs):
+    kind = tokens.pop(0)
+    if kind == 'list':
+        if tokens.pop(0) != '<':
+            raise SyntaxError('Expected < after list')
+        element = parse_kind(tokens, structs)
+        if tokens.pop(0) != '>':
+            raise SyntaxError('Expected > after list element type')
+        return ('list', element)
+    if kind in SCALARS or kind == 'string':
+        return (kind,)
+    if kind in structs:
+        return ('struct', kind)
+    raise SyntaxError('Unknown type %s' % kind)
+
+
+def parse(text):
+    tokens = tokenize(text)
+    structs = {}
+    ordered = []
+    while tokens:
+        keyword = tokens.pop(0)
+        if keyword not in ('struct', 'message'):
+            raise SyntaxError('Expected struct or message, got %s' % keyword)
+        name = tokens.pop(0)
+        wire_types = []
+        while tokens[0].startswith('"'):
+            wire_types.append(tokens.pop(0).strip('"'))
+        if keyword == 'message' and not wire_types:
+            raise SyntaxError('Message %s needs a wire type' % name)
+        if tokens.pop(0) != '{':
+            raise SyntaxError('Expected { after %s' % name)
+        struct = Struct(name, wire_types)
+        while tokens[0] != '}':
+            kind = parse_kind(tokens, structs)
+            field = tokens.pop(0)
+            if tokens.pop(0) != ';':
+                raise SyntaxError('Expected ; after %s.%s' % (name, field))
+            struct.fields.append(Field(kind, field))
+        tokens.pop(0)
+        structs[name] = struct
+        ordered.append(struct)
+    return ordered
+
+
+def cpp_type(kind):
+    if kind[0] == 'list':
+        return 'std::vector<%s>' % cpp_type(kind[1])
+    if kind[0] == 'struct':
+        return kind[1]
+    if kind[0] == 'string':
+        return 'std::string'
+    return SCALARS[kind[0]][0]
+
+
+def fixed_size(struct, structs):
+    size = 0
+    for field in struct.fields:
+        kind = field.kind
+        if kind[0] in SCALARS:
+            size += SCALARS[kind[0]][2]
+        elif kind[0] == 'struct' and fixed_size(structs[kind[1]], structs):
+            size += fixed_size(structs[kind[1]], structs)
+        else:
+            return 0
+    return size
+
+
+def encode(kind, value, indent, depth=0):
+    pad = '    ' * indent
+    if kind[0] == 'list':
+        element = 'element%d' % depth
+        return ('%spacket << static_cast<sf::Uint32>(%s.size());\n' % (pad, value) +
+                '%sfor (auto& %s : %s) {\n' % (pad, element, value) +
+                encode(kind[1], element, indent + 1, depth + 1) +
+                '%s}\n' % pad)
+    if kind[0] == 'struct':
+        return '%s%s.encode(packet);\n' % (pad, value)
+    if kind[0] == 'u64':
+        return '%swriteUint64(packet, %s);\n' % (pad, value)
+    return '%spacket << %s;\n' % (pad, value)
+
+
+def decode(kind, value, indent, depth=0):
+    pad = '    ' * indent
+    if kind[0] == 'list':
+        count = 'count%d' % depth
+        element = 'element%d' % depth
+        return ('%ssf::Uint32 %s;\n' % (pad, count) +
+                '%sif (!(packet >> %s)) {\n%s    return false;\n%s}\n' % (pad, count, pad, pad) +
+                '%s%s.clear();\n' % (pad, value) +
+                '%sfor (sf::Uint32 i%d = 0; i%d < %s; i%d++) {\n' % (pad, depth, depth, count, depth) +
+                '%s    %s %s%s;\n' % (pad, cpp_type(kind[1]), element, ' = 0' if kind[1][0] in SCALARS else '') +
+                decode(kind[1], element, indent + 1, depth + 1) +
+                '%s    %s.push_back(%s);\n' % (pad, value, element) +
+                '%s}\n' % pad)
+    if kind[0] == 'struct':
+        check = '!%s.decode(packet)' % value
+    elif kind[0] == 'u64':
+        check = '!readUint64(packet, %s)' % value
+    else:
+        check = '!(packet >> %s)' % value
+    return '%sif (%s) {\n%s    return false;\n%s}\n' % (pad, check, pad, pad)
+
+
+def to_json(kind, value):
+    if kind[0] == 'struct':
+        return '%s.toJson()' % value
+    if kind[0] == 'string':
+        return value
+    return 'static_cast<%s>(%s)' % (SCALARS[kind[0]][1], value)
+
+
+def json_field(field, indent):
+    pad = '    ' * indent
+    if field.kind[0] != 'list':
+        return '%sjson["%s"] = %s;\n' % (pad, field.name, to_json(field.kind, field.name))
+    if field.kind[1][0] == 'list':
+        raise SyntaxError('Nested lists have no JSON view: %s' % field.name)
+    return ('%sjson["%s"] = Json::Value(Json::arrayValue);\n' % (pad, field.name) +
+            '%sfor (auto& element : %s) {\n' % (pad, field.name) +
+            '%s    json["%s"].append(%s);\n' % (pad, field.name, to_json(field.kind[1], 'element')) +
+            '%s}\n' % pad)
+
+
+def enumerator(name):
+    return 'k' + name[0].upper() + name[1:]
+
+
+def emit_struct(struct, structs):
+    lines = []
+    lines.append('struct %s {\n' % struct.name)
+    if struct.wire_types:
+        lines.append('    static const char* type() { return "%s"; }\n' % struct.wire_types[0])
+    enumerators = [enumerator(field.name) for field in struct.fields] + ['kFieldCount']
+    lines.append('    enum Field { %s };\n' % ', '.join(enumerators))
+    lines.append('    static const std::size_t kFixedSize = %d;\n\n' % fixed_size(struct, structs))
+    for field in struct.fields:
+        lines.append('    %s %s;\n' % (cpp_type(field.kind), field.name))
+
+    scalars = [field for field in struct.fields if field.kind[0] in SCALARS]
+    if scalars:
+        initializers = ', '.join('%s(0)' % field.name if field.kind[0] != 'bool' else '%s(false)' % field.name
+                                 for field in scalars)
+        lines.append('\n    %s(): %s {}\n' % (struct.name, initializers))
+
+    lines.append('\n    void encode(sf::Packet& packet) const {\n')
+    for field in struct.fields:
+        lines.append(encode(field.kind, field.name, 2))
+    lines.append('    }\n\n')
+
+    lines.append('    bool decode(sf::Packet& packet) {\n')
+    for field in struct.fields:
+        lines.append(decode(field.kind, field.name, 2))
+    lines.append('        return true;\n    }\n\n')
+
+    lines.append('    Json::Value toJson() const {\n        Json::Value json(Json::objectValue);\n')
+    for field in struct.fields:
+        lines.append(json_field(field, 2))
+    lines.append('        return json;\n    }\n};\n')
+    return ''.join(lines)
+
+
+PREAMBLE = '''// Generated by Tools/messagegen.py from Messages.idl, do not edit by hand
+#ifndef __MESSAGES_H__
+#define __MESSAGES_H__
+#include <SFML/Network.hpp>
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+
+// Every struct describes its layout at compile time: Field lists the fields in wire order and
+// kFixedSize is the encoded size in bytes, or 0 when a string or list makes it variable
+
+// sf::Packet stops at 32 bits, so 64 bit fields go out as two words in network order
+inline void writeUint64(sf::Packet& packet, sf::Uint64 value) {
+    packet << static_cast<sf::Uint32>(value >> 32) << static_cast<sf::Uint32>(value & 0xFFFFFFFF);
+}
+
+inline bool readUint64(sf::Packet& packet, sf::Uint64& value) {
+    sf::Uint32 high, low;
+    if (!(packet >> high >> low)) {
+        return false;
+    }
+    value = (static_cast<sf::Uint64>(high) << 32) | low;
+    return true;
+}
+
+'''
+
+POSTAMBLE = '''
+// Flatten a message into the bytes carried by Message::payload
+template <typename T>
+std::string encodePayload(const T& message) {
+    sf::Packet packet;
+    message.encode(packet);
+    return std::string(static_cast<const char*>(packet.getData()), packet.getDataSize());
+}
+
+// Rebuild a message from Message::payload, false if the bytes don't fit the schema
+template <typename T>
+bool decodePayload(const std::string& payload, T& message) {
+    sf::Packet packet;
+    packet.append(payload.data(), payload.size());
+    return message.decode(packet);
+}
+
+// Debugging view of any known payload, only used for logging
+inline Json::Value payloadToJson(const std::string& type, const std::string& payload) {
+%s
+    Json::Value unknown;
+    unknown["bytes"] = static_cast<Json::UInt>(payload.size());
+    return unknown;
+}
+
+// Every wire type declared in the schema
+inline std::vector<std::string> knownMessageTypes() {
+    std::vector<std::string> types;
+%s
+    return types;
+}
+
+#endif // __MESSAGES_H__
+'''
+
+
+def emit_dispatch(structs):
+    lines = []
+    for struct in structs:
+        for wire_type in struct.wire_types:
+            lines.append('    if (type == "%s") {\n' % wire_type +
+                         '        %s message;\n' % struct.name +
+                         '        if (decodePayload(payload, message)) {\n' +
+                         '            return message.toJson();\n' +
+                         '        }\n' +
+                         '    }\n')
+    return ''.join(lines)
+
+
+def emit_types(structs):
+    return '\n'.join('    types.push_back("%s");' % wire_type for struct in structs for wire_type in struct.wire_types)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(argv[1]) as source:
+        structs = parse(source.read())
+    lookup = dict((struct.name, struct) for struct in structs)
+    body = ''.join(emit_struct(struct, lookup) + '\n' for struct in structs)
+    with open(argv[2], 'w') as header:
+        header.write(PREAMBLE + body + POSTAMBLE % (emit_dispatch(structs).rstrip('\n'), emit_types(structs)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,156 @@
+#!/usr/bin/env python
+"""Turns metrics exported by MetricsExporter into CSV, one row per metric per snapshot.
+
+Binary files (and their rotated siblings, pass them oldest first) become
+    timestamp_ns,metric,value
+with counters as running totals and each histogram expanded into _count, _sum, _p50, _p90 and
+_p99 rows. Prometheus text files are passed through as the same columns.
+
+Usage: python Tools/metrics2csv.py metrics.bin.2 metrics.bin.1 metrics.bin > metrics.csv
+"""
+import csv
+import sys
+
+MAGIC = b'MNGM'
+VERSION = 1
+NAME = 1
+SNAPSHOT = 2
+COUNTER = 0
+HISTOGRAM = 1
+
+# Must match kHistogramSubBuckets and kHistogramBuckets in Metrics.h
+SUB_BUCKETS = 8
+BUCKETS = 38 * SUB_BUCKETS
+PERCENTILES = (('p50', 0.5), ('p90', 0.9), ('p99', 0.99))
+
+
+class Reader(object):
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.offset = 0
+
+    def done(self):
+        return self.offset >= len(self.data)
+
+    def byte(self):
+        value = self.data[self.offset]
+        self.offset += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+
+    def bytes(self, length):
+        value = bytes(self.data[self.offset:self.offset + length])
+        self.offset += length
+        return value
+
+
+def bucket_lower_bound(index):
+    if index < SUB_BUCKETS:
+        return index
+    top = index // SUB_BUCKETS + 2
+    return (SUB_BUCKETS + index % SUB_BUCKETS) << (top - 3)
+
+
+def percentile(buckets, count, fraction):
+    target = int(fraction * count)
+    seen = 0
+    for index, value in enumerate(buckets):
+        seen += value
+        if seen > target:
+            return bucket_lower_bound(index)
+    return bucket_lower_bound(BUCKETS - 1)
+
+
+def read_binary(data, writer):
+    reader = Reader(data)
+    if reader.bytes(len(MAGIC)) != MAGIC or reader.varint() != VERSION:
+        raise ValueError('Not a version %d metrics file' % VERSION)
+
+    names = []
+    kinds = []
+    values = []
+    timestamp = 0
+    while not reader.done():
+        kind = reader.byte()
+        if kind == NAME:
+            index = reader.varint()
+            metric_kind = reader.byte()
+            name = reader.bytes(reader.varint()).decode('utf-8')
+            if index != len(names):
+                raise ValueError('Metric %s is out of order' % name)
+            names.append(name)
+            kinds.append(metric_kind)
+            values.append([0] if metric_kind == COUNTER else [0, 0, [0] * BUCKETS])
+        elif kind == SNAPSHOT:
+            timestamp += reader.varint()
+            known = reader.varint()
+            counters = [i for i in range(known) if kinds[i] == COUNTER]
+            histograms = [i for i in range(known) if kinds[i] == HISTOGRAM]
+            for i in counters:
+                values[i][0] += reader.varint()
+            for i in histograms:
+                values[i][0] += reader.varint()
+            for i in histograms:
+                values[i][1] += reader.varint()
+            for i in histograms:
+                bucket = 0
+                for _ in range(reader.varint()):
+                    bucket += reader.varint()
+                    values[i][2][bucket] += reader.varint()
+
+            for i in range(known):
+                if kinds[i] == COUNTER:
+                    writer.writerow([timestamp, names[i], values[i][0]])
+                    continue
+                count, total, buckets = values[i]
+                writer.writerow([timestamp, suffixed(names[i], '_count'), count])
+                writer.writerow([timestamp, suffixed(names[i], '_sum'), total])
+                for label, fraction in PERCENTILES:
+                    writer.writerow([timestamp, suffixed(names[i], '_' + label), percentile(buckets, count, fraction) if count else 0])
+        else:
+            raise ValueError('Unknown record %d at offset %d' % (kind, reader.offset - 1))
+
+
+def suffixed(name, suffix):
+    labels = name.find('{')
+    if labels < 0:
+        return name + suffix
+    return name[:labels] + suffix + name[labels:]
+
+
+def read_prometheus(text, writer):
+    for line in text.splitlines():
+        if not line or line.startswith('#'):
+            continue
+        # Label values may hold spaces, so split from the right: name value timestamp
+        name, value, milliseconds = line.rsplit(' ', 2)
+        writer.writerow([int(milliseconds) * 1000000, name, value])
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    writer = csv.writer(sys.stdout)
+    writer.writerow(['timestamp_ns', 'metric', 'value'])
+    for filename in argv[1:]:
+        with open(filename, 'rb') as source:
+            data = source.read()
+        if data.startswith(MAGIC):
+            read_binary(data, writer)
+        else:
+            read_prometheus(data.decode('utf-8'), writer)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))